@@ -0,0 +1,164 @@
+//
+// Forward kinematics and Jacobian of the iCub arm for many configurations: iKin, ArmKinematics and BatchKinematics.
+//
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <yarp/os/LogStream.h>
+#include <yarp/os/ResourceFinder.h>
+#include <yarp/sig/Vector.h>
+#include <yarp/sig/Matrix.h>
+#include <iCub/iKin/iKinFwd.h>
+#include "armKinematics.h"
+#include "batchKinematics.h"
+
+using namespace yarp::os;
+using namespace yarp::sig;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double microseconds(const Clock::time_point& start, const size_t n)
+    {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / n;
+    }
+}
+
+
+int main(int argc, char * argv[])
+{
+    ResourceFinder rf;
+    rf.configure(argc,argv);
+
+    if (rf.check("help"))
+    {
+        yInfo(" ");
+        yInfo("Options:");
+        yInfo(" ");
+        yInfo("   --part           part: the arm, left or right. Default left.");
+        yInfo("   --torso                released torso links (10 DOF instead of 7).");
+        yInfo("   --configurations int:  number of random configurations. Default 100000.");
+        yInfo(" ");
+        return 0;
+    }
+
+    std::string part = "left";
+    if (rf.check("part"))
+    {
+        part = rf.find("part").asString();
+    }
+    size_t configurations = 100000;
+    if (rf.check("configurations"))
+    {
+        configurations = static_cast<size_t>(std::max(1, rf.find("configurations").asInt32()));
+    }
+
+    iCub::iKin::iCubArm arm(part+"_v2");
+    if (rf.check("torso"))
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            arm.releaseLink(i);
+        }
+    }
+    iCub::iKin::iKinChain& chain = *arm.asChain();
+    const int dof = static_cast<int>(chain.getDOF());
+
+    ArmKinematics single;
+    BatchKinematics batched;
+    if (!single.configure(chain) || !batched.configure(chain))
+    {
+        yError("The chain has more than %d links", ArmKinematics::MAX_LINKS);
+        return 1;
+    }
+
+    // configurations within the joint limits, so that setAng() does not change them
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<Vector> qs(configurations, Vector(dof));
+    BatchKinematics::Batch batch;
+    batch.resize(configurations, dof);
+    for (size_t k = 0; k < configurations; k++)
+    {
+        for (int i = 0; i < dof; i++)
+        {
+            qs[k][i] = chain(i).getMin() + unit(gen) * (chain(i).getMax() - chain(i).getMin());
+        }
+        batch.setConfiguration(k, qs[k]);
+    }
+    yInfo("%s arm, %d DOF, %lu configurations", part.c_str(), dof, configurations);
+
+    // iKin
+    std::vector<Matrix> H(configurations), J(configurations);
+    Clock::time_point start = Clock::now();
+    for (size_t k = 0; k < configurations; k++)
+    {
+        arm.setAng(qs[k]);
+        H[k] = arm.getH();
+    }
+    const double tIKin = microseconds(start, configurations);
+    start = Clock::now();
+    for (size_t k = 0; k < configurations; k++)
+    {
+        arm.setAng(qs[k]);
+        H[k] = arm.getH();
+        J[k] = arm.GeoJacobian();
+    }
+    const double tIKinJ = microseconds(start, configurations);
+
+    // one configuration at a time
+    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d>> Hs(configurations);
+    std::vector<ArmKinematics::Jacobian, Eigen::aligned_allocator<ArmKinematics::Jacobian>> Js(configurations);
+    start = Clock::now();
+    for (size_t k = 0; k < configurations; k++)
+    {
+        single.compute(qs[k].data());
+        Hs[k] = single.endEffector();
+        Js[k] = single.jacobian();
+    }
+    const double tSingle = microseconds(start, configurations);
+
+    // batched
+    start = Clock::now();
+    batched.compute(batch, false);
+    const double tBatch = microseconds(start, configurations);
+    start = Clock::now();
+    batched.compute(batch, true);
+    const double tBatchJ = microseconds(start, configurations);
+
+    double errSingle = 0.0, errH = 0.0, errJ = 0.0;
+    for (size_t k = 0; k < configurations; k++)
+    {
+        for (int r = 0; r < 3; r++)
+        {
+            errH = std::max(errH, std::abs(H[k](r, 3) - batch.position(k, r)));
+            for (int c = 0; c < 4; c++)
+            {
+                errSingle = std::max(errSingle, std::abs(H[k](r, c) - Hs[k](r, c)));
+                if (c < 3) errH = std::max(errH, std::abs(H[k](r, c) - batch.rotation(k, r, c)));
+            }
+        }
+        for (int r = 0; r < 6; r++)
+        {
+            for (int c = 0; c < dof; c++)
+            {
+                errSingle = std::max(errSingle, std::abs(J[k](r, c) - Js[k](r, c)));
+                errJ = std::max(errJ, std::abs(J[k](r, c) - batch.jacobian(k, r, c)));
+            }
+        }
+    }
+
+    yInfo("                        pose [us]   pose and Jacobian [us]");
+    yInfo("  iKin setAng/getH      %9.3f   %9.3f", tIKin, tIKinJ);
+    yInfo("  ArmKinematics                     %9.3f", tSingle);
+    yInfo("  BatchKinematics (%d)  %9.3f   %9.3f", BatchKinematics::LANES, tBatch, tBatchJ);
+    yInfo("speed-up of the batch: %.1fx (pose), %.1fx (pose and Jacobian)", tIKin / tBatch, tIKinJ / tBatchJ);
+    yInfo("largest difference from iKin: %g (ArmKinematics), %g (batch pose), %g (batch Jacobian)",
+          errSingle, errH, errJ);
+    return (errSingle < 1e-9 && errH < 1e-9 && errJ < 1e-9) ? 0 : 1;
+}
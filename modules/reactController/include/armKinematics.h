@@ -0,0 +1,144 @@
+//
+// Allocation-free DH kinematics of an iKin chain with fixed-size Eigen types.
+//
+
+#ifndef ARMKINEMATICS_H
+#define ARMKINEMATICS_H
+
+#include <array>
+#include <cmath>
+#include <Eigen/Dense>
+#include <iCub/iKin/iKinFwd.h>
+
+
+/**
+ * Forward kinematics of a serial chain in the DH convention of iKin (H = Rz(theta+offset) Tz(d) Tx(a) Rx(alpha)),
+ * built from the parameters of an existing chain, e.g. iCubArm("left_v2"). One call to compute() evaluates all the
+ * link frames, the end-effector frame and the geometric Jacobian of the DOFs, on fixed-size storage: nothing is
+ * allocated after configure(). Blocked links keep the angle they had when the chain was read, as in iKin;
+ * joint limits are not applied, the angles are used as given.
+ * iKin stays the reference for the setup: configure() has to be called again if links are blocked or released.
+ */
+class ArmKinematics
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    static constexpr int MAX_LINKS = 16;
+    typedef Eigen::Matrix<double, 6, Eigen::Dynamic, Eigen::ColMajor, 6, MAX_LINKS> Jacobian;
+
+    ArmKinematics(): n(0), nDof(0)
+    {
+        H0.setIdentity();
+        HN.setIdentity();
+        ee.setIdentity();
+    }
+
+    explicit ArmKinematics(iCub::iKin::iKinChain& chain): ArmKinematics()
+    {
+        configure(chain);
+    }
+
+    /**
+    * Reads the DH parameters, the blocked links and the base and end-effector transforms of a chain
+    * @return false if the chain has more than MAX_LINKS links
+    */
+    bool configure(iCub::iKin::iKinChain& chain)
+    {
+        if (chain.getN() > static_cast<unsigned int>(MAX_LINKS))
+        {
+            n = nDof = 0;
+            return false;
+        }
+        n = static_cast<int>(chain.getN());
+        nDof = static_cast<int>(chain.getDOF());
+        for (int j = 0; j < n; j++)
+        {
+            iCub::iKin::iKinLink& l = chain[j];
+            link[j] = {l.getA(), l.getD(), std::cos(l.getAlpha()), std::sin(l.getAlpha()), l.getOffset(), l.getAng(),
+                       l.isBlocked()};
+        }
+        toEigen(chain.getH0(), H0);
+        toEigen(chain.getHN(), HN);
+        frames[0] = H0;
+        J.resize(6, nDof);
+        return true;
+    }
+
+    int links() const { return n; }
+    int dof() const { return nDof; }
+
+    /**
+    * Evaluates the chain
+    * @param q angles of the DOFs [rad], dof() values
+    */
+    void compute(const double* q)
+    {
+        int k = 0;
+        for (int j = 0; j < n; j++)
+        {
+            const link_t& l = link[j];
+            const double theta = (l.blocked ? l.angle : q[k++]) + l.offset;
+            const double ct = std::cos(theta), st = std::sin(theta);
+            Eigen::Matrix<double, 3, 4> A;
+            A << ct, -st*l.ca,  st*l.sa, l.a*ct,
+                 st,  ct*l.ca, -ct*l.sa, l.a*st,
+                 0.0,    l.sa,     l.ca,    l.d;
+            // affine composition, the last row stays (0 0 0 1)
+            frames[j+1].topRows<3>().noalias() = frames[j].topLeftCorner<3,3>() * A;
+            frames[j+1].topRightCorner<3,1>() += frames[j].topRightCorner<3,1>();
+            frames[j+1].row(3) << 0.0, 0.0, 0.0, 1.0;
+        }
+        ee.noalias() = frames[n] * HN;
+
+        const Eigen::Vector3d pe = ee.topRightCorner<3,1>();
+        int c = 0;
+        for (int j = 0; j < n; j++)
+        {
+            if (link[j].blocked) continue;
+            const Eigen::Vector3d z = frames[j].block<3,1>(0,2);
+            J.block<3,1>(0,c) = z.cross(pe - frames[j].topRightCorner<3,1>());
+            J.block<3,1>(3,c) = z;
+            c++;
+        }
+    }
+
+    /**
+    * @param j 0 for the base frame, j+1 for the frame at the end of link j (iKinChain::getH(j, true))
+    */
+    const Eigen::Matrix4d& frame(int j) const { return frames[j]; }
+    const Eigen::Matrix4d& endEffector() const { return ee; }
+    const Jacobian& jacobian() const { return J; }
+
+    /**
+    * Copies a 4x4 iKin/yarp matrix (row-major) into an Eigen one
+    */
+    static void toEigen(const yarp::sig::Matrix& m, Eigen::Matrix4d& out)
+    {
+        out = Eigen::Map<const Eigen::Matrix<double,4,4,Eigen::RowMajor>>(m.data());
+    }
+
+    /**
+    * Copies an Eigen 4x4 matrix into an already sized yarp one, without allocating
+    */
+    static void toYarp(const Eigen::Matrix4d& m, yarp::sig::Matrix& out)
+    {
+        Eigen::Map<Eigen::Matrix<double,4,4,Eigen::RowMajor>>(out.data()) = m;
+    }
+
+private:
+    struct link_t
+    {
+        double a, d, ca, sa, offset;
+        double angle; // of a blocked link
+        bool blocked;
+    };
+
+    int n, nDof;
+    std::array<link_t, MAX_LINKS> link;
+    std::array<Eigen::Matrix4d, MAX_LINKS+1> frames;
+    Eigen::Matrix4d H0, HN, ee;
+    Jacobian J;
+};
+
+#endif //ARMKINEMATICS_H
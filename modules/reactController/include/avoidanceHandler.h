@@ -23,6 +23,9 @@
 
 #include <iCub/iKin/iKinFwd.h>
 #include "common.h"
+#include "environmentMap.h"
+#include "collisionClusterer.h"
+#include "kinematicState.h"
 
 
 
@@ -32,24 +35,75 @@ class AvoidanceHandler
 public:
     AvoidanceHandler(iCub::iKin::iKinChain &_chain, const std::vector<collisionPoint_t> &_colPoints,
                              iCub::iKin::iKinChain* _secondChain, double _useSelfColPoints, const std::string& _part,
-                             yarp::sig::Vector* data, iCub::iKin::iKinChain* _torso, unsigned int _verbosity=0);
+                             yarp::sig::Vector* data, iCub::iKin::iKinChain* _torso,
+                             const EnvironmentMap* _envMap=nullptr, unsigned int _verbosity=0);
 
-    std::deque<std::pair<yarp::sig::Vector, int>> getCtrlPointsPosition();
-    std::deque<std::pair<iCub::iKin::iKinChain, int>> getCtrlPoints() const { return ctrlPointChains; }
+    /**
+    * Control points of the constraints generated in the last cycle, in the order of the constraint rows
+    */
+    const std::vector<ctrlPoint_t>& getCtrlPoints() const { return ctrlPoints; }
 
     void getVLIM(std::vector<yarp::sig::Vector>& Aobs, std::vector<double> &bvals, bool mainpart=true);
-    
-    virtual ~AvoidanceHandler() { ctrlPointChains.clear(); }
+
+    /**
+    * First stage of getVLIM: collects the collision points of this cycle and resets the output rows
+    * @return number of constraint rows to be filled by computeVLIMRow
+    */
+    int prepareVLIM(std::vector<yarp::sig::Vector>& Aobs, std::vector<double> &bvals, bool mainpart=true);
+
+    /**
+    * Second stage of getVLIM: fills row i of Aobs and bvals; distinct rows can be computed concurrently, as they read
+    * only the snapshot taken by prepareVLIM and never the (shared) chains
+    */
+    void computeVLIMRow(int i, std::vector<yarp::sig::Vector>& Aobs, std::vector<double> &bvals);
+
+    /**
+    * Sets the reduction of the collision points done before the constraints are generated
+    * @param maxPoints maximum number of constraint rows of this arm for the perceived obstacles
+    * @param radius points of the same skin part closer than radius [m] are merged
+    */
+    void setPointBudget(int maxPoints, double radius)
+    {
+        clusterer.setBudget(maxPoints);
+        clusterer.setRadius(radius);
+    }
+
+    /**
+    * Sets how the motion of the obstacles is taken into account
+    * @param _latency the collision points are moved by their velocity times _latency [s]
+    * @param _ttcHorizon obstacles whose time-to-collision is below _ttcHorizon [s] tighten the bound in proportion
+    * to their approach speed (0 disables it)
+    */
+    void setPrediction(double _latency, double _ttcHorizon)
+    {
+        latency = _latency;
+        ttcHorizon = _ttcHorizon;
+    }
+
+    /**
+    * Sets the points of the geometric obstacles, recomputed every cycle; they are constrained by a velocity damper
+    * on their distance instead of by their magnitude
+    * @param points witness points on the links of this arm (nullptr if not used)
+    */
+    void setObstaclePoints(const std::vector<collisionPoint_t>* points) { obstaclePoints = points; }
+
+    /**
+    * Sets the cached frames of the chain, so that prepareVLIM copies them instead of recomputing them
+    * @param state kinematic state of the same chain (nullptr to query the chain)
+    */
+    void setKinematicState(const KinematicState* state) { kinState = state; }
+
+    virtual ~AvoidanceHandler() = default;
 
     const std::vector<yarp::sig::Vector>& getSelfColPointsTorso() { return selfColPoints[3]; }
 
     bool existsCtrlPoint()
     {
-        return !ctrlPointChains.empty();
+        return nCtrlPoints > 0;
     }
 
     void checkSelfCollisions(bool mainpart=true);
-    void checkTableCollisions();
+    void checkEnvironmentCollisions();
 
 protected:
     unsigned int verbosity;
@@ -58,12 +112,39 @@ protected:
     iCub::iKin::iKinChain& chain;
     iCub::iKin::iKinChain* secondChain;
     iCub::iKin::iKinChain* torso;
+    const EnvironmentMap* envMap; // signed distance field of the static workcell (nullptr if not used)
     const std::vector<collisionPoint_t> &collisionPoints;
-    std::deque<std::pair<iCub::iKin::iKinChain, int>> ctrlPointChains;
+    const std::vector<collisionPoint_t>* obstaclePoints;
+    const KinematicState* kinState;
+    std::vector<ctrlPoint_t> ctrlPoints; // one per constraint row
+    int nCtrlPoints;
+    int chainDOF; // of the chain when prepareVLIM took the snapshot
+    yarp::sig::Matrix torsoH;
+    std::vector<yarp::sig::Matrix> linkFrames; // snapshot of the chain taken by prepareVLIM, without a kinematic state
+    const std::vector<yarp::sig::Matrix>* frames; // link frames read by the rows: of the kinematic state or linkFrames
+    std::vector<bool> linkBlocked;
     std::vector<collisionPoint_t> totalColPoints;
+    CollisionClusterer clusterer;
+    double latency;
+    double ttcHorizon;
     std::vector<std::vector<yarp::sig::Vector>> selfColPoints;
     std::vector<std::vector<yarp::sig::Vector>> selfControlPoints;
-    std::vector<yarp::sig::Vector> tablePoints;
+
+    // result of the last distance computation of each (hand/forearm, body) pair and the joints it was done at
+    struct pairCache_t
+    {
+        bool valid{false};
+        bool withSecond{false};
+        double dist{0.0};
+        yarp::sig::Vector q1, q2;
+    };
+    std::vector<pairCache_t> pairCache;
+    std::vector<double> lever1, lever2; // per DOF bound on the displacement caused by a unit joint rotation
+
+    static std::vector<double> leverArms(iCub::iKin::iKinChain& c);
+    static double motionBound(const yarp::sig::Vector& q, const yarp::sig::Vector& q0, const std::vector<double>& lever);
+
+    double approachMargin(const collisionPoint_t& colPoint) const;
 
     static bool computeFoR(const yarp::sig::Vector &pos, const yarp::sig::Vector &norm, yarp::sig::Matrix &FoR);
     
@@ -0,0 +1,124 @@
+//
+// Forward kinematics and Jacobians of an iKin chain for many configurations at once, in SoA layout.
+//
+
+#ifndef BATCHKINEMATICS_H
+#define BATCHKINEMATICS_H
+
+#include <array>
+#include <vector>
+#include <yarp/sig/Vector.h>
+#include <iCub/iKin/iKinFwd.h>
+#include "armKinematics.h"
+
+
+/**
+ * Evaluates the end-effector pose and the geometric Jacobian of a chain (the arm, 7 DOF, or arm and torso, 10 DOF)
+ * for a batch of configurations, e.g. for workspace precomputation or to score several candidate motions.
+ * The configurations are stored as structure of arrays and processed LANES at a time: every step of the DH recursion
+ * is one vector operation over LANES configurations, i.e. an AVX2 register of doubles when the module is built with
+ * ENABLE_AVX2. Same convention and parameters as ArmKinematics: blocked links keep the angle they had when the chain
+ * was read and the joint limits are not applied.
+ */
+class BatchKinematics
+{
+public:
+    static constexpr int LANES = 4;
+    static constexpr int MAX_LINKS = ArmKinematics::MAX_LINKS;
+
+    /**
+     * Configurations and results, as structure of arrays per group of LANES configurations: a group holds the first
+     * angle of its LANES configurations, then the second one and so on, so that every value is one vector load or store
+     * and a group stays within a few cache lines however many configurations there are. The last group is padded,
+     * its padding configurations are evaluated too and ignored.
+     */
+    class Batch
+    {
+    public:
+        Batch(): n(0), nDof(0) {}
+
+        /**
+        * @param configurations number of configurations
+        * @param dof number of DOFs of the chain
+        */
+        void resize(size_t configurations, int dof);
+
+        size_t size() const { return n; }
+        int dof() const { return nDof; }
+
+        /**
+        * @param k configuration
+        * @param q angles of the DOFs [rad]
+        */
+        void setConfiguration(size_t k, const yarp::sig::Vector& q);
+
+        /**
+        * @param k configuration
+        * @param i DOF
+        * @return angle [rad]
+        */
+        double& q(size_t k, int i) { return qs[at(k, i, nDof)]; }
+        double q(size_t k, int i) const { return qs[at(k, i, nDof)]; }
+
+        /**
+        * @param k configuration
+        * @param r coordinate (0-2)
+        * @return end-effector position [m]
+        */
+        double position(size_t k, int r) const { return pos[at(k, r, 3)]; }
+
+        /**
+        * @param k configuration
+        * @param r, c row and column (0-2)
+        * @return end-effector rotation
+        */
+        double rotation(size_t k, int r, int c) const { return rot[at(k, 3*r+c, 9)]; }
+
+        /**
+        * @param k configuration
+        * @param r, c row (0-5) and DOF
+        * @return geometric Jacobian
+        */
+        double jacobian(size_t k, int r, int c) const { return jac[at(k, r*nDof+c, 6*nDof)]; }
+
+    private:
+        friend class BatchKinematics;
+        size_t n;
+        int nDof;
+        std::vector<double> qs, pos, rot, jac;
+
+        // value v of configuration k, among the values of a group
+        static size_t at(size_t k, int v, int values) { return (k / LANES * values + v) * LANES + k % LANES; }
+    };
+
+    BatchKinematics(): n(0), nDof(0) {}
+    explicit BatchKinematics(iCub::iKin::iKinChain& chain): BatchKinematics() { configure(chain); }
+
+    /**
+    * Reads the DH parameters, the blocked links and the base and end-effector transforms of a chain
+    * @return false if the chain has more than MAX_LINKS links
+    */
+    bool configure(iCub::iKin::iKinChain& chain);
+    int dof() const { return nDof; }
+
+    /**
+    * Evaluates all the configurations of a batch resized for dof()
+    * @param batch configurations, receives the results
+    * @param withJacobian false to compute the end-effector pose only
+    */
+    void compute(Batch& batch, bool withJacobian=true) const;
+
+private:
+    struct link_t
+    {
+        double a, d, ca, sa, offset;
+        double ct, st; // cos and sin of the angle of a blocked link, with the offset
+        bool blocked;
+    };
+
+    int n, nDof;
+    std::array<link_t, MAX_LINKS> link;
+    double H0[3][4], HN[3][4];
+};
+
+#endif //BATCHKINEMATICS_H
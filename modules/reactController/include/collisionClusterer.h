@@ -0,0 +1,59 @@
+//
+// Reduction of the collision points to a bounded set of representative clusters.
+//
+
+#ifndef COLLISIONCLUSTERER_H
+#define COLLISIONCLUSTERER_H
+
+#include <vector>
+#include <cmath>
+#include "common.h"
+
+
+/**
+ * Greedily merges collision points of the same skin part and type whose positions are closer than a radius and whose
+ * normals differ by less than a given angle. Points are visited by decreasing magnitude, so every cluster is seeded by
+ * its strongest point; the merged position and normal are magnitude-weighted averages and the cluster keeps the
+ * largest magnitude. The clusters are then ranked (highest magnitude first, ties resolved by the distance from the
+ * skin part frame) and only the first budget ones are kept, which bounds the number of QP rows per arm taken by the
+ * perceived obstacles. The points with a bound of their own (geometric obstacles, self-collisions) are not reduced.
+ */
+class CollisionClusterer
+{
+public:
+    /**
+    * @param _budget maximum number of points kept
+    * @param _radius merging distance [m] (0 disables merging)
+    * @param _maxAngle maximum angle between merged normals [rad]
+    */
+    explicit CollisionClusterer(int _budget=40, double _radius=0.03, double _maxAngle=M_PI/4);
+
+    void setBudget(int _budget) { budget = _budget; }
+    int getBudget() const { return budget; }
+    void setRadius(double _radius) { radius = _radius; }
+
+    /**
+    * Replaces the points with their ranked clusters
+    * @param points perceived collision points of one arm, expressed in the FoR of their skin parts
+    */
+    void reduce(std::vector<collisionPoint_t>& points);
+
+private:
+    struct cluster_t
+    {
+        int seed;           // index of the strongest point, whose skin part and type the cluster keeps
+        double x[3], n[3];  // magnitude-weighted sums
+        double weight;
+        double magnitude;
+        double dist;
+    };
+
+    int budget;
+    double radius;
+    double minCos;
+    std::vector<int> order;
+    std::vector<cluster_t> clusters;
+    std::vector<collisionPoint_t> reduced;
+};
+
+#endif //COLLISIONCLUSTERER_H
@@ -0,0 +1,86 @@
+//
+// Collision points of one arm, indexed by a spatial hash and expired by a timing wheel.
+//
+
+#ifndef COLLISIONPOINTSTORE_H
+#define COLLISIONPOINTSTORE_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "common.h"
+
+
+/**
+ * Keeps the collision points densely packed (so that they can be handed out as a plain vector) together with
+ * a hash of grid cells, keyed by skin part, type and quantized position, holding the points of every cell.
+ * A new measurement looks for its match only in the 27 cells around it, and every point is scheduled on a timing
+ * wheel at the cycle its magnitude or duration runs out, so both ingestion and expiry cost O(1) per point
+ * instead of a scan of the whole list.
+ */
+class CollisionPointStore
+{
+public:
+    /**
+    * @param _dT period of the control thread [s]
+    * @param _gate maximum distance [m] between a measurement and the stored point it updates (also the cell size)
+    */
+    explicit CollisionPointStore(double _dT, double _gate=0.03);
+
+    const std::vector<collisionPoint_t>& points() const { return pts; }
+    bool empty() const { return pts.empty(); }
+    size_t size() const { return pts.size(); }
+
+    /**
+    * Updates the nearest stored point of the same skin part and type within the gate that has not been
+    * updated at this stamp yet, or adds the measurement as a new point
+    * @param meas new collision point
+    * @param stamp time of the current cycle
+    * @param R rotation from the FoR of the skin part to the root FoR, at the time of the measurement
+    */
+    void merge(const collisionPoint_t& meas, double stamp, const yarp::sig::Matrix& R);
+
+    /**
+    * Advances by one cycle: decays all points and drops the ones that expire now
+    */
+    void tick();
+
+    void clear();
+
+private:
+    static constexpr double DECAY = 0.9;      // magnitude decay per cycle
+    static constexpr double MIN_MAGNITUDE = 1e-3;
+    static constexpr int WHEEL_SIZE = 256;
+
+    struct wheelEntry_t
+    {
+        int id;
+        long tick;
+    };
+
+    double dT;
+    double gate;
+    long now;
+
+    // dense storage; ids[i] is the stable id of pts[i]
+    std::vector<collisionPoint_t> pts;
+    std::vector<int> ids;
+
+    // indexed by id
+    std::vector<int> denseOf;     // -1 if the id is free
+    std::vector<uint64_t> cellOf;
+    std::vector<int> nextInCell;  // singly linked list of the ids sharing a cell
+    std::vector<long> expiry;
+    std::vector<int> freeIds;
+
+    std::unordered_map<uint64_t, int> cells; // cell key -> first id
+    std::vector<std::vector<wheelEntry_t>> wheel;
+
+    uint64_t cellKey(const collisionPoint_t& cp, int dx=0, int dy=0, int dz=0) const;
+    void link(int id);
+    void unlink(int id);
+    void schedule(int id);
+    void remove(int id);
+};
+
+#endif //COLLISIONPOINTSTORE_H
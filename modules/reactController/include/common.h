@@ -6,16 +6,25 @@
 #define COMMON_H
 #define M2MM 1000
 #define DURATION 1
+#define OBS_RANGE 0.2 // distance [m] at which an obstacle starts to be perceived (magnitude 0)
+#define MAX_TRACK_GAP 0.5 // [s] older measurements are not used for velocity estimation
+#define DAMPER_INFLUENCE 0.25 // distance [m] below which a geometric obstacle constrains the motion (di in NeoQP)
+#define DAMPER_SECURITY 0.05 // distance [m] the velocity damper keeps from a geometric obstacle (ds in NeoQP)
 
 #include <sstream>
+#include <yarp/os/Bottle.h>
+#include <yarp/sig/Matrix.h>
 #include <iCub/skinDynLib/common.h>
 #include <cstdarg>
+#include <algorithm>
 
 enum {
     TACTILE_OBS,
     VISUAL_OBS,
     PROX_OBS,
-    SELFCOL_OBS
+    SELFCOL_OBS,
+    GEOM_OBS,
+    MEMORY_OBS
 };
 
 
@@ -26,25 +35,38 @@ struct collisionPoint_t{
     double magnitude; // ~ activation level from probabilistic representation in pps - likelihood of collision
     double duration;  // how long will be collision point activated when no update come
     int type;
+    yarp::sig::Vector v; // velocity of the point in the FoR of the skin part, estimated across updates
+    double approachVel; // speed [m/s] at which the obstacle closes in on the skin (0 if receding or unknown)
+    double measMagnitude; // last measured magnitude (magnitude itself decays between updates)
+    double stamp; // time of the last update
+    double distance; // GEOM_OBS only: signed distance [m] to the obstacle surface (negative when penetrating)
+    double obsNormalVel; // GEOM_OBS only: velocity of the obstacle along n (positive if moving away)
 
-    explicit collisionPoint_t(int typ): magnitude(1), skin_part(iCub::skinDynLib::SKIN_PART_UNKNOWN), duration(DURATION), type(typ)
+    explicit collisionPoint_t(int typ): magnitude(1), skin_part(iCub::skinDynLib::SKIN_PART_UNKNOWN), duration(DURATION), type(typ),
+                                        approachVel(0), measMagnitude(1), stamp(0),
+                                        distance(0), obsNormalVel(0)
     {
         x.resize(3);
         n.resize(3);
+        v.resize(3, 0.0);
     }
     collisionPoint_t(iCub::skinDynLib::SkinPart _skinPart, std::vector<double> pos, int typ, double mag = 1):
-            skin_part(_skinPart), magnitude(mag), duration(DURATION), type(typ)
+            skin_part(_skinPart), magnitude(mag), duration(DURATION), type(typ), approachVel(0), measMagnitude(mag), stamp(0),
+            distance(0), obsNormalVel(0)
     {
         x.resize(3);
         x = {pos[0], pos[1], pos[2]};
         n.resize(3);
+        v.resize(3, 0.0);
     }
 
     explicit collisionPoint_t(iCub::skinDynLib::SkinPart _skinPart, int typ,  double mag=1):
-            skin_part(_skinPart), magnitude(mag), duration(DURATION), type(typ)
+            skin_part(_skinPart), magnitude(mag), duration(DURATION), type(typ), approachVel(0), measMagnitude(mag), stamp(0),
+            distance(0), obsNormalVel(0)
     {
         x.resize(3);
         n.resize(3);
+        v.resize(3, 0.0);
     }
 
     void reset(double mag=1)
@@ -53,6 +75,94 @@ struct collisionPoint_t{
         duration = DURATION;
     }
 
+    /**
+    * Updates the point with a new measurement of the same obstacle, estimating its velocity and approach speed
+    * from the displacement and from the change of the measured magnitude (~ proximity) since the last update
+    * @param meas new measurement
+    * @param now time of the measurement
+    * @param R rotation from the FoR of the skin part (x, v) to the root FoR (n)
+    */
+    void track(const collisionPoint_t& meas, double now, const yarp::sig::Matrix& R)
+    {
+        const double dt = now - stamp;
+        if (dt > 1e-3 && dt < MAX_TRACK_GAP)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                v[k] = 0.5*v[k] + 0.5*(meas.x[k] - x[k])/dt;
+            }
+            double closing = 0.0;
+            for (int k = 0; k < 3; k++)
+            {
+                // n points out of the skin, towards the obstacle
+                closing -= (R(k,0)*v[0] + R(k,1)*v[1] + R(k,2)*v[2]) * meas.n[k];
+            }
+            closing = std::max(closing, (meas.magnitude - measMagnitude) * OBS_RANGE / dt);
+            approachVel = 0.5*approachVel + 0.5*std::max(0.0, closing);
+        }
+        else
+        {
+            v.zero();
+            approachVel = 0.0;
+        }
+        x = meas.x;
+        n = meas.n;
+        reset(meas.magnitude);
+        duration = meas.duration;
+        measMagnitude = meas.magnitude;
+        stamp = now;
+    }
+
+};
+
+/**
+ * Control point of an obstacle constraint, as generated in the current cycle
+ */
+struct ctrlPoint_t{
+    yarp::sig::Vector pos; // position in the root FoR
+    yarp::sig::Vector n; // normal in the root FoR
+    int dof; // number of joints of the subchain moving the point (identifies the body part)
+    iCub::skinDynLib::SkinPart skin_part;
+    int type;
+    double bound; // right-hand side of the constraint row
+
+    ctrlPoint_t(): dof(0), skin_part(iCub::skinDynLib::SKIN_PART_UNKNOWN), type(TACTILE_OBS), bound(0)
+    {
+        pos.resize(3, 0.0);
+        n.resize(3, 0.0);
+    }
+};
+
+/**
+ * Collision point of an aggregated skin, pps or proximity event, as read from its port
+ * (skinPart_s x y z o1 o2 o3 ... magnitude), with position and normal in the FoR of the skin part
+ */
+struct portEvent_t{
+    iCub::skinDynLib::SkinPart skin_part;
+    double x[3];
+    double n[3];
+    double activation;
+    unsigned int bottle; // sequence number of the bottle it came in
 };
 
+/**
+ * @param bot one event
+ * @param type TACTILE_OBS, VISUAL_OBS or PROX_OBS; the pps events carry the direction of the obstacle in 10-12
+ * @param bottle sequence number of the bottle
+ */
+inline portEvent_t parsePortEvent(const yarp::os::Bottle& bot, int type, unsigned int bottle)
+{
+    portEvent_t e;
+    e.skin_part = static_cast<iCub::skinDynLib::SkinPart>(bot.get(0).asInt32());
+    const int nIdx = (type == VISUAL_OBS) ? 10 : 4;
+    for (int i = 0; i < 3; i++)
+    {
+        e.x[i] = bot.get(1+i).asFloat64();
+        e.n[i] = bot.get(nIdx+i).asFloat64();
+    }
+    e.activation = bot.get(13).asFloat64();
+    e.bottle = bottle;
+    return e;
+}
+
 #endif //COMMON_H
@@ -0,0 +1,104 @@
+//
+// Thread reading the control modes of the controlled parts at a low rate, off the control cycle.
+//
+
+#ifndef CTRLMODEMONITOR_H
+#define CTRLMODEMONITOR_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <yarp/dev/ControlBoardInterfaces.h>
+#include "doubleBuffer.h"
+
+
+/**
+ * Keeps the control modes of the joints of some parts (each read through its IControlMode) and hands them to the
+ * control thread as a snapshot, so that the control cycle checks and sets the modes from the cache instead of asking
+ * the control boards every cycle. The modes are read every period, and at once when refresh() is called, e.g. after
+ * a command was refused. A part whose modes can not be read keeps the last ones read.
+ */
+class CtrlModeMonitor
+{
+public:
+    static constexpr int MAX_PARTS = 3;
+    static constexpr int MAX_JOINTS = 16;
+
+    struct modes_t
+    {
+        int parts{0};
+        int joints[MAX_PARTS]{};
+        int modes[MAX_PARTS][MAX_JOINTS]{};
+        double stamp{0.0}; // time of the read
+    };
+
+    /**
+    * @param _period time [s] between two reads
+    * @param _verbosity verbosity level
+    */
+    explicit CtrlModeMonitor(double _period, unsigned int _verbosity=0);
+    ~CtrlModeMonitor();
+
+    CtrlModeMonitor(const CtrlModeMonitor&) = delete;
+    CtrlModeMonitor& operator=(const CtrlModeMonitor&) = delete;
+
+    /**
+    * Adds a part to read, before start()
+    * @param joints number of joints monitored, the first ones of the part
+    * @return index of the part in modes_t, -1 if there are too many parts or joints
+    */
+    int addPart(const std::string& name, yarp::dev::IControlMode* imod, int joints);
+
+    /**
+    * Reads the modes once on the calling thread, so that they are ready to take(), then goes on in the background
+    */
+    void start();
+    void stop();
+
+    /**
+    * Asks for a read as soon as possible, without waiting for it
+    */
+    void refresh();
+
+    /**
+    * Consumer only
+    * @param dst receives the last modes read, if they were not taken yet
+    * @return true if new modes were taken
+    */
+    bool take(modes_t& dst) { return snapshots.take(dst); }
+
+    /**
+    * @return native handle of the thread (valid once started)
+    */
+    std::thread::native_handle_type nativeHandle() { return worker.native_handle(); }
+
+    unsigned long reads() const;
+    unsigned long failures() const; // reads refused by a part
+
+private:
+    struct part_t
+    {
+        std::string name;
+        yarp::dev::IControlMode* imod;
+        int joints;
+    };
+
+    std::vector<part_t> parts;
+    double period;
+    unsigned int verbosity;
+    modes_t last; // last modes read, only used by the thread reading them
+    DoubleBuffer<modes_t> snapshots;
+    std::thread worker;
+    mutable std::mutex mtx;
+    std::condition_variable wakeCv;
+    bool started, stopping, pending;
+    unsigned long nReads, nFailures;
+
+    void poll();
+    void workerLoop();
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //CTRLMODEMONITOR_H
@@ -0,0 +1,79 @@
+//
+// Double-buffered snapshot handed from one pipeline stage to the next.
+//
+
+#ifndef DOUBLEBUFFER_H
+#define DOUBLEBUFFER_H
+
+#include <mutex>
+#include <utility>
+
+
+/**
+ * Two instances of T, one written by the producer stage and one published to the consumer stage. The producer fills
+ * back() with no lock held and publish() makes it the front one; the consumer take()s the front one by swapping it
+ * with its own instance, so that no copy is made and the buffers keep their capacity from cycle to cycle. If the
+ * producer publishes twice before the consumer takes, the older snapshot is dropped.
+ * The producer calls back() again after every publish(); the instance it gets may hold data taken by the consumer
+ * long before, so it has to overwrite (or clear) all of it.
+ */
+template <typename T>
+class DoubleBuffer
+{
+public:
+    DoubleBuffer(): front(0), fresh(false), dropped(0) {}
+
+    DoubleBuffer(const DoubleBuffer&) = delete;
+    DoubleBuffer& operator=(const DoubleBuffer&) = delete;
+
+    /**
+    * @return the instance to fill, for the producer only
+    */
+    T& back()
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        return buffers[1 - front];
+    }
+
+    /**
+    * Makes the back instance available to the consumer
+    */
+    void publish()
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        if (fresh) dropped++;
+        front = 1 - front;
+        fresh = true;
+    }
+
+    /**
+    * @param dst receives the last published snapshot, if it was not taken yet (left as it is otherwise)
+    * @return true if a new snapshot was taken
+    */
+    bool take(T& dst)
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        if (!fresh) return false;
+        std::swap(dst, buffers[front]);
+        fresh = false;
+        return true;
+    }
+
+    /**
+    * @return snapshots published and overwritten before the consumer took them
+    */
+    unsigned long drops() const
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        return dropped;
+    }
+
+private:
+    mutable std::mutex mtx;
+    T buffers[2];
+    int front;
+    bool fresh;
+    unsigned long dropped;
+};
+
+#endif //DOUBLEBUFFER_H
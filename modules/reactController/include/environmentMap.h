@@ -0,0 +1,105 @@
+//
+// Static environment map precomputed into a signed distance field.
+//
+
+#ifndef ENVIRONMENTMAP_H
+#define ENVIRONMENTMAP_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <Eigen/Dense>
+
+
+/**
+ * Static obstacles of the workcell (boxes, planes and triangle meshes, all in the robot root FoR),
+ * sampled once at startup into a regular grid holding the signed distance and its gradient.
+ * Queries are a trilinear lookup, so their cost does not depend on the number of primitives.
+ * The grid is cached on disk and memory-mapped, so restarting with an unchanged description is instant.
+ *
+ * Description file format (one primitive per line, '#' starts a comment, units in meters):
+ *   bounds     xmin ymin zmin xmax ymax zmax
+ *   resolution r
+ *   box        cx cy cz sx sy sz         (axis aligned, center and full size)
+ *   plane      nx ny nz offset           (solid half-space n.x < offset)
+ *   mesh       file.obj [tx ty tz]       (triangles only, path relative to the description file)
+ */
+class EnvironmentMap
+{
+public:
+    explicit EnvironmentMap(unsigned int _verbosity=0);
+    ~EnvironmentMap();
+
+    EnvironmentMap(const EnvironmentMap&) = delete;
+    EnvironmentMap& operator=(const EnvironmentMap&) = delete;
+
+    /**
+    * Loads the environment description and maps its distance field, rebuilding the cache if it is stale; if the
+    * cache can not be written, the field is kept in memory
+    * @param descFile path of the description file
+    * @param cacheFile path of the binary cache (empty to use descFile + ".sdf")
+    * @param defaultResolution grid step used if the description does not set one
+    * @return true/false on success/failure
+    */
+    bool load(const std::string& descFile, const std::string& cacheFile="", double defaultResolution=0.02);
+
+    bool isValid() const { return grid != nullptr; }
+
+    /**
+    * Signed distance and outward normal at a point in the root FoR
+    * @param p query point
+    * @param dist signed distance to the nearest obstacle surface (negative inside)
+    * @param normal unit gradient of the distance, pointing away from the obstacle
+    * @return false if p lies outside the mapped volume or the gradient vanishes there
+    */
+    bool query(const Eigen::Vector3d& p, double& dist, Eigen::Vector3d& normal) const;
+
+private:
+    struct box_t { Eigen::Vector3d center, halfSize; };
+    struct plane_t { Eigen::Vector3d n; double offset; };
+    struct triangle_t
+    {
+        Eigen::Vector3d a, b, c, n;
+        // angle-weighted pseudo-normals of the vertices a, b, c and of the edges ab, bc, ca, which give the sign of
+        // the distance when the closest point is on a feature shared with other triangles
+        Eigen::Vector3d pn[6];
+    };
+
+    struct header_t
+    {
+        uint64_t magic;
+        uint64_t hash;
+        int32_t dims[3];
+        int32_t pad;
+        double origin[3];
+        double resolution;
+    };
+
+    unsigned int verbosity;
+    std::vector<box_t> boxes;
+    std::vector<plane_t> planes;
+    std::vector<triangle_t> triangles;
+
+    Eigen::Vector3d origin;
+    Eigen::Vector3d upper;
+    double resolution;
+    int dims[3];
+
+    // each node stores distance and gradient (4 floats), x is the fastest running index
+    const float* grid;
+    void* mapped;
+    size_t mappedSize;
+    std::vector<float> ownGrid; // the field, if it could not be cached
+
+    bool parse(const std::string& descFile, std::string& content, double defaultResolution);
+    bool loadMesh(const std::string& file, const Eigen::Vector3d& offset);
+    double signedDistance(const Eigen::Vector3d& p) const;
+    void build(std::vector<float>& data) const;
+    bool write(const std::string& cacheFile, uint64_t hash, const std::vector<float>& data) const;
+    bool mapCache(const std::string& cacheFile, uint64_t hash);
+    void unmap();
+
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //ENVIRONMENTMAP_H
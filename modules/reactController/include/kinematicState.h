@@ -0,0 +1,116 @@
+//
+// Link frames, end-effector pose and Jacobian of a chain, computed once per configuration and shared by all the users.
+//
+
+#ifndef KINEMATICSTATE_H
+#define KINEMATICSTATE_H
+
+#include <vector>
+#include <yarp/sig/Vector.h>
+#include <yarp/sig/Matrix.h>
+#include <iCub/iKin/iKinFwd.h>
+#include "armKinematics.h"
+#include "orientation.h"
+
+
+/**
+ * Owns the joint angles of an iKin chain: every configuration change goes through update(), which recomputes all the
+ * link frames and the geometric Jacobian in one pass (one 4x4 product per link instead of one product chain per
+ * getH() call); the end-effector pose is derived on first request. The controller, the QP solver
+ * and the avoidance handler read from here, so a frame is computed once per configuration whoever needs it.
+ * The chain itself must not be set elsewhere, or refresh() has to be called afterwards; setChain() again if its
+ * links are blocked or released.
+ * The frames and the Jacobian come from an ArmKinematics built from the chain; iKin computes them instead if the
+ * engine cannot model the chain or disagrees with iKin in crossCheck().
+ */
+class KinematicState
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    explicit KinematicState(iCub::iKin::iCubArm* _chain=nullptr);
+
+    /**
+    * Binds the state to a chain and computes it at the current angles of the chain
+    */
+    void setChain(iCub::iKin::iCubArm* _chain);
+    iCub::iKin::iCubArm* chain() const { return arm; }
+
+    /**
+    * Sets the joint angles of the chain
+    * @param q angles of the DOFs [rad]
+    * @return true if the configuration changed and the state was recomputed
+    */
+    bool update(const yarp::sig::Vector& q);
+
+    /**
+    * Recomputes the state at the current angles of the chain
+    */
+    void refresh();
+
+    /**
+    * @param i index of the link among all the links of the chain
+    * @return frame at the end of link i, as iKinChain::getH(i, true)
+    */
+    const yarp::sig::Matrix& H(unsigned int i) const { return frames[i+1]; }
+
+    /**
+    * @return the base frame followed by the frame at the end of every link; frames[j] is the one the axis of link j
+    * is expressed in
+    */
+    const std::vector<yarp::sig::Matrix>& getFrames() const { return frames; }
+
+    /**
+    * @return end-effector frame, as iKinChain::getH()
+    */
+    const yarp::sig::Matrix& endEffector() const { return eeFrame; }
+    yarp::sig::Vector position() const { return eeFrame.subcol(0,3,3); }
+
+    /**
+    * @return end-effector position and orientation in axis-angle, as iKinChain::EndEffPose()
+    */
+    const yarp::sig::Vector& pose();
+
+    /**
+    * @return end-effector orientation as a unit quaternion
+    */
+    const Eigen::Quaterniond& orientation();
+
+    /**
+    * @return geometric Jacobian of the DOFs, as iKinChain::GeoJacobian()
+    */
+    const yarp::sig::Matrix& jacobian();
+
+    /**
+    * Compares the engine with iKin at random configurations within the joint limits and falls back to iKin if they
+    * disagree; the angles of the chain are restored
+    * @param samples number of configurations
+    * @param tol largest difference allowed in the frames (rotation and translation [m]) and in the Jacobian
+    * @param worst largest difference found
+    * @return true if the engine is used
+    */
+    bool crossCheck(int samples, double tol, double& worst);
+    bool usesEngine() const { return useEngine; }
+
+    /**
+    * @return number of times the frames were computed
+    */
+    unsigned long computations() const { return count; }
+
+private:
+    iCub::iKin::iCubArm* arm;
+    ArmKinematics engine;
+    bool useEngine;
+    yarp::sig::Vector q;
+    std::vector<yarp::sig::Matrix> frames;
+    yarp::sig::Matrix eeFrame;
+    yarp::sig::Vector eePose;
+    yarp::sig::Matrix J;
+    Eigen::Quaterniond eeOrientation;
+    bool poseValid, orientationValid, jacobianValid;
+    unsigned long count;
+
+    void compute(const yarp::sig::Vector& qChain);
+};
+
+#endif //KINEMATICSTATE_H
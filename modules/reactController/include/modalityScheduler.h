@@ -0,0 +1,52 @@
+//
+// Processing rates of the obstacle modalities, independent of the rate of the control thread.
+//
+
+#ifndef MODALITYSCHEDULER_H
+#define MODALITYSCHEDULER_H
+
+#include <vector>
+
+
+/**
+ * Decides in which control cycles every obstacle modality is processed. A modality can be processed in every cycle
+ * (rate 0, the default), at most at a given rate [Hz] or only when new data came (rate < 0). Between two updates
+ * the collision points of the modality are kept in the FoR of their links, so the constraints still follow the
+ * arm: only their Jacobians are recomputed at the current configuration.
+ */
+class ModalityScheduler
+{
+public:
+    enum { TACTILE, VISUAL, PROXIMITY, POINT_CLOUD, GEOMETRIC, MODALITIES };
+
+    explicit ModalityScheduler(const std::vector<double>& rates=std::vector<double>(MODALITIES, 0.0)):
+            period(MODALITIES, 0.0), last(MODALITIES, -1e9)
+    {
+        for (int m = 0; m < MODALITIES && m < static_cast<int>(rates.size()); m++)
+        {
+            period[m] = rates[m] > 0.0 ? 1.0 / rates[m] : rates[m];
+        }
+    }
+
+    /**
+    * @param m modality
+    * @param now time of the current cycle
+    * @param fresh whether new data of the modality are available
+    * @return true if the modality has to be processed in this cycle
+    */
+    bool due(const int m, const double now, const bool fresh)
+    {
+        if (period[m] == 0.0) return true;
+        if (period[m] < 0.0) return fresh;
+        // half a control period of tolerance would need the period of the thread; 1 ms is below any of them
+        if (now - last[m] < period[m] - 1e-3) return false;
+        last[m] = now;
+        return true;
+    }
+
+private:
+    std::vector<double> period; // [s], 0 every cycle, < 0 on new data only
+    std::vector<double> last;
+};
+
+#endif //MODALITYSCHEDULER_H
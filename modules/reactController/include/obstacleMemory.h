@@ -0,0 +1,109 @@
+//
+// World-frame memory of the obstacles seen by any modality, stored in an octree with time-decayed occupancy.
+//
+
+#ifndef OBSTACLEMEMORY_H
+#define OBSTACLEMEMORY_H
+
+#include <vector>
+#include <Eigen/Dense>
+
+
+/**
+ * Remembers where obstacles were perceived, in the root FoR, so that they are still avoided when the arm comes back
+ * after the perception modules stopped reporting them (e.g. the pps events of a skin part that moved away).
+ * Every leaf of the octree is a cell of the given resolution holding the last obstacle point seen in it and an
+ * occupancy that decays exponentially since then. Every node also keeps the time of the last update below it, so a
+ * nearest-obstacle query descends only into the branches with recent cells and within the current best distance,
+ * i.e. O(log n) per link instead of a scan of all the cells.
+ */
+class ObstacleMemory
+{
+public:
+    struct nearest_t
+    {
+        bool valid;
+        double dist;               // distance between the segment and the obstacle point
+        double occupancy;          // decayed occupancy of the cell, in (0, 1]
+        Eigen::Vector3d onSegment; // witness point on the segment
+        Eigen::Vector3d obstacle;  // obstacle point
+    };
+
+    /**
+    * @param _resolution size of the cells [m]
+    * @param _decay time constant of the occupancy decay [s]
+    * @param _extent the memory covers the cube of half size _extent [m] around the root
+    * @param _verbosity verbosity level
+    */
+    explicit ObstacleMemory(double _resolution=0.02, double _decay=2.0, double _extent=2.0, unsigned int _verbosity=0);
+
+    /**
+    * Marks the cell of an obstacle point as occupied
+    * @param p obstacle point in the root FoR
+    * @param stamp time of the observation
+    * @param occupancy confidence of the observation, in (0, 1]
+    */
+    void insert(const Eigen::Vector3d& p, double stamp, double occupancy=1.0);
+
+    /**
+    * Finds the remembered obstacle nearest to a segment
+    * @param a, b end points of the segment in the root FoR
+    * @param now current time
+    * @param maxDist obstacles farther than maxDist [m] are left out
+    * @param skipSince cells updated at or after this time are left out (they are perceived now anyway)
+    * @param result nearest obstacle, if any
+    * @return true if an obstacle was found within maxDist
+    */
+    bool nearest(const Eigen::Vector3d& a, const Eigen::Vector3d& b, double now, double maxDist, double skipSince,
+                 nearest_t& result);
+
+    size_t size() const { return leaves.size(); }
+    void clear();
+
+private:
+    static constexpr double MIN_OCCUPANCY = 0.05; // cells below are free
+    static constexpr int MAX_LEAVES = 1 << 16;
+
+    struct node_t
+    {
+        int child[8];  // nodes, or leaves at the last level; -1 if empty
+        double latest; // last update in the subtree
+    };
+
+    struct leaf_t
+    {
+        Eigen::Vector3d p;
+        double occupancy; // at stamp
+        double stamp;
+    };
+
+    struct entry_t
+    {
+        int node;
+        int level;
+        double half;
+        Eigen::Vector3d center;
+    };
+
+    double resolution;
+    double decay;
+    double extent;
+    double horizon; // [s] after which a fully occupied cell is free
+    int depth;
+    unsigned int verbosity;
+    std::vector<node_t> nodes;
+    std::vector<leaf_t> leaves;
+    std::vector<leaf_t> live; // cells kept by prune(), allocated once
+    std::vector<entry_t> stack;
+
+    double occupancyAt(const leaf_t& l, double now) const;
+    int newNode(double stamp);
+    void prune(double now);
+
+    static double segmentPoint(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& p,
+                               Eigen::Vector3d& onSegment);
+
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //OBSTACLEMEMORY_H
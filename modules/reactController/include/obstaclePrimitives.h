@@ -0,0 +1,141 @@
+//
+// Geometric obstacles (spheres, boxes and capsules, possibly moving) and their distance to the robot links.
+//
+
+#ifndef OBSTACLEPRIMITIVES_H
+#define OBSTACLEPRIMITIVES_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <Eigen/Dense>
+#include <yarp/os/Bottle.h>
+
+
+/**
+ * Keeps the obstacles last received on a port, all in the robot root FoR, and moves them with their velocity
+ * until a new description comes or they time out. The distance to a link, modelled as a segment, is closed form
+ * for spheres and capsules; for boxes it is a line search along the segment, since the distance from a convex set
+ * is convex.
+ *
+ * Bottle format, one list per obstacle (units in meters and m/s, sizes are full sizes as in the environment map):
+ *   (sphere cx cy cz r [vx vy vz])
+ *   (box cx cy cz sx sy sz [vx vy vz [ax ay az angle]])
+ * A flat list of numbers is read as triplets of points, i.e. spheres of zero radius.
+ *
+ * People are described by skeletons instead, one list of keypoints per person:
+ *   ((name x y z) (name x y z) ...) or (((name x y z) ...) ((name x y z) ...)) for several people
+ * with the keypoint names of the skeletonRetriever (shoulderLeft, elbowLeft, handLeft, hipCenter, ...). Every bone
+ * whose two keypoints are present becomes a capsule, moving with the velocity estimated from the previous skeleton.
+ */
+class ObstaclePrimitives
+{
+public:
+    enum { SPHERE, BOX, CAPSULE };
+
+    struct primitive_t
+    {
+        int shape;
+        Eigen::Vector3d center;   // at the time of the description (first end point for a capsule)
+        Eigen::Matrix3d R;        // orientation of the box
+        Eigen::Vector3d halfSize; // half extents of the box; the radius of a sphere or capsule is halfSize[0]
+        Eigen::Vector3d vel;
+        Eigen::Vector3d end;      // second end point of a capsule, at the time of the description
+    };
+
+    static constexpr int MAX_PRIMITIVES = 64;
+
+    // the obstacles of one description, copied from the parser to the control thread without allocations
+    struct frame_t
+    {
+        int n;
+        double stamp;
+        primitive_t primitives[MAX_PRIMITIVES];
+    };
+
+    struct witness_t
+    {
+        int obstacle;               // index of the primitive
+        double dist;                // signed distance between the segment and the obstacle surface
+        Eigen::Vector3d onSegment;  // witness point on the segment
+        Eigen::Vector3d normal;     // unit direction from the segment towards the obstacle
+        Eigen::Vector3d vel;        // velocity of the obstacle
+    };
+
+    /**
+    * @param _timeout obstacles not described again for _timeout [s] are dropped
+    * @param _verbosity verbosity level
+    */
+    explicit ObstaclePrimitives(double _timeout=1.0, unsigned int _verbosity=0);
+
+    /**
+    * Replaces the obstacles with the ones in the bottle
+    * @param b description of the obstacles
+    * @param stamp time of the description
+    * @return number of obstacles read
+    */
+    int parse(const yarp::os::Bottle& b, double stamp);
+
+    /**
+    * Replaces the obstacles with the bones of the skeletons in the bottle
+    * @param b keypoints of one or more skeletons
+    * @param stamp time of the description
+    * @return number of bones read
+    */
+    int parseSkeletons(const yarp::os::Bottle& b, double stamp);
+
+    /**
+    * @param f receives the obstacles (the first MAX_PRIMITIVES) and the time of their description
+    */
+    void toFrame(frame_t& f) const;
+
+    /**
+    * Replaces the obstacles with the ones of a frame, e.g. parsed by another instance
+    */
+    void assign(const frame_t& f);
+
+    bool empty(double now) const { return primitives.empty() || now - stamp > timeout; }
+    const std::vector<primitive_t>& getPrimitives() const { return primitives; }
+
+    /**
+    * Computes the distance from the segment to every obstacle, at their current positions
+    * @param a, b end points of the segment in the root FoR
+    * @param now current time
+    * @param maxDist obstacles farther than maxDist [m] are left out
+    * @param results the witness of every obstacle within maxDist is appended
+    * @return number of witnesses appended
+    */
+    int closest(const Eigen::Vector3d& a, const Eigen::Vector3d& b, double now, double maxDist,
+                std::vector<witness_t>& results) const;
+
+private:
+    static constexpr int SEARCH_ITERATIONS = 40;
+
+    double timeout;
+    unsigned int verbosity;
+    double stamp;
+    std::vector<primitive_t> primitives;
+    std::map<std::string, Eigen::Vector3d> keypoints, prevKeypoints; // "<skeleton>/<name>" -> position
+    double prevStamp;
+
+    struct bone_t
+    {
+        const char* from;
+        const char* to;
+        double radius;
+    };
+    static const std::vector<bone_t> bones;
+
+    void addSkeleton(const yarp::os::Bottle& skeleton, int index, double dt);
+
+    static double segmentSphere(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c, double r,
+                                Eigen::Vector3d& onSegment, Eigen::Vector3d& normal);
+    static double segmentCapsule(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c,
+                                 const Eigen::Vector3d& d, double r, Eigen::Vector3d& onSegment, Eigen::Vector3d& normal);
+    static double segmentBox(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const primitive_t& box,
+                             const Eigen::Vector3d& c, Eigen::Vector3d& onSegment, Eigen::Vector3d& normal);
+
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //OBSTACLEPRIMITIVES_H
@@ -0,0 +1,78 @@
+//
+// Unit quaternion helpers for the end-effector orientation, and the conversions to the axis-angle of the interfaces.
+//
+
+#ifndef ORIENTATION_H
+#define ORIENTATION_H
+
+#include <cmath>
+#include <Eigen/Dense>
+#include <yarp/sig/Vector.h>
+#include <yarp/sig/Matrix.h>
+
+
+/**
+ * @param aa axis and angle [rad], as given by dcm2axis and by the rpc and streaming interfaces
+ * @return the same rotation as a unit quaternion
+ */
+inline Eigen::Quaterniond axisAngleToQuaternion(const yarp::sig::Vector& aa)
+{
+    const Eigen::Vector3d axis(aa[0], aa[1], aa[2]);
+    const double n = axis.norm();
+    if (n < 1e-12)
+    {
+        return Eigen::Quaterniond::Identity();
+    }
+    const double h = 0.5 * aa[3];
+    const Eigen::Vector3d v = std::sin(h) / n * axis;
+    return Eigen::Quaterniond(std::cos(h), v.x(), v.y(), v.z());
+}
+
+/**
+ * @param q unit quaternion
+ * @return axis and angle in [0, pi], as dcm2axis (all zeros for the identity)
+ */
+inline yarp::sig::Vector quaternionToAxisAngle(const Eigen::Quaterniond& q)
+{
+    const double s = q.vec().norm();
+    if (s < 1e-12)
+    {
+        return yarp::sig::Vector(4, 0.0);
+    }
+    const double sign = q.w() < 0.0 ? -1.0 : 1.0;
+    const Eigen::Vector3d axis = sign / s * q.vec();
+    return yarp::sig::Vector{axis.x(), axis.y(), axis.z(), 2.0 * std::atan2(s, sign * q.w())};
+}
+
+/**
+ * @param H rotation or homogeneous transform (the top-left 3x3 block is used)
+ * @return the rotation as a unit quaternion
+ */
+inline Eigen::Quaterniond matrixToQuaternion(const yarp::sig::Matrix& H)
+{
+    Eigen::Matrix3d R;
+    R << H(0,0), H(0,1), H(0,2),
+         H(1,0), H(1,1), H(1,2),
+         H(2,0), H(2,1), H(2,2);
+    return Eigen::Quaterniond(R);
+}
+
+/**
+ * Log map of SO(3) in closed form
+ * @param q unit quaternion
+ * @return rotation vector (axis times angle in [0, pi]) of the shortest rotation represented by q
+ */
+inline Eigen::Vector3d rotationVector(const Eigen::Quaterniond& q)
+{
+    // q and -q are the same rotation, the one with w >= 0 turns by at most pi
+    const double w = std::abs(q.w());
+    const Eigen::Vector3d v = q.w() < 0.0 ? Eigen::Vector3d(-q.vec()) : q.vec();
+    const double s = v.norm();
+    if (s < 1e-9)
+    {
+        return 2.0 / w * v; // angle/sin(angle/2) -> 2 as the angle -> 0
+    }
+    return 2.0 * std::atan2(s, w) / s * v;
+}
+
+#endif //ORIENTATION_H
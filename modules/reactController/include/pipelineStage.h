@@ -0,0 +1,90 @@
+//
+// Stage of the control pipeline: a thread running one job per control cycle, within a latency budget.
+//
+
+#ifndef PIPELINESTAGE_H
+#define PIPELINESTAGE_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+
+/**
+ * Runs a job on its own thread every time it is triggered by the control thread, so that the job for the next cycle
+ * overlaps with the rest of the current one. The job has a latency budget from its trigger: wait() blocks at most until
+ * the budget is over, and a job finishing later is counted as an overrun (its result is picked up in a later cycle).
+ * A trigger while the job is still running is skipped, so a slow stage never queues up work.
+ * Until start() is called, trigger() runs the job on the calling thread.
+ */
+class PipelineStage
+{
+public:
+    /**
+    * @param _name name of the stage, for the messages
+    * @param _budget time [s] the job may take from its trigger
+    * @param _verbosity verbosity level
+    */
+    PipelineStage(std::string _name, double _budget, unsigned int _verbosity=0);
+    ~PipelineStage();
+
+    PipelineStage(const PipelineStage&) = delete;
+    PipelineStage& operator=(const PipelineStage&) = delete;
+
+    /**
+    * Starts the thread of the stage
+    * @param _job work of one cycle
+    */
+    void start(std::function<void()> _job);
+
+    /**
+    * Waits for the running job and stops the thread
+    */
+    void stop();
+
+    /**
+    * Starts the job, unless the one of the previous trigger is still running
+    * @return false if the trigger was skipped
+    */
+    bool trigger();
+
+    /**
+    * Waits for the job of the last trigger, at most until its budget is over
+    * @return true if the job is done
+    */
+    bool wait();
+
+    unsigned long runs() const;
+    unsigned long overruns() const;
+    unsigned long skips() const;
+    double maxLatency() const; // longest job [s]
+
+    /**
+    * @return native handle of the thread of the stage (valid once started)
+    */
+    std::thread::native_handle_type nativeHandle() { return worker.native_handle(); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    std::string name;
+    Clock::duration budget;
+    unsigned int verbosity;
+    std::function<void()> job;
+    std::thread worker;
+    mutable std::mutex mtx;
+    std::condition_variable wakeCv, doneCv;
+    bool started, stopping, busy;
+    Clock::time_point triggered;
+    unsigned long nRuns, nOverruns, nSkips;
+    double longest;
+
+    void workerLoop();
+
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //PIPELINESTAGE_H
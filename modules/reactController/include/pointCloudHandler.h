@@ -0,0 +1,125 @@
+//
+// Obstacles from depth data: voxel occupancy of a point cloud and nearest obstacle to the robot links.
+//
+
+#ifndef POINTCLOUDHANDLER_H
+#define POINTCLOUDHANDLER_H
+
+#include <vector>
+#include <cstdint>
+#include <Eigen/Dense>
+#include <yarp/sig/Matrix.h>
+#include <yarp/sig/PointCloud.h>
+#include "workerPool.h"
+
+
+/**
+ * Downsamples point clouds into a fixed-size open-addressed hash of voxels, each remembering when it was last seen,
+ * so that the occupancy rolls over the last few frames without any allocation. The occupied voxels, but those of the
+ * robot itself, are then searched for the obstacle nearest to each link, modelled as a segment in the root FoR.
+ * Both the quantization of the cloud and the nearest-point search are split among the threads of a WorkerPool.
+ */
+class PointCloudHandler
+{
+public:
+    struct segment_t
+    {
+        Eigen::Vector3d a, b; // end points in the root FoR
+    };
+
+    struct nearest_t
+    {
+        bool valid;
+        double dist;               // distance between the segment and the nearest voxel center
+        Eigen::Vector3d onSegment; // witness point on the segment
+        Eigen::Vector3d obstacle;  // nearest voxel center
+    };
+
+    /**
+    * @param _voxel voxel size [m]
+    * @param _extrinsics transform from the point cloud FoR to the root FoR
+    * @param _memory voxels not seen for longer than _memory [s] are considered free
+    * @param _stride only one point every _stride of the cloud is used
+    * @param _selfRadius voxels closer than this [m] to a link of the robot are the robot itself
+    * @param _verbosity verbosity level
+    */
+    PointCloudHandler(double _voxel, const yarp::sig::Matrix& _extrinsics, double _memory=0.2, int _stride=1,
+                      double _selfRadius=0.0, unsigned int _verbosity=0);
+
+    /**
+    * Adds a point cloud to the occupancy
+    * @param cloud points in the FoR of the sensor
+    * @param stamp acquisition time
+    * @param pool threads used for the quantization
+    */
+    void integrate(const yarp::sig::PointCloud<yarp::sig::DataXYZ>& cloud, double stamp, WorkerPool& pool);
+
+    /**
+    * Voxel keys of a point cloud, without touching the occupancy (so that another thread can do it meanwhile)
+    * @param cloud points in the FoR of the sensor
+    * @param cloudKeys one key per used point, EMPTY for the invalid ones (resized if needed)
+    * @param pool threads used for the quantization
+    */
+    void quantize(const yarp::sig::PointCloud<yarp::sig::DataXYZ>& cloud, std::vector<int64_t>& cloudKeys,
+                  WorkerPool& pool) const;
+
+    /**
+    * Adds a quantized point cloud to the occupancy
+    * @param cloudKeys as given by quantize()
+    * @param stamp acquisition time
+    */
+    void integrate(const std::vector<int64_t>& cloudKeys, double stamp);
+
+    /**
+    * Collects the voxels occupied now, but those within the self radius of a link of the robot, for nearest()
+    * @param robot links of the robot in the root FoR, at the current configuration
+    * @param now current time, to discard the voxels that were not seen recently
+    * @param pool threads used for the filtering
+    * @return number of occupied voxels kept
+    */
+    int update(const std::vector<segment_t>& robot, double now, WorkerPool& pool);
+
+    /**
+    * Finds the nearest occupied voxel, as collected by the last update(), to every segment
+    * @param segments in the root FoR, e.g. the links of the robot
+    * @param results one per segment (resized if needed)
+    * @param pool threads used for the search
+    * @return number of occupied voxels
+    */
+    int nearest(const std::vector<segment_t>& segments, std::vector<nearest_t>& results, WorkerPool& pool);
+
+private:
+    static constexpr int TABLE_BITS = 16;
+    static constexpr int TABLE_SIZE = 1 << TABLE_BITS;
+    static constexpr int MAX_PROBES = 16;
+    static constexpr int CHUNKS = 16;          // work items per segment or per cloud
+    static constexpr int64_t EMPTY = INT64_MIN;
+
+    struct voxel_t
+    {
+        int64_t key;
+        double stamp;
+    };
+
+    double voxel;
+    double memory;
+    int stride;
+    double selfRadius;
+    unsigned int verbosity;
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+
+    std::vector<voxel_t> table;
+    std::vector<int64_t> keys;              // quantized cloud
+    std::vector<Eigen::Vector3f> centers;   // occupied voxels of the current cycle
+    std::vector<char> self;                 // per center, 1 if it is inside a link
+    std::vector<nearest_t> partial;         // per segment and chunk
+
+    int64_t quantize(const Eigen::Vector3d& p) const;
+    Eigen::Vector3f center(int64_t key) const;
+    void insert(int64_t key, double stamp);
+
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //POINTCLOUDHANDLER_H
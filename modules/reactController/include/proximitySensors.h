@@ -0,0 +1,67 @@
+//
+// Registry of the proximity sensors, each streaming its events on its own port.
+//
+
+#ifndef PROXIMITYSENSORS_H
+#define PROXIMITYSENSORS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "common.h"
+#include "ringPort.h"
+
+
+/**
+ * Any number of proximity sensors, given by name in the configuration; sensor i reads /<module>/<name_i>:i.
+ * The events are parsed by the reader thread of each port and drained in one pass per cycle, so that the events of
+ * the cycle can be processed (and their visualisation sent) together. The registry also remembers which sensors had an event in the previous cycle, so that
+ * their iCubGui objects are deleted only when they go silent instead of in every cycle.
+ */
+class ProximitySensors
+{
+public:
+    static constexpr size_t RING_SIZE = 16; // events of a sensor waiting for the control thread
+
+    struct reading_t
+    {
+        int sensor;
+        portEvent_t event;
+    };
+
+    explicit ProximitySensors(std::vector<std::string> _names);
+
+    bool open(const std::string& prefix);
+    void close();
+
+    int size() const { return static_cast<int>(names.size()); }
+    const std::string& getName(int i) const { return names[i]; }
+
+    /**
+    * Takes the events parsed since the last call, without waiting
+    * @return the last event of every sensor that had any
+    */
+    const std::vector<reading_t>& drain();
+
+    /**
+    * @return events lost because the rings were full
+    */
+    unsigned long drops() const;
+
+    /**
+    * Sensors whose iCubGui object has to be deleted, i.e. the ones with an event in the previous drain() and none
+    * in the last one
+    */
+    const std::vector<int>& hidden() const { return silenced; }
+
+private:
+    std::vector<std::string> names;
+    typedef RingPort<portEvent_t, RING_SIZE> port_t;
+
+    std::vector<std::unique_ptr<port_t>> ports;
+    std::vector<bool> shown;
+    std::vector<reading_t> readings;
+    std::vector<int> silenced;
+};
+
+#endif //PROXIMITYSENSORS_H
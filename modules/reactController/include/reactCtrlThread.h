@@ -24,11 +24,11 @@
 #include <yarp/os/LogStream.h>
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/dev/GazeControl.h>
+#include <yarp/dev/IEncodersTimed.h>
 
 #include <iCub/ctrl/minJerkCtrl.h>
 #include <fstream>
 #include <Eigen/Dense>
-#include <unsupported/Eigen/MatrixFunctions>
 #include <utility>
 #include <iCub/skinDynLib/dynContact.h>
 #include <iCub/skinDynLib/dynContactList.h>
@@ -39,6 +39,22 @@
 #include "particleThread.h"
 #include "avoidanceHandler.h"
 #include "visualisationHandler.h"
+#include "workerPool.h"
+#include "collisionPointStore.h"
+#include "pointCloudHandler.h"
+#include "obstaclePrimitives.h"
+#include "proximitySensors.h"
+#include "taxelProcessor.h"
+#include "modalityScheduler.h"
+#include "obstacleMemory.h"
+#include "kinematicState.h"
+#include "orientation.h"
+#include "doubleBuffer.h"
+#include "pipelineStage.h"
+#include "ringPort.h"
+#include "realtimeProfile.h"
+#include "timingHistogram.h"
+#include "ctrlModeMonitor.h"
 
 
 using namespace yarp::dev;
@@ -52,62 +68,42 @@ using namespace iCub::skinDynLib;
 #define NR_ARM_JOINTS_FOR_INTERACTION_MODE 5
 #define NR_TORSO_JOINTS 3
 
-static Eigen::Matrix3d axisAngleToMatrix(const Vector& state)
-{
-    auto mat = axis2dcm(state);
-    Eigen::Matrix3d final;
-    final << mat(0,0), mat(0,1), mat(0,2),
-        mat(1,0), mat(1,1), mat(1,2),
-        mat(2,0), mat(2,1), mat(2,2);
-    return final;
-}
-
 class LPFilterSO3
 {
 public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    LPFilterSO3(const Vector& _start, double _ts, double T=1.) : ts_(_ts), T_(T), alpha_(0)
+    LPFilterSO3(const Eigen::Quaterniond& _start, double _ts, double T=1.) : ts_(_ts), T_(T), alpha_(0)
     {
-        state_ = axisAngleToMatrix(_start);
+        state_ = _start;
     }
 
-    Vector next_value(const Vector& final_state)
+    Eigen::Quaterniond next_value(const Eigen::Quaterniond& final_state)
     {
         alpha_ += ts_/T_;
         if (alpha_ >= 1) return final_state;
-        auto final = axisAngleToMatrix(final_state);
-        Eigen::AngleAxisd error(final * state_.transpose());
-        if (error.angle() < 0.01) return final_state;
-        auto res = Eigen::AngleAxisd(step(((error.axis() * error.angle()).array() * alpha_).matrix()));
-        return Vector{res.axis().x(), res.axis().y(), res.axis().z(), res.angle()};
+        if (state_.angularDistance(final_state) < 0.01) return final_state;
+        return state_.slerp(alpha_, final_state); // along the shortest geodesic
     }
 
-    void reset(const Vector& _start, double T=1.)
+    void reset(const Eigen::Quaterniond& _start, double T=1.)
     {
-        state_ = axisAngleToMatrix(_start);
+        state_ = _start;
         alpha_ = 0;
         T_ = T;
     }
 
 private:
-    Eigen::Matrix3d step(const Eigen::Vector3d& twist)
-    {
-        Eigen::Matrix3d skew;
-        skew << 0, -twist[2], twist[1],
-            twist[2], 0, -twist[0],
-            -twist[1], twist[0], 0;
-        return skew.exp() * state_;
-    }
-
     double alpha_;
-    Eigen::Matrix3d state_;
+    Eigen::Quaterniond state_;
     double ts_, T_;
 };
 
 
 struct ArmInterface
 {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
     iCub::ctrl::Integrator *I; //if controlMode == positionDirect, we need to integrate the velocity control commands
 
     std::string part_name;  // Which arm to use: either left_arm or right_arm
@@ -117,13 +113,14 @@ struct ArmInterface
     PolyDriver       ddA;
 
     // "Classical" interfaces for the arm
-    IEncoders             *iencsA;
+    IEncodersTimed        *iencsA;
     IPositionDirect       *iposDirA;
     IControlMode          *imodA;
     IInteractionMode      *iintmodeA;
     IImpedanceControl     *iimpA;
     IControlLimits        *ilimA;
     yarp::sig::Vector     *encsA;
+    std::vector<double>    encStampsA; // time of every encoder sample
     iCub::iKin::iCubArm   *arm;
     int jntsA;
 
@@ -134,6 +131,8 @@ struct ArmInterface
     size_t chainActiveDOF;
     //parallel virtual arm and chain on which QP will be working in the positionDirect mode case
     iCub::iKin::iCubArm    *virtualArm;
+    KinematicState kin; //frames of arm, at the encoders
+    KinematicState virtualKin; //frames of virtualArm, at the integrated positions; its angles are set only through it
     iCub::ctrl::minJerkTrajGen *minJerkTarget; //if referenceGen is "minJerk"
     LPFilterSO3 *filter;
 
@@ -143,12 +142,12 @@ struct ArmInterface
     yarp::sig::Vector x_d;  // Vector that stores the new target
     yarp::sig::Vector x_home;  // Home end-effector position
 
-    //All orientation in Euler angle format
-    yarp::sig::Vector o_0;  // Initial end-effector orientation
-    yarp::sig::Vector o_t;  // Current end-effector orientation
-    yarp::sig::Vector o_n;  // Desired next end-effector orientation
-    yarp::sig::Vector o_d;  // Vector that stores the new orientation
-    yarp::sig::Vector o_home;  // Home end-effector orientation
+    //All orientation as unit quaternions; axis-angle only at the rpc and port interfaces
+    Eigen::Quaterniond o_0;  // Initial end-effector orientation
+    Eigen::Quaterniond o_t;  // Current end-effector orientation
+    Eigen::Quaterniond o_n;  // Desired next end-effector orientation
+    Eigen::Quaterniond o_d;  // Vector that stores the new orientation
+    Eigen::Quaterniond o_home;  // Home end-effector orientation
 
     //N.B. All angles in this thread are in degrees
     yarp::sig::Vector qA; //current values of arm joints (should be 7)
@@ -160,7 +159,8 @@ struct ArmInterface
     yarp::sig::Matrix lim;  //matrix with joint position limits for the current chain
     yarp::sig::Matrix vLimNominal;     //matrix with min/max velocity limits for the current chain
     yarp::sig::Matrix vLimAdapted;  //matrix with min/max velocity limits after adptation by avoidanceHandler
-    std::vector<collisionPoint_t> collisionPoints; //list of "avoidance vectors" from peripersonal space / safety margin
+    CollisionPointStore collisionPoints; //list of "avoidance vectors" from peripersonal space / safety margin
+    std::vector<collisionPoint_t> obstaclePoints; // witness points of the geometric obstacles, in the current cycle
     std::unique_ptr<AvoidanceHandler> avhdl;
     std::vector<Vector> Aobst{};
     std::vector<double> bvalues{};
@@ -182,12 +182,23 @@ struct ArmInterface
     void updateCollPoints();
     bool prepareDrivers(const std::string& robot, const std::string& name, bool stiffInteraction);
     void release();
-    void updateArm(const Vector& qT);
-    void initialization(iKinChain* chain, iKinChain* torso, int verbosity);
+    /**
+    * Reads the encoders of the arm, with their timestamps
+    * @return time of the sample (of its oldest joint), 0 if it could not be read
+    */
+    double readEncoders();
+
+    /**
+    * Updates q and the frames of the arm from the torso angles and the encoders last read
+    * @param qT torso angles (iKin order, deg)
+    * @param horizon time [s] the arm joints are extrapolated by, with the last commanded velocities
+    */
+    void updateArm(const Vector& qT, double horizon=0.0);
+    void initialization(iKinChain* chain, iKinChain* torso, const EnvironmentMap* envMap, int verbosity);
     bool checkRecoveryPath(Vector& next_x);
     void updateRecoveryPath();
     void updateNextTarget(bool&);
-    void resetTarget(const yarp::sig::Vector& _x_d, const yarp::sig::Vector& _o_d, double trajSpeed);
+    void resetTarget(const yarp::sig::Vector& _x_d, const Eigen::Quaterniond& _o_d, double trajSpeed);
 
     /**
     * Aligns joint bounds according to the actual limits of the robot
@@ -209,7 +220,10 @@ public:
     reactCtrlThread(int , std::string   , std::string   , const std::string&  _ , const std::string& ,
                     int , bool , double , double , double , double , double , std::string  ,
                     bool , bool , bool, bool , bool , bool, bool , bool , bool , bool ,
-                    particleThread *, double, double);
+                    particleThread *, double, double, std::string, double, int, int, double, double, double,
+                    bool, double, const yarp::sig::Matrix&, const std::vector<std::string>&,
+                    const std::vector<std::pair<std::string, std::string>>&, double, const std::vector<double>&, bool, double, bool,
+                    const RealtimeProfile::settings_t&, bool, double);
     // INIT
     bool threadInit() override;
     // RUN
@@ -227,10 +241,12 @@ public:
     bool setNewTarget(const yarp::sig::Vector& _x_d, bool _movingCircle);
 
     bool setNewTarget(const yarp::sig::Vector& _x_d, const yarp::sig::Vector& _o_d, bool _movingCircle);
+    bool setNewTarget(const yarp::sig::Vector& _x_d, const Eigen::Quaterniond& _o_d, bool _movingCircle);
 
     bool setBothTargets(const yarp::sig::Vector& _x_d, const yarp::sig::Vector& _x2_d, bool m_arm_constr=true);
 
     bool setBothTargets(const yarp::sig::Vector& _x_d, const yarp::sig::Vector& _o_d, const yarp::sig::Vector& _x2_d, const yarp::sig::Vector& _o2_d, bool m_arm_constr=true);
+    bool setBothTargets(const yarp::sig::Vector& _x_d, const Eigen::Quaterniond& _o_d, const yarp::sig::Vector& _x2_d, const Eigen::Quaterniond& _o2_d, bool m_arm_constr=true);
 
     // Sets the new target relative to the current position
     bool setNewRelativeTarget(const yarp::sig::Vector&);
@@ -273,6 +289,9 @@ public:
     // gets the state of the controller
     int getState() const { return state; };
 
+    // gets the timing of the stages of the control cycle, see timingSummary()
+    yarp::os::Bottle getTiming() const;
+
     // Stops the control of the robot
     bool stopControlAndSwitchToPositionMode();
 
@@ -315,6 +334,16 @@ protected:
     bool orientationControl; //if orientation should be minimized as well
     // will use the yarp rpc /icubSim/world to visualize the potential collision points
     bool visualizeCollisionPointsInSim;
+    std::string envMapFile; // description of the static environment (empty if not used)
+    double envMapResolution; // grid step of its signed distance field
+    int constraintWorkers; // extra threads of the pool computing the obstacle constraint rows
+    int maxCollisionPoints; // obstacle constraint rows per arm left after clustering
+    double clusterRadius; // merging distance of the collision points [m]
+    double obstacleLatency; // [s] collision points are extrapolated by their velocity over this time
+    double ttcHorizon; // [s] obstacles closer in time than this tighten the constraints (0 to disable)
+    bool pointCloudCollPointsOn; //if on, will be computing collision points from the point clouds on /pointcloud:i
+    bool sweptCheck; //if on, the step from q to qIntegrated is checked against the obstacles and shortened if it would pass through one
+    bool pipeline; //if on, the inputs of the next cycle are read and the data of the last one are sent by threads of their own
 
     /***************************************************************************/
     // INTERNAL VARIABLES:
@@ -334,13 +363,17 @@ protected:
 
     // "Classical" interfaces for the torso
     iCubTorso         *torso;
-    IEncoders         *iencsT;
+    IEncodersTimed    *iencsT;
     IPositionDirect   *iposDirT;
     IControlMode      *imodT;
     IControlLimits    *ilimT;
     yarp::sig::Vector *encsT;
+    std::vector<double> encStampsT; // time of every encoder sample
     int jntsT;
     yarp::sig::Vector qT; //current values of torso joints (3, in the order expected for iKin: yaw, roll, pitch)
+    double encoderStamp; // time of the encoder sample of the cycle, of the oldest part
+    bool encoderPrediction; // if on, the joints are extrapolated to the time the command is expected to be applied
+    double commandDelay; // [s] from the read of the encoders to the application of the command, besides their age
 
     // Gaze interface
     IGazeControl    *igaze;
@@ -354,22 +387,45 @@ protected:
     int ee_dist_constr{-10000};
 
     bool streamingTarget;
-    yarp::os::BufferedPort<yarp::os::Bottle> streamedTargets;
+    // last streamed target, as read from the port
+    struct streamedTarget_t
+    {
+        int size;
+        bool orientation; // 7 values, the last 4 an axis-angle (not a flag for main_arm_constr)
+        double values[16];
+    };
+    static constexpr size_t TARGET_RING = 16;
+    RingPort<streamedTarget_t, TARGET_RING> streamedTargets;
+    streamedTarget_t target;
 
     bool holding_position;
     bool comingHome;
 
     // ports and files
-    yarp::os::BufferedPort<yarp::os::Bottle> proximityEventsInPort; //coming from proximity sensor
-    yarp::os::BufferedPort<yarp::os::Bottle> proximityEvents2InPort; //coming from proximity sensor
-    yarp::os::BufferedPort<yarp::os::Bottle> proximityEventsVisuPort; //sending out proximity data
-    yarp::os::BufferedPort<yarp::os::Bottle> aggregSkinEventsInPort; //coming from /skinEventsAggregator/skin_events_aggreg:o
-    yarp::os::BufferedPort<yarp::os::Bottle> aggregPPSeventsInPort; //coming from visuoTactileRF/pps_activations_aggreg:o
+    ProximitySensors proximitySensors; //ports of the proximity sensors, as listed in the config
+    std::vector<double> proxActivations; //last activation of every proximity sensor
+    yarp::os::Bottle guiObjects; //iCubGui objects of the cycle (targets, proximity obstacles), sent with the telemetry
+    std::vector<std::pair<std::string, std::string>> rawSkinParts; //skin parts read as raw taxels, with their calibration files
+    TaxelProcessor taxels; //contacts from the raw taxels; replaces aggregSkinEventsInPort for the parts it reads
+    ModalityScheduler scheduler; //cycles in which every obstacle modality is processed
+    yarp::os::BufferedPort<yarp::os::Bottle> proximityEventsVisuPort; //sending out proximity data (one activation per sensor)
+    static constexpr size_t EVENT_RING = 256; // skin or pps events waiting for the control thread
+    RingPort<portEvent_t, EVENT_RING> aggregSkinEventsInPort; //coming from /skinEventsAggregator/skin_events_aggreg:o
+    RingPort<portEvent_t, EVENT_RING> aggregPPSeventsInPort; //coming from visuoTactileRF/pps_activations_aggreg:o
     //expected format for both: (skinPart_s x y z o1 o2 o3 magnitude), with position x,y,z and normal o1 o2 o3 in link FoR
     yarp::os::Port outPort;
     yarp::os::Port outObsPort;
     BufferedPort<skinContactList> proximityEventsForiCubGuiPort;
-    BufferedPort<Bottle>  sensManagerPort;
+    // positions of the obstacles of the sensation manager, for logging
+    static constexpr int MAX_SENS_MANAGER = 100;
+    struct sensManagerFrame_t
+    {
+        int n;
+        double pos[MAX_SENS_MANAGER][3];
+    };
+    static constexpr size_t FRAME_RING = 4; // obstacle descriptions waiting for the control thread
+    RingPort<sensManagerFrame_t, FRAME_RING> sensManagerPort;
+    sensManagerFrame_t sensManagerFrame; // last frame, drained every cycle
     std::vector<Vector> obsWorldPos;
 
     yarp::os::BufferedPort<yarp::os::Bottle> movementFinishedPort;
@@ -378,14 +434,90 @@ protected:
     yarp::os::Stamp ts;
     double t_0, t_1;
     int counter;
+    double cycleStamp; // time at which the collision points of the current cycle are read
 
     // QPSolver STUFF
     int solverExitCode;
     double timeToSolveProblem_s; //time taken by q_dot = solveIK(solverExitCode)
     Vector obstacle{0.0,0.0,0.0};
-    yarp::os::BufferedPort<yarp::os::Bottle> NeoObsInPort; //coming from python script
+    RingPort<ObstaclePrimitives::frame_t, FRAME_RING> NeoObsInPort; //coming from python script
+    RingPort<ObstaclePrimitives::frame_t, FRAME_RING> skeletonInPort; //keypoints of the people, e.g. from a 3D pose estimator
+    ObstaclePrimitives::frame_t obstacleFrame;
+    bool sensManagerNew; // sensManagerFrame came since the visual modality was last processed
+    bool primitivesNew; // obstacles or people came since their constraints were last computed
     std::unique_ptr<QPSolver> solver;
     VisualisationHandler visuhdl;
+    std::unique_ptr<EnvironmentMap> envMap;
+    std::unique_ptr<WorkerPool> workers;
+    yarp::os::BufferedPort<yarp::sig::PointCloud<yarp::sig::DataXYZ>> pointCloudInPort; // depth data, FoR set by the extrinsics
+    std::unique_ptr<PointCloudHandler> pcHandler;
+    std::vector<PointCloudHandler::nearest_t> pcNearest;
+    std::vector<PointCloudHandler::segment_t> linkSegments; // upper arm, forearm and hand of each arm, in the root FoR
+    std::vector<std::pair<ArmInterface*, SkinPart>> linkSegmentParts;
+    ObstaclePrimitives obstacles; // spheres and boxes from NeoObsInPort
+    ObstaclePrimitives people; // capsules around the bones of the skeletons from skeletonInPort
+    std::vector<ObstaclePrimitives::witness_t> obsWitnesses;
+    std::vector<PointCloudHandler::segment_t> sweptSegments; // links at the configurations sampled along the step
+    std::vector<PointCloudHandler::nearest_t> sweptNearest;
+    std::vector<double> sweptClearance; // distance of every sampled link from the obstacles
+    std::unique_ptr<ObstacleMemory> obstacleMemory; // obstacles seen by any modality, in the root FoR (nullptr if off)
+    ObstacleMemory::nearest_t memNearest;
+    std::vector<portEvent_t> portEvents; // events drained from a ring in this cycle
+    // events of the last bottle of every skin part, kept from cycle to cycle until their modality is due
+    std::vector<portEvent_t> pendingSkinEvents, pendingPPSEvents;
+
+    // inputs read by the perception stage; the flag tells whether they came since the last snapshot
+    struct perception_t
+    {
+        std::vector<int64_t> cloudKeys; // quantized point cloud
+        bool cloudNew{false};
+    };
+
+    // what sendData() and sendObsData() write to the ports
+    struct telemetry_t
+    {
+        yarp::os::Stamp ts;
+        yarp::os::Bottle data, obs;
+        yarp::os::Bottle gui; // objects for iCubGui, see VisualisationHandler::sendiCubGuiObjects; cleared once sent
+        bool dataOn{false}, obsOn{false};
+    };
+
+    ObstaclePrimitives parsedObstacles, parsedPeople; // parsers of NeoObsInPort and skeletonInPort (their reader threads)
+    DoubleBuffer<perception_t> perceptionBuffer;
+    perception_t perception; // inputs not processed yet, kept until their modality is due
+    perception_t perceptionIn; // last snapshot taken
+    DoubleBuffer<telemetry_t> telemetryBuffer;
+    telemetry_t telemetry; // data of the cycle (of the last one sent, for the telemetry stage)
+    std::unique_ptr<WorkerPool> perceptionWorkers; // serial pool of the perception stage
+    std::unique_ptr<PipelineStage> perceptionStage; // nullptr if the pipeline is off
+    std::unique_ptr<PipelineStage> telemetryStage;
+    RealtimeProfile rtProfile; // CPUs, scheduling and memory of the control thread and of its helpers
+    std::unique_ptr<CtrlModeMonitor> ctrlModeMonitor; // reads the control modes off the control cycle
+    CtrlModeMonitor::modes_t ctrlModes; // last modes known by the control thread: read by the monitor or set here
+    int ctrlModeParts[3]; // index in ctrlModes of the arm, the torso and the second arm
+    std::atomic<bool> positionModesSet; // the joints were switched to position mode, e.g. by the rpc thread
+
+    // stages of the control cycle timed on their own
+    enum timingStage_t
+    {
+        TIMING_ARM_CHAIN,   // updateArmChain()
+        TIMING_PORTS,       // getCollisionsFromPorts(): inputs taken from the ports and turned into collision points
+        TIMING_VLIM,        // rest of preprocCollisions(): velocity limits from the collision points
+        TIMING_SOLVE_IK,    // solveIK()
+        TIMING_CONTROL_ARM, // controlArm()
+        TIMING_SEND_DATA,   // sendData()
+        TIMING_SEND_OBS,    // sendObsData()
+        TIMING_WRITE,       // writeTelemetry(), on the telemetry stage if the pipeline is on
+        TIMING_CYCLE,       // whole run()
+        TIMING_PERIOD,      // from the start of a run() to the start of the next one
+        TIMING_STAGES
+    };
+    static const char* const timingNames[TIMING_STAGES];
+    std::array<TimingHistogram, TIMING_STAGES> timings; // each one is recorded by one thread and read by any
+    std::atomic<unsigned long> cycleOverruns; // run() longer than the period
+    TimingHistogram::Clock::time_point cycleStart;
+    double lastTimingSent;
+    yarp::os::BufferedPort<yarp::os::Bottle> timingPort; // summary of the timings, every TIMING_SEND_PERIOD
 
     /**
     * Solves the Inverse Kinematic task
@@ -394,6 +526,13 @@ protected:
 
     void nextMove(bool&);
 
+    /**
+    * Checks the volume swept by the links from the current configuration to the integrated one against the geometric
+    * obstacles, the point cloud and the static environment, at configurations sampled in joint space
+    * @return fraction of the step that can be done without a link entering an obstacle (1 if the whole step)
+     */
+    double sweptStepFraction();
+
     /**** kinematic chain, control, ..... *****************************/
 
     /**
@@ -430,6 +569,18 @@ protected:
     bool setCtrlModes(const std::vector<int> &jointsToSet,
                       const std::string &_p, const std::string &_s);
 
+    /**
+     * @param  _p part: "arm", "torso" or "second_arm"
+     * @return    index of the part in ctrlModes, -1 if there is no such part
+     */
+    int ctrlModePart(const std::string &_p) const;
+
+    /**
+     * Records in ctrlModes the modes just set by setCtrlModes(), until the monitor reads them
+     */
+    void cacheCtrlModes(const std::vector<int> &jointsToSet,
+                        const std::string &_p, const std::string &_s);
+
 
     bool prepareDrivers();
 
@@ -445,12 +596,55 @@ protected:
 
     void getCollisionsFromPorts();
 
+    /**
+    * Reads the point cloud and quantizes it. It is the job of the perception stage; the other inputs are parsed by
+    * the reader threads of their ports.
+    * @param in receives the inputs
+    * @param pool threads used for the quantization of the point cloud
+    */
+    void readPerception(perception_t& in, WorkerPool& pool);
+
+    /**
+    * Takes the last inputs of the perception stage (or reads them if the pipeline is off), and starts reading the ones
+    * of the next cycle
+    */
+    void receivePerception();
+
+    /**
+    * Takes the events parsed from an aggregated skin or pps port since the last call, every cycle so that the ring
+    * never fills up
+    * @param pending events of the last bottle that had each skin part (the older ones are stale), updated with the
+    * new ones
+    */
+    void drainEvents(SpscRing<portEvent_t, EVENT_RING>& ring, std::vector<portEvent_t>& pending);
+    void addCollPoints(const std::vector<portEvent_t>& events, double gain, int type);
+
+    /**
+    * Parsers of the input ports, called by their reader threads
+    */
+    static void parseEvents(const Bottle& b, int type, unsigned int seq, SpscRing<portEvent_t, EVENT_RING>& ring);
+    static void parseSensManager(const Bottle& b, SpscRing<sensManagerFrame_t, FRAME_RING>& ring);
+    static void parseStreamedTarget(const Bottle& b, SpscRing<streamedTarget_t, TARGET_RING>& ring);
+
+    /**
+    * Updates the voxel occupancy with the last point cloud and adds a collision point for every link with an
+    * obstacle within range
+    */
+    void updateLinkSegments();
+    void appendLinkSegments(const ArmInterface* a, const KinematicState& state, std::vector<PointCloudHandler::segment_t>& segments) const;
+    void getProximityCollisions();
+    void getPointCloudCollisions();
+    void getPrimitiveCollisions();
+
+    /**
+    * Adds a collision point for every link with a remembered obstacle within range that was not perceived in this cycle
+    */
+    void getMemoryCollisions();
+
     bool preprocCollisions();
     /************************** communication through ports in/out ***********************************/
 
-    void getCollPointFromPort(Bottle* bot, double gain, int type);
-
-    void getCollisionPointsFromPort(BufferedPort<Bottle> &inPort, double gain, int type);
+    void addCollPoint(SkinPart sp, const Vector& x, const Vector& n, double activation, double gain, int type);
 
     /**
      * writing to param file
@@ -458,21 +652,25 @@ protected:
     void writeConfigData();
 
     /**
-    * Sends useful data to a port in order to track it on matlab
+    * Prepares useful data for a port in order to track it on matlab
     **/
-    void sendData();
+    void sendData(telemetry_t& t);
 
     /**
-    * Sends useful data to a port in order to track it on matlab
+    * Prepares useful data for a port in order to track it on matlab
     **/
-    void sendObsData();
+    void sendObsData(telemetry_t& t);
 
     /**
-    * @brief Receive trajectories of control points from planner
-    * @param x_desired standard vector of set of 3D points
-    * @return true if received trajectories are valid, false otherwise
-     */
-    bool readMotionPlan(std::vector<yarp::sig::Vector> &x_desired);
+    * Writes the data prepared by sendData() and sendObsData() (job of the telemetry stage)
+    **/
+    void writeTelemetry(const telemetry_t& t);
+
+    /**
+    * Summary of the timings: ((stage count mean p50 p90 p99 p99.9 max) ...) (overruns n) (used t) (period t),
+    * durations in ms; used and period are the averages estimated by the PeriodicThread
+    **/
+    void timingSummary(yarp::os::Bottle& b) const;
 
     bool readStreamingTarget();
 
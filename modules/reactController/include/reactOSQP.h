@@ -8,6 +8,7 @@
 #include "common.h"
 #include <iCub/iKin/iKinFwd.h>
 #include "OsqpEigen/OsqpEigen.h"
+#include "kinematicState.h"
 
 
 using namespace yarp::os;
@@ -19,6 +20,7 @@ using namespace iCub::skinDynLib;
 
 struct ArmHelper
 {
+    KinematicState *kin; // frames of arm, shared with the controller
     iCubArm *arm;
     Vector q0, v0, rest_jnt_pos, rest_w, v_des;
     Matrix v_lim, J0, bounds;
@@ -33,10 +35,10 @@ struct ArmHelper
     constexpr static double elb_n = (90.-(40.-90.)/(105.-85.)*85.)*CTRL_DEG2RAD;
 
 
-    ArmHelper(iCubArm *chain_, double dt_, int offset_, double vmax_, const Vector& restPos,
+    ArmHelper(KinematicState *kin_, double dt_, int offset_, double vmax_, const Vector& restPos,
               bool hitting_constr_, int vars_offset_=0, int constr_offset_=0);
 
-    void init(const Vector &_xr, const Vector &_v0, const Matrix &_v_lim);
+    void init(const Vector &_xr, const Eigen::Quaterniond &_or, const Vector &_v0, const Matrix &_v_lim);
     void computeGuard();
     void computeBounds();
     void updateBounds(Eigen::VectorXd& lowerBound, Eigen::VectorXd& upperBound, double pos_error);
@@ -67,14 +69,15 @@ class QPSolver
     void update_constraints();
 
 public:
-    QPSolver(iCubArm *chain_, bool hittingConstraints_, iCubArm* second_chain_, double vmax_,
+    QPSolver(KinematicState *kin_, bool hittingConstraints_, KinematicState* second_kin_, double vmax_,
              bool orientationControl_, double dT_, const Vector& restPos, double restPosWeight, const std::string& part_);
     ~QPSolver();
 
-    void init(const Vector &_xr, const Vector &_v0, const Matrix &_v_lim, double rest_pos_w,
+    void init(const Vector &_xr, const Eigen::Quaterniond &_or, const Vector &_v0, const Matrix &_v_lim, double rest_pos_w,
               const std::vector<yarp::sig::Vector>& Aobs, const std::vector<double> &bvals,
               const std::vector<yarp::sig::Vector>& Aobs2={}, const std::vector<double> &bvals2={},
-              const Vector &_xr2 = {}, const Vector &_v02 = {}, const Matrix &_v2_lim = {}, bool ee_dist_constr=false);
+              const Vector &_xr2 = {}, const Eigen::Quaterniond &_or2 = Eigen::Quaterniond::Identity(),
+              const Vector &_v02 = {}, const Matrix &_v2_lim = {}, bool ee_dist_constr=false);
     Vector get_resultInDegPerSecond(Matrix& bounds);
     int optimize(double pos_error, bool main_arm_constr=true);
 };
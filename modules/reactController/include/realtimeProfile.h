@@ -0,0 +1,81 @@
+//
+// Real-time execution profile of the control thread: CPU affinity, SCHED_FIFO, memory locking and prefaulting.
+//
+
+#ifndef REALTIMEPROFILE_H
+#define REALTIMEPROFILE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+
+
+/**
+ * Sets up the control thread and its helper threads for deterministic cycle times: the control thread and the workers
+ * of its constraints are pinned to their own CPUs and scheduled with SCHED_FIFO, the memory of the process is locked
+ * and the heap and stack of the control thread are touched once at startup, so that no page fault happens in the
+ * cycle. Every setting is optional and applied on its own: what can not be applied (e.g. without the privileges for
+ * SCHED_FIFO or mlockall, or on another OS than Linux) is reported and the thread goes on without it.
+ */
+class RealtimeProfile
+{
+public:
+    struct settings_t
+    {
+        std::vector<int> cpus;       // CPUs of the control thread (empty for any)
+        std::vector<int> workerCpus; // CPUs of the workers and of the pipeline stages (empty for any)
+        int priority{0};             // SCHED_FIFO priority of the control thread and of the workers (0 to keep the default)
+        bool lockMemory{false};      // lock the current and future memory of the process
+        double prefault{0.0};        // [MB] heap prefaulted at startup (0 to disable), the stack is prefaulted too
+    };
+
+    /**
+    * @param _settings what to apply
+    * @param _verbosity verbosity level
+    */
+    explicit RealtimeProfile(settings_t _settings, unsigned int _verbosity=0);
+
+    bool enabled() const;
+
+    /**
+    * Locks the memory and prefaults the heap and the stack; to be called by the control thread, whose heap arena is
+    * then prefaulted
+    * @return true if all that was asked was applied
+    */
+    bool setupMemory();
+
+    /**
+    * Pins the calling thread (the control thread) to its CPUs and sets its priority
+    * @return true if all that was asked was applied
+    */
+    bool setupControlThread();
+
+    /**
+    * Pins a helper thread to the worker CPUs
+    * @param h native handle of the thread
+    * @param realtime true to give it the priority of the control thread (for the threads the cycle waits for)
+    * @return true if all that was asked was applied
+    */
+    bool setupWorker(std::thread::native_handle_type h, bool realtime);
+
+    /**
+    * @return what was applied, e.g. for the log
+    */
+    const std::vector<std::string>& achieved() const { return applied; }
+
+private:
+    static constexpr size_t STACK_PREFAULT = 256 * 1024; // [B]
+
+    settings_t settings;
+    unsigned int verbosity;
+    std::vector<std::string> applied;
+
+    bool pin(std::thread::native_handle_type h, const std::vector<int>& cpus, const std::string& what);
+    bool schedule(std::thread::native_handle_type h, int priority, const std::string& what);
+    void note(const std::string& setting);
+    static std::string cpuList(const std::vector<int>& cpus);
+
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //REALTIMEPROFILE_H
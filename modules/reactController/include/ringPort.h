@@ -0,0 +1,48 @@
+//
+// Input port parsing every bottle on its reader thread into records for the control thread.
+//
+
+#ifndef RINGPORT_H
+#define RINGPORT_H
+
+#include <functional>
+#include <utility>
+#include <yarp/os/Bottle.h>
+#include <yarp/os/BufferedPort.h>
+#include "spscRing.h"
+
+
+/**
+ * BufferedPort whose bottles are parsed in onRead(), i.e. on the reader thread of the port, into records pushed to
+ * an SpscRing of N records. The port is strict, so that a burst of bottles is queued by YARP instead of replacing
+ * the last one, and the consumer only pops the records that are ready. The parser may push any number of records
+ * per bottle; it runs on the reader thread only, so the state it keeps needs no locking.
+ */
+template <typename T, size_t N>
+class RingPort : public yarp::os::BufferedPort<yarp::os::Bottle>
+{
+public:
+    typedef std::function<void(const yarp::os::Bottle&, SpscRing<T, N>&)> parser_t;
+
+    /**
+    * @param _parse called with every bottle received and the ring to push the records to
+    */
+    explicit RingPort(parser_t _parse): parse(std::move(_parse))
+    {
+        setStrict();
+        useCallback();
+    }
+
+    void onRead(yarp::os::Bottle& b) override
+    {
+        parse(b, ring);
+    }
+
+    SpscRing<T, N>& records() { return ring; }
+
+private:
+    parser_t parse;
+    SpscRing<T, N> ring;
+};
+
+#endif //RINGPORT_H
@@ -0,0 +1,81 @@
+//
+// Lock-free ring of preallocated records, from one producer thread to one consumer thread.
+//
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+
+
+/**
+ * Bounded single-producer single-consumer queue: push() and pop() copy a record into and out of a fixed array of N
+ * slots and synchronize with one acquire/release pair, with neither locks nor allocations. A push into a full ring is
+ * refused and counted, so that a stalled consumer never blocks the producer.
+ */
+template <typename T, size_t N>
+class SpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "the capacity of the ring has to be a power of two");
+
+public:
+    SpscRing(): head(0), tail(0), dropped(0) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    static constexpr size_t capacity() { return N; }
+
+    /**
+    * Producer only
+    * @return false if the ring is full (the record is dropped)
+    */
+    bool push(const T& r)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[h & (N - 1)] = r;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+    * Consumer only
+    * @return false if the ring is empty
+    */
+    bool pop(T& r)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t)
+        {
+            return false;
+        }
+        r = slots[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+    * Consumer only
+    */
+    bool empty() const { return head.load(std::memory_order_acquire) == tail.load(std::memory_order_relaxed); }
+
+    /**
+    * @return records refused because the ring was full
+    */
+    unsigned long drops() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    std::array<T, N> slots;
+    alignas(64) std::atomic<size_t> head; // next slot to write, only written by the producer
+    alignas(64) std::atomic<size_t> tail; // next slot to read, only written by the consumer
+    alignas(64) std::atomic<unsigned long> dropped;
+};
+
+#endif //SPSCRING_H
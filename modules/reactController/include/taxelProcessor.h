@@ -0,0 +1,103 @@
+//
+// Contacts computed directly from the raw taxel pressures, without going through the skin events aggregator.
+//
+
+#ifndef TAXELPROCESSOR_H
+#define TAXELPROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+#include <yarp/sig/Vector.h>
+#include <yarp/os/BufferedPort.h>
+#include <iCub/skinDynLib/common.h>
+
+
+/**
+ * Reads the compensated taxel pressures of some skin parts (as streamed by the skin, e.g. /icub/skin/left_forearm_comp)
+ * and turns every connected blob of taxels above a threshold into a contact, with the geocenter, normal and activation
+ * that the skin events aggregator would compute. Positions and normals come from the skin calibration files and the
+ * neighbours of every taxel are precomputed at startup, so a cycle costs one pass over the pressures (a threshold
+ * over contiguous arrays) plus a visit of the active taxels only.
+ *
+ * The calibration files are the ones of skinGui: after the [calibration] line, one line "x y z nx ny nz" per taxel,
+ * in the FoR of the skin part; taxels with a zero normal are not mounted.
+ */
+class TaxelProcessor
+{
+public:
+    struct contact_t
+    {
+        iCub::skinDynLib::SkinPart skin_part;
+        yarp::sig::Vector x; // geocenter in the FoR of the skin part
+        yarp::sig::Vector n; // unit normal in the FoR of the skin part, pointing out of the skin
+        double activation;   // in [0, 1]
+        int taxels;
+    };
+
+    /**
+    * @param _threshold pressure above which a taxel is active
+    * @param _verbosity verbosity level
+    */
+    explicit TaxelProcessor(double _threshold=10.0, unsigned int _verbosity=0);
+
+    /**
+    * Loads the taxels of a skin part
+    * @param sp skin part
+    * @param calibFile positions and normals of the taxels
+    * @return true/false on success/failure
+    */
+    bool addPart(iCub::skinDynLib::SkinPart sp, const std::string& calibFile);
+
+    /**
+    * Opens one port per skin part, /prefix/skin/<skin part>:i
+    */
+    bool open(const std::string& prefix);
+    void close();
+
+    bool empty() const { return parts.empty(); }
+
+    /**
+    * @return true if the taxels of the skin part were loaded
+    */
+    bool handles(iCub::skinDynLib::SkinPart sp) const
+    {
+        return std::any_of(parts.begin(), parts.end(), [sp](const part_t& p) { return p.sp == sp; });
+    }
+
+    /**
+    * Reads the pressures of all the skin parts without waiting and clusters the active taxels
+    * @return contacts found in the parts that sent new pressures
+    */
+    const std::vector<contact_t>& process();
+
+private:
+    static constexpr double NEIGHBOR_RADIUS = 0.012; // [m] taxels closer than this belong to the same blob
+    static constexpr double SATURATION = 100.0;      // pressure giving full activation
+
+    struct part_t
+    {
+        iCub::skinDynLib::SkinPart sp;
+        int n;
+        std::vector<float> px, py, pz, nx, ny, nz; // calibration, one entry per taxel
+        std::vector<uint8_t> mounted;
+        std::vector<int> nbrStart, nbr;            // neighbours of taxel i are nbr[nbrStart[i] .. nbrStart[i+1])
+        std::vector<float> pressure;
+        std::vector<uint8_t> active;
+        std::unique_ptr<yarp::os::BufferedPort<yarp::sig::Vector>> port;
+    };
+
+    double threshold;
+    unsigned int verbosity;
+    std::vector<part_t> parts;
+    std::vector<contact_t> contacts;
+    std::vector<int> stack;
+
+    void cluster(part_t& p);
+
+    int printMessage(unsigned int l, const char *f, ...) const;
+};
+
+#endif //TAXELPROCESSOR_H
@@ -0,0 +1,86 @@
+//
+// Lock-free histogram of durations with a bounded relative error, for the timing of the stages of the control cycle.
+//
+
+#ifndef TIMINGHISTOGRAM_H
+#define TIMINGHISTOGRAM_H
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+
+/**
+ * HDR-style histogram of durations: the durations are counted in microseconds, exactly below 64 us and then in 32
+ * buckets per power of two, i.e. with a relative error below 3%, up to 16 s (longer durations go to the last bucket).
+ * A single thread records into it without locks or allocations, while any other thread can read consistent enough
+ * summaries (each counter is atomic, the set of them is not a snapshot).
+ */
+class TimingHistogram
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct summary_t
+    {
+        unsigned long count{0};
+        double mean{0.0}, p50{0.0}, p90{0.0}, p99{0.0}, p999{0.0}, max{0.0}; // [ms]
+    };
+
+    TimingHistogram();
+
+    TimingHistogram(const TimingHistogram&) = delete;
+    TimingHistogram& operator=(const TimingHistogram&) = delete;
+
+    /**
+    * Single writer only
+    */
+    void record(Clock::duration d);
+
+    /**
+    * @param p percentile in [0, 100]
+    * @return upper bound of the bucket holding the percentile [ms], 0 if nothing was recorded
+    */
+    double percentile(double p) const;
+
+    summary_t summary() const;
+
+    unsigned long count() const { return total.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int SUB_BITS = 6;                  // 64 exact buckets, then 32 per power of two
+    static constexpr uint64_t SUB_COUNT = 1u << SUB_BITS;
+    static constexpr uint64_t HALF_COUNT = SUB_COUNT / 2;
+    static constexpr int MAX_BITS = 24;                  // [us] 2^24 us ~ 16.8 s
+    static constexpr size_t BUCKETS = SUB_COUNT + (MAX_BITS - SUB_BITS) * HALF_COUNT;
+
+    std::array<std::atomic<uint32_t>, BUCKETS> counts;
+    std::atomic<unsigned long> total;
+    std::atomic<uint64_t> sum;     // [us]
+    std::atomic<uint64_t> longest; // [us]
+
+    static size_t bucketOf(uint64_t us);
+    static uint64_t upperBound(size_t bucket); // [us]
+};
+
+
+/**
+ * Records the time from its construction to its destruction into a histogram
+ */
+class ScopedTiming
+{
+public:
+    explicit ScopedTiming(TimingHistogram& _h): h(_h), t0(TimingHistogram::Clock::now()) {}
+    ~ScopedTiming() { h.record(TimingHistogram::Clock::now() - t0); }
+
+    ScopedTiming(const ScopedTiming&) = delete;
+    ScopedTiming& operator=(const ScopedTiming&) = delete;
+
+private:
+    TimingHistogram& h;
+    TimingHistogram::Clock::time_point t0;
+};
+
+#endif //TIMINGHISTOGRAM_H
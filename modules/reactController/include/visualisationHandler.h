@@ -38,6 +38,14 @@ public:
 
     void deleteiCubGuiObject(const std::string& object_type);
 
+    //objects gathered in one bottle and sent in its order: (object_type x y z) shows one with the position in the root
+    //FoR, (object_type) deletes it
+    void sendiCubGuiObjects(const yarp::os::Bottle& objects);
+
+    //adds to a bottle for sendiCubGuiObjects
+    static void addiCubGuiObject(yarp::os::Bottle& objects, const std::string& object_type, const Vector& x);
+    static void addiCubGuiDelete(yarp::os::Bottle& objects, const std::string& object_type);
+
     /****************** visualizations in icub simulator   *************************************/
     /**
     * Creates a sphere (not affected by gravity) in the iCub simulator through the /icubSim/world port
@@ -56,9 +64,11 @@ public:
                                   iCub::iKin::iCubArm* second_arm, const std::vector<collisionPoint_t>& colPoints2,
                                   const std::vector<Vector>& selfColPoints);
 
-    void visualizeObjects(const Vector& x_d, const Vector& x_n);
+    //if gui is given, the iCubGui objects are added to it (see sendiCubGuiObjects) instead of being sent
+    void visualizeObjects(const Vector& x_d, const Vector& x_n, yarp::os::Bottle* gui=nullptr);
 
-    void visualizeObjects(const Vector& x_d, const Vector& x_n, const Vector& x2_d, const Vector& x2_n);
+    void visualizeObjects(const Vector& x_d, const Vector& x_n, const Vector& x2_d, const Vector& x2_n,
+                          yarp::os::Bottle* gui=nullptr);
 
     void closePorts();
 
@@ -0,0 +1,80 @@
+//
+// Persistent pool of worker threads for data-parallel loops inside the control cycle.
+//
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <type_traits>
+
+
+/**
+ * Fixed set of threads created once at startup. parallelFor() hands out loop indices to the workers and to the
+ * calling thread, and returns once all of them are done, so nothing is created or allocated per cycle.
+ * Loops shorter than the crossover count are run serially on the calling thread, where waking the workers
+ * would cost more than it saves.
+ */
+class WorkerPool
+{
+public:
+    /**
+    * @param nWorkers number of extra threads (0 makes every loop serial)
+    * @param _crossover minimum number of iterations run in parallel
+    */
+    explicit WorkerPool(unsigned int nWorkers, int _crossover=8);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    /**
+    * @return native handles of the worker threads, e.g. to set their affinity
+    */
+    std::vector<std::thread::native_handle_type> nativeHandles();
+
+    /**
+    * Calls f(i) for every i in [0, n); iterations must be independent of each other
+    */
+    template <class F>
+    void parallelFor(int n, F&& f)
+    {
+        if (n <= 0) return;
+        if (workers.empty() || n < crossover)
+        {
+            for (int i = 0; i < n; i++) f(i);
+            return;
+        }
+        using Fn = typename std::remove_reference<F>::type;
+        run(n, [](void* ctx, int i) { (*static_cast<Fn*>(ctx))(i); }, static_cast<void*>(&f));
+    }
+
+private:
+    typedef void (*task_t)(void*, int);
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable wakeCv, doneCv;
+    int crossover;
+    bool stopping;
+    unsigned long generation;
+
+    // state of the loop being executed
+    task_t task;
+    void* context;
+    int count;
+    std::atomic<int> next;
+    int busy;
+
+    void run(int n, task_t t, void* ctx);
+    void drain();
+    void workerLoop();
+};
+
+#endif //WORKERPOOL_H
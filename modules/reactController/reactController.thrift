@@ -11,6 +11,12 @@ struct Vector {
   yarp.includefile="yarp/sig/Vector.h"
 )
 
+struct Bottle {
+} (
+  yarp.name = "yarp::os::Bottle"
+  yarp.includefile="yarp/os/Bottle.h"
+)
+
 /**
 * reactController_IDL
 *
@@ -211,4 +217,15 @@ service reactController_IDL
   *         STATE_IDLE  (2) -> idle state, it falls back automatically to STATE_WAIT
   **/
   i32 get_state();
+
+  /**
+  * Gets the timing of the stages of the control cycle since the start.
+  * @return ((stage count mean p50 p90 p99 p99.9 max) ...) (overruns n)
+  *         (used t) (period t), with the durations in ms: the stages are
+  *         updateArmChain, ports, vlim, solveIK, controlArm, sendData,
+  *         sendObsData, writeTelemetry, the whole cycle and the period
+  *         between two cycles; overruns counts the cycles longer than the
+  *         period; used and period are the averages estimated by the thread.
+  **/
+  Bottle get_timing();
 }
@@ -18,9 +18,13 @@
 */
 
 
+#include <algorithm>
 #include "avoidanceHandler.h"
 
 #define LIMIT 0.05
+#define MAX_APPROACH_MARGIN 0.2 // [m/s]
+#define HAND_REACH 0.15 // [m] bound on the extent of hand and fingers beyond the last link
+#define DAMPER_GAIN 1.0 // [m/s] approach speed allowed at the influence distance (w_eps in NeoQP)
 using namespace yarp::sig;
 using namespace yarp::math;
 using namespace yarp::os;
@@ -29,21 +33,18 @@ using namespace iCub::skinDynLib;
 
 AvoidanceHandler::AvoidanceHandler(iCub::iKin::iKinChain &_chain, const std::vector<collisionPoint_t> &_colPoints,
                                                    iCub::iKin::iKinChain* _secondChain, double _useSelfColPoints, const std::string& _part,
-                                                   yarp::sig::Vector* data, iCub::iKin::iKinChain* _torso, const unsigned int _verbosity):
-        chain(_chain), collisionPoints(_colPoints), secondChain(_secondChain), torso(_torso), part(_part),
-        verbosity(_verbosity), selfColDistance(_useSelfColPoints)
+                                                   yarp::sig::Vector* data, iCub::iKin::iKinChain* _torso,
+                                                   const EnvironmentMap* _envMap, const unsigned int _verbosity):
+        chain(_chain), collisionPoints(_colPoints), obstaclePoints(nullptr), kinState(nullptr), secondChain(_secondChain), torso(_torso), envMap(_envMap), part(_part),
+        verbosity(_verbosity), selfColDistance(_useSelfColPoints), nCtrlPoints(0), chainDOF(0), torsoH(eye(4)), frames(nullptr),
+        latency(0.0), ttcHorizon(0.0)
 {
     selfColPoints.resize(4);
     selfControlPoints.resize(2);
-    for (int i = 0; i < 5; i++)
-    {
-        for (int j = 0; j < 8; j++)
-        {
-            tablePoints.emplace_back(Vector{-0.15-i*0.07, -0.45+j*0.1, -0.02, 1.0});
-        }
-    }
+    pairCache.resize(8);
 
-    if (selfColDistance > 0)
+    // the control points of hand and forearm are shared by self-collision and environment checks
+    if (selfColDistance > 0 || envMap)
     {
         // front chest, back, face, back of head, ears (2x), hip (3x), front chest low band (relative coords to SKIN_FRONT_TORSO)
         std::vector<std::vector<double>> posx{{-0.13, -0.122, -0.084}, {0.05,  0.065, 0.08}, {-0.12, -0.112, -0.082},
@@ -128,18 +129,6 @@ AvoidanceHandler::AvoidanceHandler(iCub::iKin::iKinChain &_chain, const std::vec
 }
 
 
-/****************************************************************/
-std::deque<std::pair<Vector, int>> AvoidanceHandler::getCtrlPointsPosition()
-{
-    std::deque<std::pair<Vector, int>> ctrlPoints;
-    for (auto & ctrlPointChain : ctrlPointChains)
-    {
-        ctrlPoints.emplace_back(ctrlPointChain.first.EndEffPosition(), ctrlPointChain.second);
-    }
-    return ctrlPoints;
-}
-
-
 int AvoidanceHandler::printMessage(const unsigned int l, const char *f, ...) const
 {
     if (verbosity>=l)
@@ -189,38 +178,81 @@ bool AvoidanceHandler::computeFoR(const yarp::sig::Vector &pos, const yarp::sig:
     return true;
 }
 
+std::vector<double> AvoidanceHandler::leverArms(iKinChain& c)
+{
+    // a rotation of joint j moves any point of the distal links by at most the length of the links from j on
+    const int N = static_cast<int>(c.getN());
+    std::vector<double> tail(N+1, HAND_REACH);
+    for (int i = N-1; i >= 0; i--)
+    {
+        tail[i] = tail[i+1] + fabs(c[i].getA()) + fabs(c[i].getD());
+    }
+    std::vector<double> lever;
+    for (int i = 0; i < N; i++)
+    {
+        if (!c[i].isBlocked()) lever.push_back(tail[i]);
+    }
+    return lever;
+}
+
+
+double AvoidanceHandler::motionBound(const Vector& q, const Vector& q0, const std::vector<double>& lever)
+{
+    double bound = 0.0;
+    for (size_t j = 0; j < q.size(); j++)
+    {
+        bound += fabs(q[j] - q0[j]) * lever[j];
+    }
+    return bound;
+}
+
+
 void AvoidanceHandler::checkSelfCollisions(bool mainpart)
 {
-    std::vector<std::vector<Matrix>> transforms;
-    transforms.resize(2);
-    std::vector<int> indexes = {SkinPart_2_LinkNum[SKIN_LEFT_HAND].linkNum + 3,
-                                SkinPart_2_LinkNum[SKIN_LEFT_FOREARM].linkNum + 3,
-                                SkinPart_2_LinkNum[SKIN_LEFT_UPPER_ARM].linkNum + 3};
-    if (secondChain && !mainpart)
+    // bodies: 0-2 hand, forearm and upper arm of the other arm, 3 torso
+    const bool withSecond = secondChain && !mainpart;
+    const std::vector<int> indexes = {SkinPart_2_LinkNum[SKIN_LEFT_HAND].linkNum + 3,
+                                      SkinPart_2_LinkNum[SKIN_LEFT_FOREARM].linkNum + 3,
+                                      SkinPart_2_LinkNum[SKIN_LEFT_UPPER_ARM].linkNum + 3};
+    const Vector q1 = chain.getAng();
+    const Vector q2 = withSecond ? secondChain->getAng() : Vector(0);
+    if (lever1.size() != q1.size() || (withSecond && lever2.size() != q2.size()))
     {
-        for (int i = 0; i < 3; ++i)
-        {
-            transforms[0].push_back(yarp::math::SE3inv(chain.getH(indexes[0])) * secondChain->getH(indexes[i], true));
-            transforms[1].push_back(yarp::math::SE3inv(chain.getH(indexes[1])) * secondChain->getH(indexes[i], true));
-        }
+        // the chains changed (e.g. torso enabled), the cached distances refer to different joints
+        lever1 = leverArms(chain);
+        lever2 = withSecond ? leverArms(*secondChain) : std::vector<double>();
+        for (auto& pc : pairCache) pc.valid = false;
     }
-    transforms[0].push_back(yarp::math::SE3inv(chain.getH(indexes[0]))*chain.getH(SkinPart_2_LinkNum[SKIN_FRONT_TORSO].linkNum));
-    transforms[1].push_back(yarp::math::SE3inv(chain.getH(indexes[1]))*chain.getH(SkinPart_2_LinkNum[SKIN_FRONT_TORSO].linkNum));
-    int index = 0;
+
+    int checked = 0;
     for (int k = 0; k < 2; ++k)
     {
-        const Matrix T_a = chain.getH(indexes[k]);
-        for (int j = 0; j < transforms[0].size(); ++j)
+        Matrix T_a, T_a_inv;
+        for (int b = withSecond ? 0 : 3; b < 4; ++b)
         {
-            double limit = LIMIT;
+            const double limit = (withSecond && b == 0 && k == 0) ? selfColDistance : LIMIT;
+
+            // the distance of the pair can have shrunk at most by how far the joints moved since it was computed
+            pairCache_t& pc = pairCache[4*k + b];
+            if (pc.valid && pc.withSecond == withSecond)
+            {
+                const double moved = motionBound(q1, pc.q1, lever1) + (withSecond ? motionBound(q2, pc.q2, lever2) : 0.0);
+                if (pc.dist - moved >= limit) continue;
+            }
+
+            if (T_a.rows() == 0)
+            {
+                T_a = chain.getH(indexes[k]);
+                T_a_inv = yarp::math::SE3inv(T_a);
+            }
+            const Matrix T = T_a_inv * ((b < 3) ? secondChain->getH(indexes[b], true)
+                                                : chain.getH(SkinPart_2_LinkNum[SKIN_FRONT_TORSO].linkNum));
             int nearest = -1;
             double neardist = std::numeric_limits<double>::max();
             Vector nearest_pos = {0.0, 0.0, 0.0, 1.0};
-
-            if (transforms[0].size() > 1 && j == 0 && k == 0) limit = selfColDistance;
-            for (const auto& colPoint : selfColPoints[j])
+            for (const auto& colPoint : selfColPoints[b])
             {
-                const Vector pos = transforms[k][j] * colPoint;
+                const Vector pos = T * colPoint;
                 for (int i = 0; i < selfControlPoints[k].size(); i++)
                 {
                     const double n = yarp::math::norm2(pos.subVector(0, 2) - selfControlPoints[k][i]);
@@ -233,6 +265,13 @@ void AvoidanceHandler::checkSelfCollisions(bool mainpart)
                 }
             }
             neardist = sqrt(neardist);
+            checked++;
+            pc.valid = true;
+            pc.withSecond = withSecond;
+            pc.dist = neardist;
+            pc.q1 = q1;
+            pc.q2 = q2;
+
             if (neardist < limit) // distance lower than 0.04 m
             {
                 collisionPoint_t cp {(k == 0) ? SKIN_LEFT_HAND : SKIN_LEFT_FOREARM, SELFCOL_OBS, std::max(0.0,1.2 - 20*neardist)}; //(1.1 - neardist*5)   //(1.4 - 2*neardist) bimanual task
@@ -240,144 +279,233 @@ void AvoidanceHandler::checkSelfCollisions(bool mainpart)
                 const Vector normal = nearest_pos.subVector(0, 2) - selfControlPoints[k][nearest];
                 cp.n = T_a.submatrix(0,2,0,2)  * (normal / yarp::math::norm(normal));
                 totalColPoints.push_back(cp);
-                yDebug("colPoint %d with pos = %s, dist = %.3f and mag = %.2f for k = %d and j = %d\n",
-                       index, cp.x.toString().c_str(), neardist, cp.magnitude, k,j);
+                yDebug("colPoint with pos = %s, dist = %.3f and mag = %.2f for k = %d and body = %d\n",
+                       cp.x.toString().c_str(), neardist, cp.magnitude, k, b);
             }
-            index++;
         }
     }
+    printMessage(4, "self-collision pairs recomputed: %d\n", checked);
 }
 
 
-void AvoidanceHandler::checkTableCollisions()
+void AvoidanceHandler::checkEnvironmentCollisions()
 {
-    std::vector<int> indexes = {SkinPart_2_LinkNum[SKIN_LEFT_HAND].linkNum + 3,
-                                SkinPart_2_LinkNum[SKIN_LEFT_FOREARM].linkNum + 3,
-                                SkinPart_2_LinkNum[SKIN_LEFT_UPPER_ARM].linkNum + 3,
-                                SkinPart_2_LinkNum[SKIN_FRONT_TORSO].linkNum};
-    const std::vector<SkinPart> parts = {SKIN_LEFT_HAND, SKIN_LEFT_FOREARM, SKIN_LEFT_UPPER_ARM, SKIN_FRONT_TORSO};
-    int index = 0;
+    const std::vector<int> indexes = {SkinPart_2_LinkNum[SKIN_LEFT_HAND].linkNum + 3,
+                                      SkinPart_2_LinkNum[SKIN_LEFT_FOREARM].linkNum + 3};
+    const std::vector<SkinPart> parts = {SKIN_LEFT_HAND, SKIN_LEFT_FOREARM};
     for (int k = 0; k < 2; ++k)
     {
         const Matrix T_a = chain.getH(indexes[k]);
-        const double limit = LIMIT;
+        const Eigen::Matrix3d R = Eigen::Map<const Eigen::Matrix<double,4,4,Eigen::RowMajor>>(T_a.data()).topLeftCorner<3,3>();
+        const Eigen::Vector3d t(T_a(0,3), T_a(1,3), T_a(2,3));
         int nearest = -1;
         double neardist = std::numeric_limits<double>::max();
-        Vector nearest_pos = {0.0, 0.0, 0.0, 1.0};
-        auto transform = yarp::math::SE3inv(chain.getH(indexes[k]));
-//        printf("Transform\n%s\n", transform.toString(3).c_str());
-        for (const auto& colPoint : tablePoints)
+        Eigen::Vector3d nearest_normal;
+        for (int i = 0; i < selfControlPoints[k].size(); i++)
         {
-//            printf("Col point %s\n", colPoint.toString(3).c_str());
-            const Vector pos = transform * colPoint;
-//            printf("Pos %s\n", pos.toString(3).c_str());
-            for (int i = 0; i < selfControlPoints[k].size(); i++)
+            const Vector& cp = selfControlPoints[k][i];
+            double dist;
+            Eigen::Vector3d normal;
+            if (envMap->query(R * Eigen::Vector3d(cp[0], cp[1], cp[2]) + t, dist, normal) && dist < neardist)
             {
-                const double n = yarp::math::norm2(pos.subVector(0, 2) - selfControlPoints[k][i]);
-                if (n < neardist)
-                {
-                    nearest = i;
-                    neardist = n;
-                    nearest_pos = pos;
-                }
+                nearest = i;
+                neardist = dist;
+                nearest_normal = normal;
             }
         }
-        neardist = sqrt(neardist);
-        if (neardist < limit) // distance lower than 0.04 m
+        if (nearest >= 0 && neardist < LIMIT)
         {
-            collisionPoint_t cp {parts[k], SELFCOL_OBS, std::max(0.0,1.2 - 20*neardist)}; //(1.1 - neardist*5)   //(1.4 - 2*neardist) bimanual task
+            collisionPoint_t cp {parts[k], SELFCOL_OBS, std::max(0.0,1.2 - 20*neardist)};
             cp.x = selfControlPoints[k][nearest];
-            const Vector normal = nearest_pos.subVector(0, 2) - selfControlPoints[k][nearest];
-            cp.n = T_a.submatrix(0,2,0,2)  * (normal / yarp::math::norm(normal));
+            // the field gradient points away from the obstacle, the normal has to point towards it
+            cp.n = {-nearest_normal[0], -nearest_normal[1], -nearest_normal[2]};
             totalColPoints.push_back(cp);
-            yDebug("colPoint %d with pos = %s, dist = %.3f and mag = %.2f for k = %d\n",
-                   index, cp.x.toString().c_str(), neardist, cp.magnitude, k);
+            printMessage(3, "environment colPoint with pos = %s, dist = %.3f and mag = %.2f for k = %d\n",
+                         cp.x.toString().c_str(), neardist, cp.magnitude, k);
         }
-        index++;
     }
 }
 
 
 /****************************************************************/
-void AvoidanceHandler::getVLIM(std::vector<yarp::sig::Vector>& Aobs, std::vector<double> &bvals, bool mainpart)
+int AvoidanceHandler::prepareVLIM(std::vector<yarp::sig::Vector>& Aobs, std::vector<double> &bvals, bool mainpart)
 {
-    printMessage(2,"AvoidanceHandlerTactile::getVLIM\n");
-    const int dim = static_cast<int>(chain.getDOF());
-    int i = 0;
-    const int dim_offset = dim-7;  // 3 if dim == 10; 0 if dim == 7
-    ctrlPointChains.clear();
+    printMessage(2,"AvoidanceHandlerTactile::prepareVLIM\n");
+    // only the perceived points are clustered and budgeted: the velocity dampers of the geometric obstacles, the
+    // self-collisions and the environment map keep a row each, with the point their bound was computed for
     totalColPoints = collisionPoints;
-    bvals = std::vector(40,std::numeric_limits<double>::max());
-    Aobs.resize(40);
-    for (int k = 0; k < 40; k++)
+    const size_t received = totalColPoints.size();
+    clusterer.reduce(totalColPoints);
+    if (totalColPoints.size() < received)
+    {
+        printMessage(3, "%lu collision points reduced to %lu\n", received, totalColPoints.size());
+    }
+    if (obstaclePoints)
     {
-        Aobs[k].resize(10,0.0);
+        totalColPoints.insert(totalColPoints.end(), obstaclePoints->begin(), obstaclePoints->end());
     }
 
 //    if (!mainPart) totalColPoints.clear();
-    checkSelfCollisions(mainpart);
-//    checkTableCollisions(); // added for bubbles
-    for(const auto & colPoint : totalColPoints)
+    if (selfColDistance > 0)
     {
-        double coef = 0.8;
-        iKinChain customChain= chain; //instantiates a new chain, copying from the old (full) one
-        if (verbosity >= 5)
-        {
-            printf("Full chain has %d DOF \n",dim);
-            printf("chain.getH() (end-effector): \n %s \n",chain.getH().toString(3,3).c_str());
-            printf("SkinPart %s, linkNum %d, chain.getH() (skin part frame): \n %s \n", SkinPart_s[colPoint.skin_part].c_str(), SkinPart_2_LinkNum[colPoint.skin_part].linkNum + dim_offset , chain.getH(SkinPart_2_LinkNum[colPoint.skin_part].linkNum + dim_offset).toString(3, 3).c_str());
-        }
+        checkSelfCollisions(mainpart);
+    }
+    if (envMap && envMap->isValid())
+    {
+        checkEnvironmentCollisions();
+    }
 
-        // Remove all the more distal links after the collision point
-        // if the skin part is a hand, no need to remove any links from the chain
-        if ((colPoint.skin_part == SKIN_LEFT_FOREARM) || (colPoint.skin_part == SKIN_RIGHT_FOREARM))
-        {
-            coef = 0.5;
-            customChain.rmLink(6+dim_offset); customChain.rmLink(5+dim_offset);
-            // we keep link 4(+3) from elbow to wrist - it is getH(4(+3)) that is the FoR at the wrist in which forearm skin is expressed; and we want to keep the elbow joint part of the game
-            printMessage(2,"obstacle threatening skin part %s, blocking links 5(+3) and 6(+3) on subchain for avoidance\n",SkinPart_s[colPoint.skin_part].c_str());
-        }
-        else if ((colPoint.skin_part == SKIN_LEFT_UPPER_ARM) || (colPoint.skin_part == SKIN_RIGHT_UPPER_ARM))
-        {
-            coef = 0.1;
-            customChain.rmLink(6+dim_offset); customChain.rmLink(5+dim_offset);
-            customChain.rmLink(4+dim_offset); customChain.rmLink(3+dim_offset);
-            printMessage(2,"obstacle threatening skin part %s, blocking links 3(+3)-6(+3) on subchain for avoidance\n",SkinPart_s[colPoint.skin_part].c_str());
-        }
-        else if (colPoint.skin_part == SKIN_FRONT_TORSO)
-        {
-            coef = 0.2;
-            customChain.rmLink(6+dim_offset); customChain.rmLink(5+dim_offset); customChain.rmLink(4+dim_offset);
-            customChain.rmLink(3+dim_offset); customChain.rmLink(2+dim_offset); customChain.rmLink(1+dim_offset);
-            customChain.rmLink(0+dim_offset);
-            printMessage(2,"obstacle threatening skin part %s, blocking links 0(+3)-6(+3) on subchain for avoidance\n",SkinPart_s[colPoint.skin_part].c_str());
-        }
+    // every row gets its own slot, so that the rows can be filled concurrently
+    nCtrlPoints = static_cast<int>(totalColPoints.size());
+    const size_t rows = std::max<size_t>(40, totalColPoints.size());
+    bvals.assign(rows, std::numeric_limits<double>::max());
+    Aobs.resize(rows);
+    for (auto& row : Aobs)
+    {
+        row.resize(10, 0.0);
+        row.zero();
+    }
+    ctrlPoints.resize(totalColPoints.size());
+
+    // getH() updates the cached link transforms, hence the shared chains are queried only here:
+    // frames[j] is the frame preceding link j, i.e. the one its joint axis is expressed in; the frames of the
+    // kinematic state are read in place, as it does not change while the rows are computed
+    const int N = static_cast<int>(chain.getN());
+    chainDOF = static_cast<int>(chain.getDOF());
+    linkBlocked.resize(N);
+    if (kinState)
+    {
+        frames = &kinState->getFrames();
+    }
+    else
+    {
+        linkFrames.resize(N+1);
+        linkFrames[0] = chain.getH0();
+        frames = &linkFrames;
+    }
+    for (int j = 0; j < N; j++)
+    {
+        if (!kinState) linkFrames[j+1] = chain.getH(j, true);
+        linkBlocked[j] = chain[j].isBlocked();
+    }
+    if (torso)
+    {
+        torsoH = torso->getH(2);
+    }
+    return nCtrlPoints;
+}
 
-        // SetHN to move the end effector toward the point to be controlled - the average locus of collision threat from safety margin
-        yarp::sig::Matrix HN = eye(4);
-        computeFoR(colPoint.x, colPoint.n, HN);
-        if (colPoint.skin_part == SKIN_FRONT_TORSO)
-        {
-            HN = SE3inv(customChain.getH(2)) * torso->getH(2) * HN;
-        }
-        printMessage(2, "Distance from colPoint is %g in skin part %s, magnitude %g, and normal is %s\n", norm(colPoint.x), SkinPart_s[colPoint.skin_part].c_str(), colPoint.magnitude, colPoint.n.toString(3).c_str());
-        printMessage(5,"HN matrix at collision point w.r.t. local frame: \n %s \n",HN.toString(3,3).c_str());
-        customChain.setHN(HN); //setting the end-effector transform to the collision point w.r.t subchain
-        if (verbosity >=5)
-        {
-            const Matrix H = customChain.getH();
-            printf("H matrix at collision point %d w.r.t. root: \n %s \n", colPoint.skin_part, H.toString(3,3).c_str());
-        }
 
-        printMessage(2,"Chain with control point - index %d (last index %d), nDOF: %d.\n",i,collisionPoints.size()-1,customChain.getDOF());
-        const Matrix J=customChain.GeoJacobian().submatrix(0,2,0,customChain.getDOF()-1); //first 3 rows ~ dPosition/dJoints
-//        const Vector normal = customChain.getH().getCol(2).subVector(0,2); //get the end-effector frame of the standard or custom chain (control point derived from skin), takes the z-axis (3rd column in transform matrix) ~ normal, only its first three elements of the 4 in the homogenous transf. format
-//        printMessage(2, "J for positions at control point:\n %s \nJ.transposed:\n %s \nNormal at control point: (%s), norm: %f \n",J.toString(3,3).c_str(),J.transposed().toString(3,3).c_str(), normal.toString(3,3).c_str(),norm(normal));
+/****************************************************************/
+void AvoidanceHandler::computeVLIMRow(const int i, std::vector<yarp::sig::Vector>& Aobs, std::vector<double> &bvals)
+{
+    const collisionPoint_t& colPoint = totalColPoints[i];
+    const int dim = chainDOF;
+    const int dim_offset = dim-7;  // 3 if dim == 10; 0 if dim == 7
+    double coef = 0.8;
+    int kept = static_cast<int>(linkBlocked.size()); // number of proximal links moving the control point
+
+    // Only the links up to the collision point move it (the more distal ones are left out of the subchain)
+    // if the skin part is a hand, all the links are kept
+    if ((colPoint.skin_part == SKIN_LEFT_FOREARM) || (colPoint.skin_part == SKIN_RIGHT_FOREARM))
+    {
+        coef = 0.5;
+        kept = 5+dim_offset;
+        // we keep link 4(+3) from elbow to wrist - it is getH(4(+3)) that is the FoR at the wrist in which forearm skin is expressed; and we want to keep the elbow joint part of the game
+        printMessage(2,"obstacle threatening skin part %s, blocking links 5(+3) and 6(+3) on subchain for avoidance\n",SkinPart_s[colPoint.skin_part].c_str());
+    }
+    else if ((colPoint.skin_part == SKIN_LEFT_UPPER_ARM) || (colPoint.skin_part == SKIN_RIGHT_UPPER_ARM))
+    {
+        coef = 0.1;
+        kept = 3+dim_offset;
+        printMessage(2,"obstacle threatening skin part %s, blocking links 3(+3)-6(+3) on subchain for avoidance\n",SkinPart_s[colPoint.skin_part].c_str());
+    }
+    else if (colPoint.skin_part == SKIN_FRONT_TORSO)
+    {
+        coef = 0.2;
+        kept = dim_offset;
+        printMessage(2,"obstacle threatening skin part %s, blocking links 0(+3)-6(+3) on subchain for avoidance\n",SkinPart_s[colPoint.skin_part].c_str());
+    }
+
+    // the point to be controlled - the average locus of collision threat from safety margin - where it will be when
+    // the command takes effect, with the normal as z axis (see computeFoR); the skin of the torso is expressed in the
+    // frame of the torso, the other skin parts in the frame at the end of the kept links
+    typedef Eigen::Map<const Eigen::Matrix<double,4,4,Eigen::RowMajor>> frame_t;
+    const frame_t base((colPoint.skin_part == SKIN_FRONT_TORSO ? torsoH : (*frames)[kept]).data());
+    const Eigen::Map<const Eigen::Vector3d> x(colPoint.x.data()), v(colPoint.v.data()), n(colPoint.n.data());
+    Eigen::Vector3d p = base.block<3,1>(0,3);
+    Eigen::Vector3d z = base.block<3,1>(0,2);
+    if (n.squaredNorm() > 0.0)
+    {
+        p += base.block<3,3>(0,0) * (x + latency * v);
+        z = base.block<3,3>(0,0) * n.normalized();
+    }
+    if (verbosity >= 2)
+    {
+        printMessage(2, "Distance from colPoint is %g in skin part %s, magnitude %g, and normal is %s\n", x.norm(),
+                     SkinPart_s[colPoint.skin_part].c_str(), colPoint.magnitude, colPoint.n.toString(3).c_str());
+    }
+
+    // the subchain would share its links with the full chain and getH()/GeoJacobian() update their cached transforms,
+    // hence the positional Jacobian (first 3 rows ~ dPosition/dJoints) is built from the frames of prepareVLIM
+    const int dof = static_cast<int>(std::count(linkBlocked.begin(), linkBlocked.begin() + kept, false));
+    Vector& row = Aobs[i];
+    row.resize(dof);
+    int c = 0;
+    for (int j = 0; j < kept; j++)
+    {
+        if (linkBlocked[j]) continue;
+        const frame_t Z((*frames)[j].data());
+        row[c++] = Z.block<3,1>(0,2).cross(p - Z.block<3,1>(0,3)).dot(n);
+    }
+    printMessage(2,"Chain with control point - index %d (last index %d), nDOF: %d.\n",i,nCtrlPoints-1,dof);
+
+    if (colPoint.type == GEOM_OBS)
+    {
+        // velocity damper: the distance may shrink at most by DAMPER_GAIN*(d-ds)/(di-ds) on top of the obstacle motion
+        bvals[i] = DAMPER_GAIN * (colPoint.distance - DAMPER_SECURITY) / (DAMPER_INFLUENCE - DAMPER_SECURITY) + colPoint.obsNormalVel;
+    }
+    else
+    {
+        bvals[i] = (0.3-colPoint.magnitude) * coef*0.66 - approachMargin(colPoint);
+    }
 
-        Aobs[i] = J.transposed()*colPoint.n;
-        bvals[i] = (0.3-colPoint.magnitude) * coef*0.66;
-        ctrlPointChains.emplace_back(customChain, colPoint.type);
-        i++;
+    // the slot of the row keeps its vectors from cycle to cycle
+    ctrlPoint_t& ctrlPoint = ctrlPoints[i];
+    for (int k = 0; k < 3; k++)
+    {
+        ctrlPoint.pos[k] = p[k];
+        ctrlPoint.n[k] = z[k];
+    }
+    ctrlPoint.dof = dof;
+    ctrlPoint.skin_part = colPoint.skin_part;
+    ctrlPoint.type = colPoint.type;
+    ctrlPoint.bound = bvals[i];
+}
+
+
+/****************************************************************/
+double AvoidanceHandler::approachMargin(const collisionPoint_t& colPoint) const
+{
+    if (ttcHorizon <= 0 || colPoint.approachVel <= 0) return 0.0;
+    // the magnitude grows from 0 at OBS_RANGE to 1 at contact
+    const double ttc = std::max(0.0, 1.0 - colPoint.magnitude) * OBS_RANGE / colPoint.approachVel;
+    const double urgency = std::max(0.0, 1.0 - ttc / ttcHorizon);
+    printMessage(3, "skin part %s: obstacle approaching at %.3f m/s, time to collision %.3f s\n",
+                 SkinPart_s[colPoint.skin_part].c_str(), colPoint.approachVel, ttc);
+    // the control point has to recede at least as fast as the obstacle closes in, once the collision is imminent;
+    // the margin is saturated so that a noisy estimate cannot make the QP infeasible
+    return std::min(urgency * colPoint.approachVel, MAX_APPROACH_MARGIN);
+}
+
+
+/****************************************************************/
+void AvoidanceHandler::getVLIM(std::vector<yarp::sig::Vector>& Aobs, std::vector<double> &bvals, bool mainpart)
+{
+    const int rows = prepareVLIM(Aobs, bvals, mainpart);
+    for (int i = 0; i < rows; i++)
+    {
+        computeVLIMRow(i, Aobs, bvals);
     }
 }
 
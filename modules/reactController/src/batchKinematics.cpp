@@ -0,0 +1,171 @@
+//
+// Forward kinematics and Jacobians of an iKin chain for many configurations at once, in SoA layout.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+#include "batchKinematics.h"
+
+using namespace yarp::sig;
+
+namespace
+{
+    // one value per configuration of a group; with AVX enabled Eigen maps it to a single register
+    typedef Eigen::Array<double, BatchKinematics::LANES, 1> Lane;
+    typedef Eigen::Map<Lane> LaneMap;
+    typedef Eigen::Map<const Lane> ConstLaneMap;
+
+    /**
+     * sin and cos of every lane, vectorized as the rest of the recursion (std::sin and std::cos would be called once
+     * per lane): reduction to [-pi/4, pi/4] with pi/2 in three parts, then the Cephes polynomials, to double precision.
+     */
+    inline void sinCos(const Lane& x, Lane& s, Lane& c)
+    {
+        const Lane n = (x * (2.0 / M_PI)).round();
+        const Lane r = ((x - n * 1.57079625129699707031) - n * 7.54978941586159635336e-8) - n * 5.39030285815811905290e-15;
+        const Lane r2 = r * r;
+        const Lane sr = r + r * r2 * (((((1.58962301576546568060e-10 * r2 - 2.50507477628578072866e-8) * r2
+                        + 2.75573136213857245213e-6) * r2 - 1.98412698295895385996e-4) * r2
+                        + 8.33333333332211858878e-3) * r2 - 1.66666666666666307295e-1);
+        const Lane cr = 1.0 - 0.5 * r2 + r2 * r2 * (((((-1.13585365213876817300e-11 * r2 + 2.08757008419747316778e-9) * r2
+                        - 2.75573141792967388112e-7) * r2 + 2.48015872888517045348e-5) * r2
+                        - 1.38888888888730564116e-3) * r2 + 4.16666666666665929218e-2);
+        // quadrant m of x, with 0/1 flags instead of comparisons so that everything stays in vector registers
+        const Lane m = n - 4.0 * (0.25 * n).floor();
+        const Lane h = (0.5 * m).floor();                                                   // sin < 0
+        const Lane odd = m - 2.0 * h;                                                       // sin and cos swap
+        const Lane hc = (0.5 * (m + 1.0)).floor() - 2.0 * (0.25 * (m + 1.0)).floor();       // cos < 0
+        s = ((1.0 - odd) * sr + odd * cr) * (1.0 - 2.0 * h);
+        c = ((1.0 - odd) * cr + odd * sr) * (1.0 - 2.0 * hc);
+    }
+}
+
+
+void BatchKinematics::Batch::resize(const size_t configurations, const int dof)
+{
+    n = configurations;
+    nDof = dof;
+    const size_t padded = (configurations + LANES - 1) / LANES * LANES;
+    qs.assign(nDof * padded, 0.0);
+    pos.assign(3 * padded, 0.0);
+    rot.assign(9 * padded, 0.0);
+    jac.assign(6 * nDof * padded, 0.0);
+}
+
+void BatchKinematics::Batch::setConfiguration(const size_t k, const Vector& _q)
+{
+    for (int i = 0; i < nDof; i++)
+    {
+        q(k, i) = _q[i];
+    }
+}
+
+bool BatchKinematics::configure(iCub::iKin::iKinChain& chain)
+{
+    if (chain.getN() > static_cast<unsigned int>(MAX_LINKS))
+    {
+        n = nDof = 0;
+        return false;
+    }
+    n = static_cast<int>(chain.getN());
+    nDof = static_cast<int>(chain.getDOF());
+    for (int j = 0; j < n; j++)
+    {
+        iCub::iKin::iKinLink& l = chain[j];
+        const double theta = l.getAng() + l.getOffset();
+        link[j] = {l.getA(), l.getD(), std::cos(l.getAlpha()), std::sin(l.getAlpha()), l.getOffset(),
+                   std::cos(theta), std::sin(theta), l.isBlocked()};
+    }
+    const Matrix M0 = chain.getH0(), MN = chain.getHN();
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            H0[r][c] = M0(r, c);
+            HN[r][c] = MN(r, c);
+        }
+    }
+    return true;
+}
+
+void BatchKinematics::compute(Batch& b, const bool withJacobian) const
+{
+    const size_t groups = b.qs.size() / std::max(nDof * LANES, 1);
+    for (size_t g = 0; g < groups; g++)
+    {
+        const double* q = &b.qs[g * nDof * LANES];
+        double* pos = &b.pos[g * 3 * LANES];
+        double* rot = &b.rot[g * 9 * LANES];
+        double* jac = &b.jac[g * 6 * nDof * LANES];
+
+        // current frame (rotation R and origin p) of the LANES configurations, from the base
+        Lane R[3][3], p[3];
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                R[r][c] = Lane::Constant(H0[r][c]);
+            }
+            p[r] = Lane::Constant(H0[r][3]);
+        }
+
+        // axis and origin of the frame every DOF rotates about, for the Jacobian
+        Lane z[MAX_LINKS][3], o[MAX_LINKS][3];
+        int i = 0;
+        for (int j = 0; j < n; j++)
+        {
+            const link_t& l = link[j];
+            Lane ct, st;
+            if (l.blocked)
+            {
+                ct = Lane::Constant(l.ct);
+                st = Lane::Constant(l.st);
+            }
+            else
+            {
+                for (int r = 0; r < 3; r++)
+                {
+                    z[i][r] = R[r][2];
+                    o[i][r] = p[r];
+                }
+                sinCos(ConstLaneMap(q + i * LANES) + l.offset, st, ct);
+                i++;
+            }
+            // R p <- R p * Rz(theta) Tz(d) Tx(a) Rx(alpha), row by row without forming the link matrix
+            for (int r = 0; r < 3; r++)
+            {
+                const Lane x = R[r][0] * ct + R[r][1] * st;
+                const Lane y = R[r][1] * ct - R[r][0] * st;
+                p[r] += l.a * x + l.d * R[r][2];
+                R[r][0] = x;
+                R[r][1] = l.ca * y + l.sa * R[r][2];
+                R[r][2] = l.ca * R[r][2] - l.sa * y;
+            }
+        }
+
+        Lane pe[3];
+        for (int r = 0; r < 3; r++)
+        {
+            pe[r] = p[r] + R[r][0] * HN[0][3] + R[r][1] * HN[1][3] + R[r][2] * HN[2][3];
+            LaneMap(pos + r * LANES) = pe[r];
+            for (int c = 0; c < 3; c++)
+            {
+                LaneMap(rot + (3*r+c) * LANES) = R[r][0] * HN[0][c] + R[r][1] * HN[1][c] + R[r][2] * HN[2][c];
+            }
+        }
+
+        if (!withJacobian) continue;
+        for (int c = 0; c < nDof; c++)
+        {
+            const Lane dx = pe[0] - o[c][0], dy = pe[1] - o[c][1], dz = pe[2] - o[c][2];
+            LaneMap(jac + (0*nDof+c) * LANES) = z[c][1] * dz - z[c][2] * dy;
+            LaneMap(jac + (1*nDof+c) * LANES) = z[c][2] * dx - z[c][0] * dz;
+            LaneMap(jac + (2*nDof+c) * LANES) = z[c][0] * dy - z[c][1] * dx;
+            for (int r = 0; r < 3; r++)
+            {
+                LaneMap(jac + ((3+r)*nDof+c) * LANES) = z[c][r];
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+//
+// Reduction of the collision points to a bounded set of representative clusters.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "collisionClusterer.h"
+
+
+CollisionClusterer::CollisionClusterer(const int _budget, const double _radius, const double _maxAngle):
+        budget(_budget), radius(_radius), minCos(cos(_maxAngle))
+{
+    order.reserve(64);
+    clusters.reserve(64);
+    reduced.reserve(64);
+}
+
+void CollisionClusterer::reduce(std::vector<collisionPoint_t>& points)
+{
+    if (points.size() <= 1 && budget >= 1) return;
+
+    order.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) order[i] = static_cast<int>(i);
+    std::stable_sort(order.begin(), order.end(), [&points](int a, int b) { return points[a].magnitude > points[b].magnitude; });
+
+    const double r2 = radius*radius;
+    clusters.clear();
+    for (const int idx : order)
+    {
+        const collisionPoint_t& p = points[idx];
+        const double w = std::max(p.magnitude, 1e-3);
+        cluster_t* target = nullptr;
+        for (auto& c : clusters)
+        {
+            const collisionPoint_t& s = points[c.seed];
+            if (s.skin_part != p.skin_part || s.type != p.type) continue;
+            // compare with the current centroid, so that a chain of points does not drift arbitrarily far
+            double d2 = 0, cosn = 0, nn = 0, pn = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                const double dx = p.x[k] - c.x[k]/c.weight;
+                d2 += dx*dx;
+                cosn += p.n[k] * c.n[k];
+                nn += c.n[k] * c.n[k];
+                pn += p.n[k] * p.n[k];
+            }
+            if (d2 <= r2 && cosn >= minCos * sqrt(nn * pn))
+            {
+                target = &c;
+                break;
+            }
+        }
+        if (target)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                target->x[k] += w * p.x[k];
+                target->n[k] += w * p.n[k];
+            }
+            target->weight += w;
+        }
+        else
+        {
+            clusters.push_back({idx, {w*p.x[0], w*p.x[1], w*p.x[2]}, {w*p.n[0], w*p.n[1], w*p.n[2]}, w, p.magnitude, 0.0});
+        }
+    }
+
+    for (auto& c : clusters)
+    {
+        c.dist = sqrt(c.x[0]*c.x[0] + c.x[1]*c.x[1] + c.x[2]*c.x[2]) / c.weight;
+    }
+    std::stable_sort(clusters.begin(), clusters.end(), [](const cluster_t& a, const cluster_t& b)
+    {
+        return (a.magnitude != b.magnitude) ? a.magnitude > b.magnitude : a.dist < b.dist;
+    });
+
+    reduced.clear();
+    const int kept = std::min(budget, static_cast<int>(clusters.size()));
+    for (int i = 0; i < kept; i++)
+    {
+        const cluster_t& c = clusters[i];
+        reduced.push_back(points[c.seed]);
+        collisionPoint_t& cp = reduced.back();
+        const double nn = sqrt(c.n[0]*c.n[0] + c.n[1]*c.n[1] + c.n[2]*c.n[2]);
+        for (int k = 0; k < 3; k++)
+        {
+            cp.x[k] = c.x[k] / c.weight;
+            if (nn > 0) cp.n[k] = c.n[k] / nn;
+        }
+    }
+    points.swap(reduced);
+}
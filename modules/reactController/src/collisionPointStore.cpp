@@ -0,0 +1,184 @@
+//
+// Collision points of one arm, indexed by a spatial hash and expired by a timing wheel.
+//
+
+#include <cmath>
+#include <algorithm>
+#include <yarp/math/Math.h>
+#include "collisionPointStore.h"
+
+
+CollisionPointStore::CollisionPointStore(const double _dT, const double _gate): dT(_dT), gate(_gate), now(0),
+                                                                                wheel(WHEEL_SIZE)
+{
+    pts.reserve(128);
+    cells.reserve(256);
+}
+
+uint64_t CollisionPointStore::cellKey(const collisionPoint_t& cp, const int dx, const int dy, const int dz) const
+{
+    // 16 bits per coordinate cover +-30 m at 3 cm, far beyond any skin part frame
+    const auto q = [this](double v, int d) { return static_cast<uint64_t>(static_cast<int64_t>(std::floor(v / gate)) + d) & 0xFFFF; };
+    return (static_cast<uint64_t>(cp.skin_part) << 56) | (static_cast<uint64_t>(cp.type & 0xFF) << 48) |
+           (q(cp.x[0], dx) << 32) | (q(cp.x[1], dy) << 16) | q(cp.x[2], dz);
+}
+
+void CollisionPointStore::link(const int id)
+{
+    const uint64_t key = cellKey(pts[denseOf[id]]);
+    cellOf[id] = key;
+    auto it = cells.find(key);
+    if (it == cells.end())
+    {
+        nextInCell[id] = -1;
+        cells.emplace(key, id);
+    }
+    else
+    {
+        nextInCell[id] = it->second;
+        it->second = id;
+    }
+}
+
+void CollisionPointStore::unlink(const int id)
+{
+    auto it = cells.find(cellOf[id]);
+    if (it == cells.end()) return;
+    if (it->second == id)
+    {
+        if (nextInCell[id] < 0) cells.erase(it);
+        else it->second = nextInCell[id];
+        return;
+    }
+    for (int prev = it->second; nextInCell[prev] >= 0; prev = nextInCell[prev])
+    {
+        if (nextInCell[prev] == id)
+        {
+            nextInCell[prev] = nextInCell[id];
+            return;
+        }
+    }
+}
+
+void CollisionPointStore::schedule(const int id)
+{
+    const collisionPoint_t& cp = pts[denseOf[id]];
+    // the point is dropped at the first tick where its duration is over or its magnitude falls below the minimum
+    long ticks = static_cast<long>(std::ceil(cp.duration / dT - 1e-9));
+    if (cp.magnitude > MIN_MAGNITUDE)
+    {
+        ticks = std::min(ticks, static_cast<long>(std::floor(std::log(MIN_MAGNITUDE / cp.magnitude) / std::log(DECAY))) + 1);
+    }
+    else ticks = 1;
+    expiry[id] = now + std::max(1L, ticks);
+    // entries left behind by earlier schedules are recognized as stale when their slot comes up
+    wheel[expiry[id] % WHEEL_SIZE].push_back({id, expiry[id]});
+}
+
+void CollisionPointStore::merge(const collisionPoint_t& meas, const double stamp, const yarp::sig::Matrix& R)
+{
+    int match = -1;
+    double matchDist = gate;
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dz = -1; dz <= 1; dz++)
+            {
+                auto it = cells.find(cellKey(meas, dx, dy, dz));
+                if (it == cells.end()) continue;
+                for (int id = it->second; id >= 0; id = nextInCell[id])
+                {
+                    const collisionPoint_t& cp = pts[denseOf[id]];
+                    if (cp.stamp == stamp) continue; // already updated in this cycle
+                    const double d = yarp::math::norm(cp.x - meas.x);
+                    if (d < matchDist)
+                    {
+                        match = id;
+                        matchDist = d;
+                    }
+                }
+            }
+        }
+    }
+
+    if (match >= 0)
+    {
+        unlink(match);
+        pts[denseOf[match]].track(meas, stamp, R);
+        link(match);
+        schedule(match);
+        return;
+    }
+
+    int id;
+    if (freeIds.empty())
+    {
+        id = static_cast<int>(denseOf.size());
+        denseOf.push_back(-1);
+        cellOf.push_back(0);
+        nextInCell.push_back(-1);
+        expiry.push_back(0);
+    }
+    else
+    {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    denseOf[id] = static_cast<int>(pts.size());
+    pts.push_back(meas);
+    pts.back().stamp = stamp;
+    ids.push_back(id);
+    link(id);
+    schedule(id);
+}
+
+void CollisionPointStore::remove(const int id)
+{
+    unlink(id);
+    const int i = denseOf[id];
+    const int last = static_cast<int>(pts.size()) - 1;
+    if (i != last)
+    {
+        std::swap(pts[i], pts[last]);
+        ids[i] = ids[last];
+        denseOf[ids[i]] = i;
+    }
+    pts.pop_back();
+    ids.pop_back();
+    denseOf[id] = -1;
+    freeIds.push_back(id);
+}
+
+void CollisionPointStore::tick()
+{
+    now++;
+    for (auto& cp : pts)
+    {
+        cp.duration -= dT;
+        cp.magnitude *= DECAY; // vision 0.6; tactile 0.9
+    }
+
+    auto& slot = wheel[now % WHEEL_SIZE];
+    size_t kept = 0;
+    for (const auto& e : slot)
+    {
+        if (denseOf[e.id] < 0 || expiry[e.id] != e.tick) continue; // removed or rescheduled meanwhile
+        if (e.tick == now) remove(e.id);
+        else slot[kept++] = e; // due in a later turn of the wheel
+    }
+    slot.resize(kept);
+}
+
+void CollisionPointStore::clear()
+{
+    pts.clear();
+    ids.clear();
+    denseOf.clear();
+    cellOf.clear();
+    nextInCell.clear();
+    expiry.clear();
+    freeIds.clear();
+    cells.clear();
+    for (auto& slot : wheel) slot.clear();
+}
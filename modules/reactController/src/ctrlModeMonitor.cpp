@@ -0,0 +1,141 @@
+//
+// Thread reading the control modes of the controlled parts at a low rate, off the control cycle.
+//
+
+#include <cstdio>
+#include <cstdarg>
+#include <chrono>
+#include <algorithm>
+#include <yarp/os/Time.h>
+#include "ctrlModeMonitor.h"
+
+
+CtrlModeMonitor::CtrlModeMonitor(const double _period, const unsigned int _verbosity): period(_period),
+        verbosity(_verbosity), started(false), stopping(false), pending(false), nReads(0), nFailures(0)
+{ }
+
+CtrlModeMonitor::~CtrlModeMonitor()
+{
+    stop();
+}
+
+int CtrlModeMonitor::addPart(const std::string& name, yarp::dev::IControlMode* imod, const int joints)
+{
+    if (started || imod == nullptr || parts.size() >= MAX_PARTS || joints > MAX_JOINTS)
+    {
+        printMessage(0, "can not monitor %s\n", name.c_str());
+        return -1;
+    }
+    const int p = static_cast<int>(parts.size());
+    parts.push_back({name, imod, joints});
+    last.parts = p + 1;
+    last.joints[p] = joints;
+    for (int j = 0; j < joints; j++)
+    {
+        last.modes[p][j] = yarp::dev::VOCAB_CM_IDLE; // unhealthy until read
+    }
+    return p;
+}
+
+void CtrlModeMonitor::start()
+{
+    stop();
+    poll();
+    stopping = false;
+    started = true;
+    worker = std::thread(&CtrlModeMonitor::workerLoop, this);
+    printMessage(1, "started, %lu parts read every %.0f ms\n", parts.size(), period*1000.0);
+}
+
+void CtrlModeMonitor::stop()
+{
+    if (!started) return;
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        stopping = true;
+    }
+    wakeCv.notify_all();
+    worker.join();
+    started = false;
+}
+
+void CtrlModeMonitor::refresh()
+{
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        pending = true;
+    }
+    wakeCv.notify_one();
+}
+
+unsigned long CtrlModeMonitor::reads() const
+{
+    std::lock_guard<std::mutex> lg(mtx);
+    return nReads;
+}
+
+unsigned long CtrlModeMonitor::failures() const
+{
+    std::lock_guard<std::mutex> lg(mtx);
+    return nFailures;
+}
+
+void CtrlModeMonitor::poll()
+{
+    unsigned long failed = 0;
+    int joints[MAX_JOINTS];
+    int modes[MAX_JOINTS];
+    for (int j = 0; j < MAX_JOINTS; j++)
+    {
+        joints[j] = j;
+    }
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        // only the joints monitored, the board may have more (e.g. those of the hand)
+        if (parts[p].imod->getControlModes(parts[p].joints, joints, modes))
+        {
+            std::copy(modes, modes + parts[p].joints, last.modes[p]);
+        }
+        else
+        {
+            failed++;
+            printMessage(1, "could not read the control modes of %s, keeping the last ones\n", parts[p].name.c_str());
+        }
+    }
+    last.stamp = yarp::os::Time::now();
+    snapshots.back() = last;
+    snapshots.publish();
+    std::lock_guard<std::mutex> lg(mtx);
+    nReads++;
+    nFailures += failed;
+}
+
+void CtrlModeMonitor::workerLoop()
+{
+    const auto wait = std::chrono::duration<double>(period);
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            wakeCv.wait_for(lk, wait, [this]() { return stopping || pending; });
+            if (stopping) return;
+            pending = false;
+        }
+        poll();
+    }
+}
+
+int CtrlModeMonitor::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[CtrlModeMonitor] ");
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
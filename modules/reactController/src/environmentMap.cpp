@@ -0,0 +1,501 @@
+//
+// Static environment map precomputed into a signed distance field.
+//
+
+#include "environmentMap.h"
+
+#include <yarp/os/LogStream.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <limits>
+#include <cstdio>
+#include <cstdarg>
+#include <cmath>
+#include <map>
+#include <array>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SDF_MAGIC 0x3146445354434552ULL // "RECTSDF1"
+
+namespace
+{
+    uint64_t fnv1a(const void* data, size_t len, uint64_t h=1469598103934665603ULL)
+    {
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < len; i++)
+        {
+            h ^= p[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    // features of a triangle, as indices of triangle_t::pn (FACE uses the face normal)
+    enum { VERTEX_A, VERTEX_B, VERTEX_C, EDGE_AB, EDGE_BC, EDGE_CA, FACE };
+
+    // closest point on the triangle abc to p (Ericson, Real-Time Collision Detection, 5.1.5), and the feature it is on
+    Eigen::Vector3d closestOnTriangle(const Eigen::Vector3d& p, const Eigen::Vector3d& a,
+                                      const Eigen::Vector3d& b, const Eigen::Vector3d& c, int& feature)
+    {
+        const Eigen::Vector3d ab = b - a, ac = c - a, ap = p - a;
+        const double d1 = ab.dot(ap), d2 = ac.dot(ap);
+        if (d1 <= 0 && d2 <= 0) { feature = VERTEX_A; return a; }
+        const Eigen::Vector3d bp = p - b;
+        const double d3 = ab.dot(bp), d4 = ac.dot(bp);
+        if (d3 >= 0 && d4 <= d3) { feature = VERTEX_B; return b; }
+        const double vc = d1*d4 - d3*d2;
+        if (vc <= 0 && d1 >= 0 && d3 <= 0) { feature = EDGE_AB; return a + ab * (d1 / (d1 - d3)); }
+        const Eigen::Vector3d cp = p - c;
+        const double d5 = ab.dot(cp), d6 = ac.dot(cp);
+        if (d6 >= 0 && d5 <= d6) { feature = VERTEX_C; return c; }
+        const double vb = d5*d2 - d1*d6;
+        if (vb <= 0 && d2 >= 0 && d6 <= 0) { feature = EDGE_CA; return a + ac * (d2 / (d2 - d6)); }
+        const double va = d3*d6 - d5*d4;
+        if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+        {
+            feature = EDGE_BC;
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+        feature = FACE;
+        const double denom = 1.0 / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+
+    // angle of the triangle at its vertex p, between the edges to q and r
+    double angleAt(const Eigen::Vector3d& p, const Eigen::Vector3d& q, const Eigen::Vector3d& r)
+    {
+        const double c = (q - p).normalized().dot((r - p).normalized());
+        return std::acos(std::min(1.0, std::max(-1.0, c)));
+    }
+}
+
+
+EnvironmentMap::EnvironmentMap(const unsigned int _verbosity): verbosity(_verbosity), resolution(0.02), dims{0, 0, 0},
+                                                               grid(nullptr), mapped(nullptr), mappedSize(0)
+{
+    origin.setZero();
+    upper.setZero();
+}
+
+EnvironmentMap::~EnvironmentMap()
+{
+    unmap();
+}
+
+bool EnvironmentMap::load(const std::string& descFile, const std::string& cacheFile, double defaultResolution)
+{
+    unmap();
+    std::string content;
+    if (!parse(descFile, content, defaultResolution))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        dims[i] = static_cast<int>(std::ceil((upper[i] - origin[i]) / resolution)) + 1;
+    }
+    uint64_t hash = fnv1a(content.data(), content.size());
+    hash = fnv1a(&resolution, sizeof(resolution), hash);
+    hash = fnv1a(origin.data(), 3*sizeof(double), hash);
+    hash = fnv1a(dims, sizeof(dims), hash);
+    // the meshes are only named in the description, their contents count too
+    for (const auto& t : triangles)
+    {
+        hash = fnv1a(t.a.data(), 3*sizeof(double), hash);
+        hash = fnv1a(t.b.data(), 3*sizeof(double), hash);
+        hash = fnv1a(t.c.data(), 3*sizeof(double), hash);
+    }
+
+    const std::string cache = cacheFile.empty()? descFile + ".sdf" : cacheFile;
+    if (mapCache(cache, hash))
+    {
+        yInfo("[EnvironmentMap] mapped cached distance field %s (%d x %d x %d)", cache.c_str(), dims[0], dims[1], dims[2]);
+        return true;
+    }
+
+    yInfo("[EnvironmentMap] building distance field of %zu boxes, %zu planes and %zu triangles on a %d x %d x %d grid..",
+          boxes.size(), planes.size(), triangles.size(), dims[0], dims[1], dims[2]);
+    std::vector<float> data;
+    build(data);
+    if (write(cache, hash, data) && mapCache(cache, hash))
+    {
+        return true;
+    }
+    // e.g. a read-only context directory: the field is rebuilt at every start
+    yWarning("[EnvironmentMap] unable to write or map the distance field cache %s, keeping it in memory", cache.c_str());
+    ownGrid = std::move(data);
+    grid = ownGrid.data();
+    return true;
+}
+
+bool EnvironmentMap::parse(const std::string& descFile, std::string& content, double defaultResolution)
+{
+    std::ifstream in(descFile);
+    if (!in.is_open())
+    {
+        yError("[EnvironmentMap] could not open environment description %s", descFile.c_str());
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    content = ss.str();
+
+    const size_t slash = descFile.find_last_of('/');
+    const std::string dir = (slash == std::string::npos)? "" : descFile.substr(0, slash + 1);
+
+    boxes.clear();
+    planes.clear();
+    triangles.clear();
+    resolution = defaultResolution;
+    // default bounds cover the reachable workspace of both arms with the torso
+    origin = Eigen::Vector3d(-0.9, -0.8, -0.5);
+    upper = Eigen::Vector3d(0.3, 0.8, 0.8);
+
+    std::istringstream lines(content);
+    std::string line;
+    int lineNr = 0;
+    while (std::getline(lines, line))
+    {
+        lineNr++;
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream tok(line);
+        std::string type;
+        if (!(tok >> type)) continue;
+
+        bool ok;
+        if (type == "bounds")
+        {
+            ok = static_cast<bool>(tok >> origin[0] >> origin[1] >> origin[2] >> upper[0] >> upper[1] >> upper[2]);
+        }
+        else if (type == "resolution")
+        {
+            ok = (tok >> resolution) && resolution > 0;
+        }
+        else if (type == "box")
+        {
+            box_t b;
+            ok = static_cast<bool>(tok >> b.center[0] >> b.center[1] >> b.center[2] >> b.halfSize[0] >> b.halfSize[1] >> b.halfSize[2]);
+            b.halfSize *= 0.5;
+            if (ok) boxes.push_back(b);
+        }
+        else if (type == "plane")
+        {
+            plane_t p;
+            ok = (tok >> p.n[0] >> p.n[1] >> p.n[2] >> p.offset) && p.n.norm() > 0;
+            if (ok)
+            {
+                p.offset /= p.n.norm();
+                p.n.normalize();
+                planes.push_back(p);
+            }
+        }
+        else if (type == "mesh")
+        {
+            std::string file;
+            Eigen::Vector3d offset = Eigen::Vector3d::Zero();
+            ok = static_cast<bool>(tok >> file);
+            tok >> offset[0] >> offset[1] >> offset[2];
+            ok = ok && loadMesh(file[0] == '/'? file : dir + file, offset);
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok)
+        {
+            yError("[EnvironmentMap] %s:%d: cannot parse '%s'", descFile.c_str(), lineNr, line.c_str());
+            return false;
+        }
+    }
+
+    if ((upper - origin).minCoeff() <= 0)
+    {
+        yError("[EnvironmentMap] empty bounds in %s", descFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool EnvironmentMap::loadMesh(const std::string& file, const Eigen::Vector3d& offset)
+{
+    std::ifstream in(file);
+    if (!in.is_open())
+    {
+        yError("[EnvironmentMap] could not open mesh %s", file.c_str());
+        return false;
+    }
+    std::vector<Eigen::Vector3d> vertices;
+    std::vector<std::array<int, 3>> corners; // vertex indices of the triangles added
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream tok(line);
+        std::string type;
+        tok >> type;
+        if (type == "v")
+        {
+            Eigen::Vector3d v;
+            tok >> v[0] >> v[1] >> v[2];
+            vertices.emplace_back(v + offset);
+        }
+        else if (type == "f")
+        {
+            // faces may be "i", "i/t" or "i/t/n"; polygons are triangulated as fans
+            std::vector<int> idx;
+            std::string vert;
+            while (tok >> vert)
+            {
+                const int i = std::stoi(vert.substr(0, vert.find('/')));
+                idx.push_back(i > 0? i - 1 : static_cast<int>(vertices.size()) + i);
+            }
+            for (size_t k = 2; k < idx.size(); k++)
+            {
+                triangle_t t;
+                t.a = vertices.at(idx[0]);
+                t.b = vertices.at(idx[k-1]);
+                t.c = vertices.at(idx[k]);
+                t.n = (t.b - t.a).cross(t.c - t.a);
+                if (t.n.norm() < 1e-12) continue;
+                t.n.normalize();
+                triangles.push_back(t);
+                corners.push_back({idx[0], idx[k-1], idx[k]});
+            }
+        }
+    }
+
+    // pseudo-normals (Baerentzen and Aanaes, 2005): of a vertex, the normals of its faces weighted by their angle at
+    // it; of an edge, the sum of the normals of its two faces
+    std::vector<Eigen::Vector3d> vertexNormals(vertices.size(), Eigen::Vector3d::Zero());
+    std::map<std::pair<int, int>, Eigen::Vector3d> edgeNormals;
+    const size_t first = triangles.size() - corners.size();
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        const triangle_t& t = triangles[first + i];
+        const std::array<int, 3>& v = corners[i];
+        vertexNormals[v[0]] += angleAt(t.a, t.b, t.c) * t.n;
+        vertexNormals[v[1]] += angleAt(t.b, t.c, t.a) * t.n;
+        vertexNormals[v[2]] += angleAt(t.c, t.a, t.b) * t.n;
+        for (int e = 0; e < 3; e++)
+        {
+            const int p = v[e], q = v[(e+1)%3];
+            auto it = edgeNormals.emplace(std::make_pair(std::min(p, q), std::max(p, q)), Eigen::Vector3d::Zero()).first;
+            it->second += t.n;
+        }
+    }
+    for (size_t i = 0; i < corners.size(); i++)
+    {
+        triangle_t& t = triangles[first + i];
+        const std::array<int, 3>& v = corners[i];
+        for (int e = 0; e < 3; e++)
+        {
+            const int p = v[e], q = v[(e+1)%3];
+            t.pn[e] = vertexNormals[p];
+            t.pn[3+e] = edgeNormals[std::make_pair(std::min(p, q), std::max(p, q))];
+        }
+    }
+    printMessage(1, "mesh %s: %zu vertices, %zu triangles in total\n", file.c_str(), vertices.size(), triangles.size());
+    return true;
+}
+
+double EnvironmentMap::signedDistance(const Eigen::Vector3d& p) const
+{
+    double dist = std::numeric_limits<double>::max();
+    for (const auto& b : boxes)
+    {
+        const Eigen::Vector3d q = (p - b.center).cwiseAbs() - b.halfSize;
+        dist = std::min(dist, q.cwiseMax(0.0).norm() + std::min(q.maxCoeff(), 0.0));
+    }
+    for (const auto& pl : planes)
+    {
+        dist = std::min(dist, pl.n.dot(p) - pl.offset);
+    }
+    if (!triangles.empty())
+    {
+        double best = std::numeric_limits<double>::max();
+        double sign = 1.0;
+        for (const auto& t : triangles)
+        {
+            int feature;
+            const Eigen::Vector3d c = closestOnTriangle(p, t.a, t.b, t.c, feature);
+            const double d = (p - c).squaredNorm();
+            if (d < best)
+            {
+                best = d;
+                // the pseudo-normal of a shared vertex or edge is the same from all its triangles, so the sign does
+                // not depend on which of them is found first
+                const Eigen::Vector3d& n = feature == FACE? t.n : t.pn[feature];
+                sign = (n.dot(p - c) < 0)? -1.0 : 1.0;
+            }
+        }
+        dist = std::min(dist, sign * std::sqrt(best));
+    }
+    return dist;
+}
+
+void EnvironmentMap::build(std::vector<float>& data) const
+{
+    const size_t nx = dims[0], ny = dims[1], nz = dims[2];
+    const size_t nodes = nx * ny * nz;
+    std::vector<float> dist(nodes);
+
+    // distance pass, split over z slices
+    const unsigned int workers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    for (unsigned int w = 0; w < workers; w++)
+    {
+        pool.emplace_back([&, w]()
+        {
+            for (size_t z = w; z < nz; z += workers)
+            {
+                for (size_t y = 0; y < ny; y++)
+                {
+                    for (size_t x = 0; x < nx; x++)
+                    {
+                        const Eigen::Vector3d p = origin + resolution * Eigen::Vector3d(x, y, z);
+                        dist[(z*ny + y)*nx + x] = static_cast<float>(signedDistance(p));
+                    }
+                }
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+
+    // gradient pass: central differences, one-sided at the borders
+    data.assign(4*nodes, 0.0f);
+    const size_t stride[3] = {1, nx, nx*ny};
+    for (size_t z = 0; z < nz; z++)
+    {
+        for (size_t y = 0; y < ny; y++)
+        {
+            for (size_t x = 0; x < nx; x++)
+            {
+                const size_t idx[3] = {x, y, z};
+                const size_t i = (z*ny + y)*nx + x;
+                data[4*i] = dist[i];
+                for (int a = 0; a < 3; a++)
+                {
+                    const size_t lo = idx[a] > 0? i - stride[a] : i;
+                    const size_t hi = idx[a] + 1 < static_cast<size_t>(dims[a])? i + stride[a] : i;
+                    const double h = (hi - lo) / stride[a] * resolution;
+                    data[4*i + 1 + a] = h > 0? static_cast<float>((dist[hi] - dist[lo]) / h) : 0.0f;
+                }
+            }
+        }
+    }
+}
+
+bool EnvironmentMap::write(const std::string& cacheFile, uint64_t hash, const std::vector<float>& data) const
+{
+    header_t hdr{};
+    hdr.magic = SDF_MAGIC;
+    hdr.hash = hash;
+    for (int a = 0; a < 3; a++)
+    {
+        hdr.dims[a] = dims[a];
+        hdr.origin[a] = origin[a];
+    }
+    hdr.resolution = resolution;
+
+    const std::string tmp = cacheFile + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) return false;
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()*sizeof(float)));
+    out.close();
+    if (!out) return false;
+    return std::rename(tmp.c_str(), cacheFile.c_str()) == 0;
+}
+
+bool EnvironmentMap::mapCache(const std::string& cacheFile, uint64_t hash)
+{
+    const int fd = open(cacheFile.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    const size_t expected = sizeof(header_t) + 4*sizeof(float)*static_cast<size_t>(dims[0])*dims[1]*dims[2];
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != expected)
+    {
+        close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, expected, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    const auto* hdr = static_cast<const header_t*>(addr);
+    if (hdr->magic != SDF_MAGIC || hdr->hash != hash)
+    {
+        munmap(addr, expected);
+        return false;
+    }
+    mapped = addr;
+    mappedSize = expected;
+    grid = reinterpret_cast<const float*>(static_cast<const char*>(addr) + sizeof(header_t));
+    return true;
+}
+
+void EnvironmentMap::unmap()
+{
+    if (mapped != nullptr)
+    {
+        munmap(mapped, mappedSize);
+    }
+    mapped = nullptr;
+    mappedSize = 0;
+    grid = nullptr;
+    ownGrid.clear();
+    ownGrid.shrink_to_fit();
+}
+
+bool EnvironmentMap::query(const Eigen::Vector3d& p, double& dist, Eigen::Vector3d& normal) const
+{
+    if (grid == nullptr) return false;
+    const Eigen::Vector3d g = (p - origin) / resolution;
+    int i0[3];
+    double f[3];
+    for (int a = 0; a < 3; a++)
+    {
+        if (g[a] < 0 || g[a] > dims[a] - 1) return false;
+        i0[a] = std::min(static_cast<int>(g[a]), dims[a] - 2);
+        f[a] = g[a] - i0[a];
+    }
+
+    // trilinear interpolation of distance and gradient
+    double acc[4] = {0, 0, 0, 0};
+    for (int c = 0; c < 8; c++)
+    {
+        const int dx = c & 1, dy = (c >> 1) & 1, dz = (c >> 2) & 1;
+        const double w = (dx? f[0] : 1 - f[0]) * (dy? f[1] : 1 - f[1]) * (dz? f[2] : 1 - f[2]);
+        const float* node = grid + 4*((static_cast<size_t>(i0[2] + dz)*dims[1] + i0[1] + dy)*dims[0] + i0[0] + dx);
+        for (int k = 0; k < 4; k++)
+        {
+            acc[k] += w * node[k];
+        }
+    }
+    dist = acc[0];
+    normal = Eigen::Vector3d(acc[1], acc[2], acc[3]);
+    const double n = normal.norm();
+    if (n < 1e-9) return false;
+    normal /= n;
+    return true;
+}
+
+int EnvironmentMap::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[EnvironmentMap] ");
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
@@ -0,0 +1,172 @@
+//
+// Link frames, end-effector pose and Jacobian of a chain, computed once per configuration and shared by all the users.
+//
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <yarp/math/Math.h>
+#include "kinematicState.h"
+
+using namespace yarp::sig;
+using namespace yarp::math;
+
+
+KinematicState::KinematicState(iCub::iKin::iCubArm* _chain):
+        arm(nullptr), useEngine(false), poseValid(false), orientationValid(false), jacobianValid(false), count(0)
+{
+    if (_chain) setChain(_chain);
+}
+
+void KinematicState::setChain(iCub::iKin::iCubArm* _chain)
+{
+    arm = _chain;
+    frames.assign(arm->getN()+1, Matrix(4,4));
+    eeFrame.resize(4,4);
+    useEngine = engine.configure(*arm->asChain());
+    refresh();
+}
+
+bool KinematicState::update(const Vector& _q)
+{
+    if (arm == nullptr) return false;
+    if (_q.size() == q.size() && (_q.size() == 0 || std::equal(_q.begin(), _q.end(), q.begin())))
+    {
+        return false;
+    }
+    compute(arm->setAng(_q)); // within the joint limits
+    q = _q;
+    return true;
+}
+
+void KinematicState::refresh()
+{
+    q = arm->getAng();
+    compute(q);
+}
+
+void KinematicState::compute(const Vector& qChain)
+{
+    if (useEngine)
+    {
+        engine.compute(qChain.data());
+        for (size_t j = 0; j < frames.size(); j++)
+        {
+            ArmKinematics::toYarp(engine.frame(static_cast<int>(j)), frames[j]);
+        }
+        ArmKinematics::toYarp(engine.endEffector(), eeFrame);
+    }
+    else
+    {
+        iCub::iKin::iKinChain& chain = *arm->asChain();
+        frames[0] = chain.getH0();
+        for (unsigned int j = 0; j+1 < frames.size(); j++)
+        {
+            frames[j+1] = frames[j] * chain[j].getH(true);
+        }
+        eeFrame = frames.back() * chain.getHN();
+    }
+    poseValid = false;
+    orientationValid = false;
+    jacobianValid = false;
+    count++;
+}
+
+const Vector& KinematicState::pose()
+{
+    if (!poseValid)
+    {
+        eePose.resize(7);
+        eePose.setSubvector(0, eeFrame.subcol(0,3,3));
+        eePose.setSubvector(3, dcm2axis(eeFrame));
+        poseValid = true;
+    }
+    return eePose;
+}
+
+const Eigen::Quaterniond& KinematicState::orientation()
+{
+    if (!orientationValid)
+    {
+        eeOrientation = matrixToQuaternion(eeFrame);
+        orientationValid = true;
+    }
+    return eeOrientation;
+}
+
+const Matrix& KinematicState::jacobian()
+{
+    if (!jacobianValid)
+    {
+        if (useEngine)
+        {
+            const ArmKinematics::Jacobian& Je = engine.jacobian();
+            J.resize(6, Je.cols());
+            for (int r = 0; r < 6; r++)
+            {
+                for (int c = 0; c < Je.cols(); c++)
+                {
+                    J(r, c) = Je(r, c);
+                }
+            }
+        }
+        else
+        {
+            J = arm->GeoJacobian();
+        }
+        jacobianValid = true;
+    }
+    return J;
+}
+
+bool KinematicState::crossCheck(const int samples, const double tol, double& worst)
+{
+    worst = 0.0;
+    if (!useEngine)
+    {
+        return false;
+    }
+    iCub::iKin::iKinChain& chain = *arm->asChain();
+    const Vector q0 = arm->getAng();
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    Vector qs(chain.getDOF());
+    for (int s = 0; s < samples; s++)
+    {
+        for (size_t i = 0; i < qs.size(); i++)
+        {
+            qs[i] = chain(i).getMin() + unit(gen) * (chain(i).getMax() - chain(i).getMin());
+        }
+        qs = arm->setAng(qs);
+        engine.compute(qs.data());
+        for (unsigned int j = 0; j < chain.getN(); j++)
+        {
+            const Matrix H = chain.getH(j, true);
+            for (int r = 0; r < 3; r++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    worst = std::max(worst, std::abs(H(r, c) - engine.frame(static_cast<int>(j)+1)(r, c)));
+                }
+            }
+        }
+        const Matrix Jr = chain.GeoJacobian();
+        for (int r = 0; r < 6; r++)
+        {
+            for (size_t c = 0; c < Jr.cols(); c++)
+            {
+                worst = std::max(worst, std::abs(Jr(r, c) - engine.jacobian()(r, static_cast<int>(c))));
+            }
+        }
+    }
+    arm->setAng(q0);
+    refresh();
+    if (worst > tol)
+    {
+        // iKin stays the reference
+        useEngine = false;
+        refresh();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,190 @@
+//
+// World-frame memory of the obstacles seen by any modality, stored in an octree with time-decayed occupancy.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <algorithm>
+#include "obstacleMemory.h"
+
+
+ObstacleMemory::ObstacleMemory(const double _resolution, const double _decay, const double _extent,
+                               const unsigned int _verbosity):
+        resolution(_resolution), decay(_decay), extent(_extent), horizon(_decay * std::log(1.0 / MIN_OCCUPANCY)),
+        depth(1), verbosity(_verbosity)
+{
+    // levels until the cells are not larger than the resolution
+    while (2.0 * extent / (1 << depth) > resolution && depth < 16)
+    {
+        depth++;
+    }
+    leaves.reserve(1024);
+    live.reserve(MAX_LEAVES);
+    nodes.reserve(1024);
+    stack.reserve(8 * depth);
+    clear();
+    printMessage(1, "%d levels, cells of %.3f m, free after %.2f s\n", depth, 2.0 * extent / (1 << depth), horizon);
+}
+
+int ObstacleMemory::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[ObstacleMemory] ");
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
+
+void ObstacleMemory::clear()
+{
+    nodes.clear();
+    leaves.clear();
+    newNode(-1e9);
+}
+
+int ObstacleMemory::newNode(const double stamp)
+{
+    node_t n;
+    std::fill(n.child, n.child + 8, -1);
+    n.latest = stamp;
+    nodes.push_back(n);
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+double ObstacleMemory::occupancyAt(const leaf_t& l, const double now) const
+{
+    return l.occupancy * std::exp(-(now - l.stamp) / decay);
+}
+
+void ObstacleMemory::insert(const Eigen::Vector3d& p, const double stamp, const double occupancy)
+{
+    if (p.cwiseAbs().maxCoeff() >= extent || occupancy <= 0.0)
+    {
+        return;
+    }
+    if (static_cast<int>(leaves.size()) >= MAX_LEAVES)
+    {
+        prune(stamp);
+        if (static_cast<int>(leaves.size()) >= MAX_LEAVES)
+        {
+            printMessage(2, "memory full, obstacle at %.3f %.3f %.3f not stored\n", p[0], p[1], p[2]);
+            return;
+        }
+    }
+
+    int node = 0;
+    Eigen::Vector3d c = Eigen::Vector3d::Zero();
+    double half = extent;
+    for (int level = 0; level < depth; level++)
+    {
+        nodes[node].latest = std::max(nodes[node].latest, stamp);
+        const int octant = (p[0] > c[0] ? 1 : 0) | (p[1] > c[1] ? 2 : 0) | (p[2] > c[2] ? 4 : 0);
+        half *= 0.5;
+        c += half * Eigen::Vector3d(octant & 1 ? 1 : -1, octant & 2 ? 1 : -1, octant & 4 ? 1 : -1);
+        const int child = nodes[node].child[octant];
+        if (level == depth - 1)
+        {
+            if (child < 0)
+            {
+                nodes[node].child[octant] = static_cast<int>(leaves.size());
+                leaves.push_back({p, std::min(1.0, occupancy), stamp});
+            }
+            else
+            {
+                // independent observations of the same cell raise the confidence
+                leaf_t& l = leaves[child];
+                const double prior = occupancyAt(l, stamp);
+                l.p = p;
+                l.occupancy = prior + std::min(1.0, occupancy) * (1.0 - prior);
+                l.stamp = stamp;
+            }
+            return;
+        }
+        if (child < 0)
+        {
+            const int n = newNode(stamp); // may reallocate nodes
+            nodes[node].child[octant] = n;
+        }
+        node = nodes[node].child[octant];
+    }
+}
+
+void ObstacleMemory::prune(const double now)
+{
+    // rebuilds the tree with the cells that are still occupied, as they were last observed: their stamps tell
+    // nearest() which cells are perceived in the current cycle
+    live.clear();
+    for (const auto& l : leaves)
+    {
+        if (occupancyAt(l, now) >= MIN_OCCUPANCY)
+        {
+            live.push_back(l);
+        }
+    }
+    printMessage(2, "pruned %lu of %lu cells\n", leaves.size() - live.size(), leaves.size());
+    clear();
+    for (const auto& l : live)
+    {
+        insert(l.p, l.stamp, l.occupancy);
+    }
+}
+
+double ObstacleMemory::segmentPoint(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& p,
+                                    Eigen::Vector3d& onSegment)
+{
+    const Eigen::Vector3d ab = b - a;
+    const double t = std::min(1.0, std::max(0.0, (p - a).dot(ab) / std::max(ab.squaredNorm(), 1e-12)));
+    onSegment = a + t * ab;
+    return (p - onSegment).norm();
+}
+
+bool ObstacleMemory::nearest(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const double now, const double maxDist,
+                             const double skipSince, nearest_t& result)
+{
+    result.valid = false;
+    double best = maxDist;
+    Eigen::Vector3d w;
+    stack.clear();
+    stack.push_back({0, 0, extent, Eigen::Vector3d::Zero()});
+    while (!stack.empty())
+    {
+        const entry_t e = stack.back();
+        stack.pop_back();
+        const node_t& n = nodes[e.node];
+        // nothing recent below, or the whole cube (within its circumscribed sphere) is farther than the best so far
+        if (now - n.latest > horizon || segmentPoint(a, b, e.center, w) - std::sqrt(3.0) * e.half >= best)
+        {
+            continue;
+        }
+        const double half = 0.5 * e.half;
+        for (int o = 0; o < 8; o++)
+        {
+            const int child = n.child[o];
+            if (child < 0) continue;
+            if (e.level < depth - 1)
+            {
+                stack.push_back({child, e.level + 1, half,
+                                 e.center + half * Eigen::Vector3d(o & 1 ? 1 : -1, o & 2 ? 1 : -1, o & 4 ? 1 : -1)});
+                continue;
+            }
+            const leaf_t& l = leaves[child];
+            if (l.stamp >= skipSince) continue;
+            const double occ = occupancyAt(l, now);
+            if (occ < MIN_OCCUPANCY) continue;
+            const double d = segmentPoint(a, b, l.p, w);
+            if (d < best)
+            {
+                best = d;
+                result = {true, d, occ, w, l.p};
+            }
+        }
+    }
+    return result.valid;
+}
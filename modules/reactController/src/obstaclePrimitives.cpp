@@ -0,0 +1,314 @@
+//
+// Geometric obstacles (spheres, boxes and capsules, possibly moving) and their distance to the robot links.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <string>
+#include <algorithm>
+#include "obstaclePrimitives.h"
+
+
+// limbs of a standing adult, radii [m] of the capsules around the bones
+const std::vector<ObstaclePrimitives::bone_t> ObstaclePrimitives::bones = {
+        {"head", "shoulderCenter", 0.12},
+        {"shoulderCenter", "hipCenter", 0.16},
+        {"shoulderCenter", "shoulderLeft", 0.07}, {"shoulderCenter", "shoulderRight", 0.07},
+        {"shoulderLeft", "elbowLeft", 0.06}, {"elbowLeft", "handLeft", 0.05},
+        {"shoulderRight", "elbowRight", 0.06}, {"elbowRight", "handRight", 0.05},
+        {"hipCenter", "hipLeft", 0.09}, {"hipCenter", "hipRight", 0.09},
+        {"hipLeft", "kneeLeft", 0.08}, {"kneeLeft", "ankleLeft", 0.06},
+        {"hipRight", "kneeRight", 0.08}, {"kneeRight", "ankleRight", 0.06}
+};
+
+
+ObstaclePrimitives::ObstaclePrimitives(const double _timeout, const unsigned int _verbosity):
+        timeout(_timeout), verbosity(_verbosity), stamp(0), prevStamp(0)
+{
+    primitives.reserve(16);
+}
+
+int ObstaclePrimitives::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[ObstaclePrimitives] ");
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
+
+void ObstaclePrimitives::toFrame(frame_t& f) const
+{
+    f.n = std::min(static_cast<int>(primitives.size()), MAX_PRIMITIVES);
+    if (f.n < static_cast<int>(primitives.size()))
+    {
+        printMessage(1, "%lu obstacles, only the first %d are used\n", primitives.size(), MAX_PRIMITIVES);
+    }
+    f.stamp = stamp;
+    std::copy(primitives.begin(), primitives.begin() + f.n, f.primitives);
+}
+
+void ObstaclePrimitives::assign(const frame_t& f)
+{
+    primitives.assign(f.primitives, f.primitives + f.n);
+    stamp = f.stamp;
+}
+
+int ObstaclePrimitives::parse(const yarp::os::Bottle& b, const double _stamp)
+{
+    primitives.clear();
+    stamp = _stamp;
+    const auto vec = [](const yarp::os::Bottle& l, int i) {
+        return Eigen::Vector3d(l.get(i).asFloat64(), l.get(i+1).asFloat64(), l.get(i+2).asFloat64());
+    };
+
+    for (int i = 0; i < b.size(); i++)
+    {
+        if (!b.get(i).isList())
+        {
+            // plain points, as sent by the former version of the port
+            if (i + 2 < b.size())
+            {
+                primitives.push_back({SPHERE, vec(b, i), Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero(),
+                                      Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero()});
+            }
+            i += 2;
+            continue;
+        }
+
+        const yarp::os::Bottle& l = *b.get(i).asList();
+        const std::string shape = l.get(0).asString();
+        primitive_t p{SPHERE, Eigen::Vector3d::Zero(), Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero(),
+                      Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero()};
+        int next;
+        if (shape == "sphere" && l.size() >= 5)
+        {
+            p.center = vec(l, 1);
+            p.halfSize[0] = std::max(0.0, l.get(4).asFloat64());
+            next = 5;
+        }
+        else if (shape == "box" && l.size() >= 7)
+        {
+            p.shape = BOX;
+            p.center = vec(l, 1);
+            p.halfSize = 0.5 * vec(l, 4).cwiseAbs();
+            next = 7;
+        }
+        else
+        {
+            printMessage(0, "unknown obstacle %s, skipped\n", l.toString().c_str());
+            continue;
+        }
+        if (l.size() >= next + 3)
+        {
+            p.vel = vec(l, next);
+        }
+        if (p.shape == BOX && l.size() >= next + 7)
+        {
+            const Eigen::Vector3d axis = vec(l, next + 3);
+            if (axis.norm() > 1e-9)
+            {
+                p.R = Eigen::AngleAxisd(l.get(next + 6).asFloat64(), axis.normalized()).toRotationMatrix();
+            }
+        }
+        primitives.push_back(p);
+    }
+    printMessage(3, "received %lu obstacles\n", primitives.size());
+    return static_cast<int>(primitives.size());
+}
+
+int ObstaclePrimitives::parseSkeletons(const yarp::os::Bottle& b, const double _stamp)
+{
+    primitives.clear();
+    std::swap(keypoints, prevKeypoints);
+    keypoints.clear();
+    const double dt = _stamp - prevStamp;
+    prevStamp = stamp = _stamp;
+
+    // a single skeleton is a list of keypoints, whose first element is the name
+    const yarp::os::Bottle* first = b.get(0).asList();
+    if (first && !first->get(0).isList())
+    {
+        addSkeleton(b, 0, dt);
+    }
+    else
+    {
+        for (int i = 0; i < b.size(); i++)
+        {
+            if (const yarp::os::Bottle* skeleton = b.get(i).asList()) addSkeleton(*skeleton, i, dt);
+        }
+    }
+    printMessage(3, "received %lu bones\n", primitives.size());
+    return static_cast<int>(primitives.size());
+}
+
+void ObstaclePrimitives::addSkeleton(const yarp::os::Bottle& skeleton, const int index, const double dt)
+{
+    const std::string prefix = std::to_string(index) + "/";
+    for (int i = 0; i < skeleton.size(); i++)
+    {
+        const yarp::os::Bottle* kp = skeleton.get(i).asList();
+        if (kp == nullptr || kp->size() < 4) continue;
+        keypoints[prefix + kp->get(0).asString()] = Eigen::Vector3d(kp->get(1).asFloat64(), kp->get(2).asFloat64(),
+                                                                    kp->get(3).asFloat64());
+    }
+
+    const auto velocity = [&](const std::string& key, const Eigen::Vector3d& p) {
+        auto prev = prevKeypoints.find(key);
+        return (prev != prevKeypoints.end() && dt > 1e-3 && dt < timeout) ? Eigen::Vector3d((p - prev->second) / dt)
+                                                                           : Eigen::Vector3d::Zero();
+    };
+    for (const auto& bone : bones)
+    {
+        auto from = keypoints.find(prefix + bone.from);
+        auto to = keypoints.find(prefix + bone.to);
+        if (from == keypoints.end() || to == keypoints.end()) continue;
+        primitive_t p{CAPSULE, from->second, Eigen::Matrix3d::Identity(), Eigen::Vector3d(bone.radius, 0, 0),
+                      0.5 * (velocity(from->first, from->second) + velocity(to->first, to->second)), to->second};
+        primitives.push_back(p);
+    }
+}
+
+double ObstaclePrimitives::segmentCapsule(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c,
+                                          const Eigen::Vector3d& d, const double r, Eigen::Vector3d& onSegment,
+                                          Eigen::Vector3d& normal)
+{
+    // closest points of the segments a + s (b-a) and c + t (d-c), clamping s and t to [0, 1]
+    const Eigen::Vector3d u = b - a, v = d - c, w = a - c;
+    const double uu = u.squaredNorm(), vv = v.squaredNorm(), uv = u.dot(v), uw = u.dot(w), vw = v.dot(w);
+    const double den = uu * vv - uv * uv;
+    double s = (uu < 1e-12) ? 0.0 : (den > 1e-12 ? std::min(1.0, std::max(0.0, (uv * vw - vv * uw) / den)) : 0.0);
+    double t = (vv < 1e-12) ? 0.0 : (uv * s + vw) / vv;
+    if (t < 0.0 || t > 1.0)
+    {
+        t = std::min(1.0, std::max(0.0, t));
+        s = (uu < 1e-12) ? 0.0 : std::min(1.0, std::max(0.0, (uv * t - uw) / uu));
+    }
+    onSegment = a + s * u;
+    const Eigen::Vector3d diff = c + t * v - onSegment;
+    const double n = diff.norm();
+    normal = (n > 1e-9) ? Eigen::Vector3d(diff / n) : Eigen::Vector3d::UnitZ();
+    return n - r;
+}
+
+double ObstaclePrimitives::segmentSphere(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const Eigen::Vector3d& c,
+                                         const double r, Eigen::Vector3d& onSegment, Eigen::Vector3d& normal)
+{
+    const Eigen::Vector3d ab = b - a;
+    const double t = std::min(1.0, std::max(0.0, (c - a).dot(ab) / std::max(ab.squaredNorm(), 1e-12)));
+    onSegment = a + t * ab;
+    const Eigen::Vector3d d = c - onSegment;
+    const double n = d.norm();
+    normal = (n > 1e-9) ? Eigen::Vector3d(d / n) : Eigen::Vector3d::UnitZ();
+    return n - r;
+}
+
+double ObstaclePrimitives::segmentBox(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const primitive_t& box,
+                                      const Eigen::Vector3d& c, Eigen::Vector3d& onSegment, Eigen::Vector3d& normal)
+{
+    // everything in the FoR of the box, where it spans [-halfSize, halfSize]
+    const Eigen::Vector3d la = box.R.transpose() * (a - c);
+    const Eigen::Vector3d lab = box.R.transpose() * (b - a);
+    const Eigen::Vector3d& h = box.halfSize;
+    const auto outside = [&](double t) {
+        const Eigen::Vector3d p = la + t * lab;
+        return (p - p.cwiseMax(-h).cwiseMin(h)).norm();
+    };
+    const auto depth = [&](double t) {
+        const Eigen::Vector3d p = la + t * lab;
+        return (h - p.cwiseAbs()).minCoeff();
+    };
+
+    // golden section search of a convex function of the position along the segment
+    const auto minimize = [](auto f) {
+        const double g = 0.5 * (std::sqrt(5.0) - 1.0);
+        double lo = 0.0, hi = 1.0;
+        double t1 = hi - g * (hi - lo), t2 = lo + g * (hi - lo);
+        double f1 = f(t1), f2 = f(t2);
+        for (int k = 0; k < SEARCH_ITERATIONS; k++)
+        {
+            if (f1 <= f2)
+            {
+                hi = t2; t2 = t1; f2 = f1;
+                t1 = hi - g * (hi - lo); f1 = f(t1);
+            }
+            else
+            {
+                lo = t1; t1 = t2; f1 = f2;
+                t2 = lo + g * (hi - lo); f2 = f(t2);
+            }
+        }
+        const double t = 0.5 * (lo + hi);
+        // the minimum may also lie at an end point, where the bracketing cannot reach exactly
+        if (f(0.0) <= f(t)) return 0.0;
+        if (f(1.0) <= f(t)) return 1.0;
+        return t;
+    };
+
+    double t = minimize(outside);
+    double dist = outside(t);
+    if (dist <= 0.0)
+    {
+        // the segment enters the box: the deepest point (depth is concave) gives the penetration
+        t = minimize([&](double s) { return -depth(s); });
+        dist = -depth(t);
+    }
+    const Eigen::Vector3d p = la + t * lab;
+    onSegment = a + t * (b - a);
+
+    Eigen::Vector3d n;
+    if (dist > 0.0)
+    {
+        n = p.cwiseMax(-h).cwiseMin(h) - p;
+    }
+    else
+    {
+        // towards the obstacle means away from the nearest face, so that the link is pushed out through it
+        int face = 0;
+        (h - p.cwiseAbs()).minCoeff(&face);
+        n = Eigen::Vector3d::Zero();
+        n[face] = (p[face] >= 0.0) ? -1.0 : 1.0;
+    }
+    const double nn = n.norm();
+    normal = box.R * ((nn > 1e-9) ? Eigen::Vector3d(n / nn) : Eigen::Vector3d::UnitZ());
+    return dist;
+}
+
+int ObstaclePrimitives::closest(const Eigen::Vector3d& a, const Eigen::Vector3d& b, const double now,
+                                const double maxDist, std::vector<witness_t>& results) const
+{
+    if (empty(now)) return 0;
+    const double elapsed = now - stamp;
+    int added = 0;
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        const primitive_t& p = primitives[i];
+        const Eigen::Vector3d c = p.center + elapsed * p.vel;
+        witness_t w{static_cast<int>(i), 0.0, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), p.vel};
+        if (p.shape == SPHERE)
+        {
+            w.dist = segmentSphere(a, b, c, p.halfSize[0], w.onSegment, w.normal);
+        }
+        else if (p.shape == CAPSULE)
+        {
+            w.dist = segmentCapsule(a, b, c, p.end + elapsed * p.vel, p.halfSize[0], w.onSegment, w.normal);
+        }
+        else
+        {
+            w.dist = segmentBox(a, b, p, c, w.onSegment, w.normal);
+        }
+        if (w.dist < maxDist)
+        {
+            results.push_back(w);
+            added++;
+        }
+    }
+    return added;
+}
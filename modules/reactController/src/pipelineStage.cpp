@@ -0,0 +1,142 @@
+//
+// Stage of the control pipeline: a thread running one job per control cycle, within a latency budget.
+//
+
+#include <cstdio>
+#include <cstdarg>
+#include <utility>
+#include <algorithm>
+#include "pipelineStage.h"
+
+
+PipelineStage::PipelineStage(std::string _name, const double _budget, const unsigned int _verbosity):
+        name(std::move(_name)),
+        budget(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(_budget))),
+        verbosity(_verbosity), started(false), stopping(false), busy(false), nRuns(0), nOverruns(0), nSkips(0),
+        longest(0.0)
+{ }
+
+PipelineStage::~PipelineStage()
+{
+    stop();
+}
+
+void PipelineStage::start(std::function<void()> _job)
+{
+    stop();
+    job = std::move(_job);
+    stopping = false;
+    started = true;
+    worker = std::thread(&PipelineStage::workerLoop, this);
+    printMessage(1, "started, budget %.1f ms\n", std::chrono::duration<double, std::milli>(budget).count());
+}
+
+void PipelineStage::stop()
+{
+    if (!started) return;
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        stopping = true;
+    }
+    wakeCv.notify_all();
+    worker.join();
+    started = false;
+}
+
+bool PipelineStage::trigger()
+{
+    if (!started)
+    {
+        if (job) job();
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        if (busy)
+        {
+            nSkips++;
+            printMessage(2, "still running, trigger skipped\n");
+            return false;
+        }
+        busy = true;
+        triggered = Clock::now();
+    }
+    wakeCv.notify_one();
+    return true;
+}
+
+bool PipelineStage::wait()
+{
+    if (!started) return true;
+    std::unique_lock<std::mutex> lk(mtx);
+    return doneCv.wait_until(lk, triggered + budget, [this]() { return !busy; });
+}
+
+unsigned long PipelineStage::runs() const
+{
+    std::lock_guard<std::mutex> lg(mtx);
+    return nRuns;
+}
+
+unsigned long PipelineStage::overruns() const
+{
+    std::lock_guard<std::mutex> lg(mtx);
+    return nOverruns;
+}
+
+unsigned long PipelineStage::skips() const
+{
+    std::lock_guard<std::mutex> lg(mtx);
+    return nSkips;
+}
+
+double PipelineStage::maxLatency() const
+{
+    std::lock_guard<std::mutex> lg(mtx);
+    return longest;
+}
+
+void PipelineStage::workerLoop()
+{
+    while (true)
+    {
+        Clock::time_point t0;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            wakeCv.wait(lk, [this]() { return stopping || busy; });
+            if (!busy) return; // stopping with no job pending
+            t0 = triggered;
+        }
+
+        job();
+
+        const Clock::duration latency = Clock::now() - t0;
+        {
+            std::lock_guard<std::mutex> lg(mtx);
+            busy = false;
+            nRuns++;
+            longest = std::max(longest, std::chrono::duration<double>(latency).count());
+            if (latency > budget) nOverruns++;
+        }
+        doneCv.notify_all();
+        if (latency > budget)
+        {
+            printMessage(1, "over budget by %.2f ms\n", std::chrono::duration<double, std::milli>(latency - budget).count());
+        }
+    }
+}
+
+int PipelineStage::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[PipelineStage %s] ",name.c_str());
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
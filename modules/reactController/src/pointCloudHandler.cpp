@@ -0,0 +1,242 @@
+//
+// Obstacles from depth data: voxel occupancy of a point cloud and nearest obstacle to the robot links.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <limits>
+#include <algorithm>
+#include "pointCloudHandler.h"
+
+// 21 bits per axis, i.e. +-20 m at 2 cm
+#define AXIS_BITS 21
+#define AXIS_OFFSET (1 << (AXIS_BITS-1))
+#define AXIS_MASK ((1 << AXIS_BITS) - 1)
+
+
+PointCloudHandler::PointCloudHandler(const double _voxel, const yarp::sig::Matrix& _extrinsics, const double _memory,
+                                     const int _stride, const double _selfRadius, const unsigned int _verbosity):
+        voxel(_voxel), memory(_memory), stride(std::max(1, _stride)), selfRadius(_selfRadius), verbosity(_verbosity),
+        table(TABLE_SIZE, voxel_t{EMPTY, 0.0}), partial(CHUNKS)
+{
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            R(r, c) = _extrinsics(r, c);
+        }
+        t[r] = _extrinsics(r, 3);
+    }
+    centers.reserve(TABLE_SIZE);
+    self.reserve(TABLE_SIZE);
+}
+
+int PointCloudHandler::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[PointCloudHandler] ");
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
+
+int64_t PointCloudHandler::quantize(const Eigen::Vector3d& p) const
+{
+    int64_t key = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        const int64_t q = static_cast<int64_t>(std::floor(p[k] / voxel)) + AXIS_OFFSET;
+        if (q < 0 || q > AXIS_MASK) return EMPTY;
+        key = (key << AXIS_BITS) | q;
+    }
+    return key;
+}
+
+Eigen::Vector3f PointCloudHandler::center(const int64_t key) const
+{
+    Eigen::Vector3f c;
+    for (int k = 2; k >= 0; k--)
+    {
+        const int64_t q = ((key >> (AXIS_BITS * (2-k))) & AXIS_MASK) - AXIS_OFFSET;
+        c[k] = static_cast<float>((static_cast<double>(q) + 0.5) * voxel);
+    }
+    return c;
+}
+
+void PointCloudHandler::insert(const int64_t key, const double stamp)
+{
+    // Fibonacci hashing, then linear probing; a voxel that has not been seen for a while is overwritten
+    size_t slot = (static_cast<uint64_t>(key) * 11400714819323198485ull) >> (64 - TABLE_BITS);
+    int reusable = -1;
+    for (int i = 0; i < MAX_PROBES; i++, slot = (slot + 1) & (TABLE_SIZE - 1))
+    {
+        voxel_t& v = table[slot];
+        if (v.key == key)
+        {
+            v.stamp = stamp;
+            return;
+        }
+        if (v.key == EMPTY)
+        {
+            if (reusable < 0) reusable = static_cast<int>(slot);
+            break;
+        }
+        if (reusable < 0 && stamp - v.stamp > memory) reusable = static_cast<int>(slot);
+    }
+    if (reusable >= 0)
+    {
+        table[reusable] = {key, stamp};
+    }
+}
+
+void PointCloudHandler::integrate(const yarp::sig::PointCloud<yarp::sig::DataXYZ>& cloud, const double stamp, WorkerPool& pool)
+{
+    quantize(cloud, keys, pool);
+    integrate(keys, stamp);
+}
+
+void PointCloudHandler::quantize(const yarp::sig::PointCloud<yarp::sig::DataXYZ>& cloud, std::vector<int64_t>& cloudKeys,
+                                 WorkerPool& pool) const
+{
+    const int n = static_cast<int>(cloud.size()) / stride;
+    cloudKeys.resize(n); // grows only with the resolution of the sensor
+
+    pool.parallelFor(CHUNKS, [&](int c)
+    {
+        const int end = n * (c+1) / CHUNKS;
+        for (int i = n * c / CHUNKS; i < end; i++)
+        {
+            const yarp::sig::DataXYZ& pt = cloud(static_cast<size_t>(i) * stride);
+            if (!std::isfinite(pt.z) || pt.z <= 0.0f)
+            {
+                cloudKeys[i] = EMPTY;
+                continue;
+            }
+            cloudKeys[i] = quantize(R * Eigen::Vector3d(pt.x, pt.y, pt.z) + t);
+        }
+    });
+}
+
+void PointCloudHandler::integrate(const std::vector<int64_t>& cloudKeys, const double stamp)
+{
+    // consecutive points mostly fall in the same voxel
+    int64_t last = EMPTY;
+    for (const int64_t key : cloudKeys)
+    {
+        if (key == EMPTY || key == last) continue;
+        insert(key, stamp);
+        last = key;
+    }
+    printMessage(5, "integrated %lu points\n", cloudKeys.size());
+}
+
+int PointCloudHandler::update(const std::vector<segment_t>& robot, const double now, WorkerPool& pool)
+{
+    centers.clear();
+    for (const auto& v : table)
+    {
+        if (v.key != EMPTY && now - v.stamp <= memory)
+        {
+            centers.push_back(center(v.key));
+        }
+    }
+    if (selfRadius <= 0.0 || robot.empty()) return static_cast<int>(centers.size());
+
+    // the robot sees its own links, which must not become obstacles to themselves
+    const int n = static_cast<int>(centers.size());
+    const float r2 = static_cast<float>(selfRadius * selfRadius);
+    self.assign(n, 0);
+    pool.parallelFor(CHUNKS, [&](int c)
+    {
+        const int end = n * (c+1) / CHUNKS;
+        for (int i = n * c / CHUNKS; i < end; i++)
+        {
+            for (const auto& s : robot)
+            {
+                const Eigen::Vector3f a = s.a.cast<float>();
+                const Eigen::Vector3f ab = (s.b - s.a).cast<float>();
+                const Eigen::Vector3f ap = centers[i] - a;
+                const float u = std::min(1.0f, std::max(0.0f, ap.dot(ab) / std::max(ab.squaredNorm(), 1e-12f)));
+                if ((ap - u * ab).squaredNorm() < r2)
+                {
+                    self[i] = 1;
+                    break;
+                }
+            }
+        }
+    });
+    int kept = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (!self[i]) centers[kept++] = centers[i];
+    }
+    centers.resize(kept);
+    printMessage(5, "%d voxels of the robot itself dropped\n", n - kept);
+    return kept;
+}
+
+int PointCloudHandler::nearest(const std::vector<segment_t>& segments, std::vector<nearest_t>& results, WorkerPool& pool)
+{
+    const int nSeg = static_cast<int>(segments.size());
+    results.resize(nSeg);
+    if (static_cast<int>(partial.size()) < nSeg * CHUNKS)
+    {
+        partial.resize(nSeg * CHUNKS);
+    }
+    const int n = static_cast<int>(centers.size());
+
+    pool.parallelFor(nSeg * CHUNKS, [&](int item)
+    {
+        const segment_t& s = segments[item / CHUNKS];
+        const int c = item % CHUNKS;
+        const Eigen::Vector3f a = s.a.cast<float>();
+        const Eigen::Vector3f ab = (s.b - s.a).cast<float>();
+        const float len2 = std::max(ab.squaredNorm(), 1e-12f);
+        nearest_t& best = partial[item];
+        float bestDist2 = std::numeric_limits<float>::max();
+        int bestIdx = -1;
+        float bestT = 0.0f;
+        const int end = n * (c+1) / CHUNKS;
+        for (int i = n * c / CHUNKS; i < end; i++)
+        {
+            const Eigen::Vector3f ap = centers[i] - a;
+            const float u = std::min(1.0f, std::max(0.0f, ap.dot(ab) / len2));
+            const float d2 = (ap - u * ab).squaredNorm();
+            if (d2 < bestDist2)
+            {
+                bestDist2 = d2;
+                bestIdx = i;
+                bestT = u;
+            }
+        }
+        best.valid = bestIdx >= 0;
+        if (best.valid)
+        {
+            best.dist = std::sqrt(bestDist2);
+            best.onSegment = s.a + bestT * (s.b - s.a);
+            best.obstacle = centers[bestIdx].cast<double>();
+        }
+    });
+
+    for (int s = 0; s < nSeg; s++)
+    {
+        nearest_t& r = results[s];
+        r.valid = false;
+        for (int c = 0; c < CHUNKS; c++)
+        {
+            const nearest_t& p = partial[s * CHUNKS + c];
+            if (p.valid && (!r.valid || p.dist < r.dist))
+            {
+                r = p;
+            }
+        }
+    }
+    return n;
+}
@@ -0,0 +1,78 @@
+//
+// Registry of the proximity sensors, each streaming its events on its own port.
+//
+
+#include <utility>
+#include <yarp/os/Log.h>
+#include "proximitySensors.h"
+
+
+ProximitySensors::ProximitySensors(std::vector<std::string> _names): names(std::move(_names)), shown(names.size(), false)
+{
+    readings.reserve(names.size());
+    silenced.reserve(names.size());
+}
+
+bool ProximitySensors::open(const std::string& prefix)
+{
+    bool ok = true;
+    ports.clear();
+    for (const auto& n : names)
+    {
+        ports.push_back(std::make_unique<port_t>([seq = 0u](const yarp::os::Bottle& b, SpscRing<portEvent_t, RING_SIZE>& ring) mutable
+        {
+            ring.push(parsePortEvent(b, PROX_OBS, seq++));
+        }));
+        if (!ports.back()->open(prefix+"/"+n+":i"))
+        {
+            yError("[ProximitySensors] Unable to open port for the proximity sensor %s", n.c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void ProximitySensors::close()
+{
+    for (auto& p : ports)
+    {
+        p->interrupt();
+        p->close();
+    }
+    ports.clear();
+}
+
+const std::vector<ProximitySensors::reading_t>& ProximitySensors::drain()
+{
+    readings.clear();
+    silenced.clear();
+    for (size_t i = 0; i < ports.size(); i++)
+    {
+        reading_t r{static_cast<int>(i), {}};
+        bool any = false;
+        while (ports[i]->records().pop(r.event))
+        {
+            any = true; // the last one is the current state of the sensor
+        }
+        if (any)
+        {
+            readings.push_back(r);
+        }
+        else if (shown[i])
+        {
+            silenced.push_back(static_cast<int>(i));
+        }
+        shown[i] = any;
+    }
+    return readings;
+}
+
+unsigned long ProximitySensors::drops() const
+{
+    unsigned long n = 0;
+    for (const auto& p : ports)
+    {
+        n += p->records().drops();
+    }
+    return n;
+}
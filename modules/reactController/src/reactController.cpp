@@ -105,10 +105,30 @@ private:
     bool hittingConstraints; //inequality constraints for safety of shoudler assembly and to prevent self-collisions torso-upper arm, upper-arm - forearm  
     bool orientationControl; //if orientation should be controlled as well
     double selfColPoints; // minimum distance between robot body parts (-1 to turn off self-collision avoidance)
+    std::string envMapFile; // description of the static environment (boxes, planes, meshes), empty if not used
+    double envMapResolution; // grid step of the precomputed signed distance field
+    int constraintWorkers; // extra threads computing the obstacle constraint rows (0 to compute them serially)
+    int maxCollisionPoints; // maximum number of perceived obstacle constraints per arm (at most 40)
+    double clusterRadius; // collision points of the same skin part closer than this are merged
+    double obstacleLatency; // collision points are extrapolated by their estimated velocity over this time
+    double ttcHorizon; // obstacles whose time-to-collision is below this tighten the constraints (0 to disable)
+    bool pointCloudCollisionPointsOn; // if on, will be computing collision points from point clouds on /reactController/pointcloud:i
+    double pointCloudVoxel; // voxel size used to downsample the point clouds
+    yarp::sig::Matrix pointCloudExtrinsics; // transform from the point cloud FoR to the robot root FoR
     
     bool tactileCollisionPointsOn; //if on, will be reading collision points from /skinEventsAggregator/skin_events_aggreg:o
     bool visualCollisionPointsOn; //if on, will be reading predicted collision points from visuoTactileRF/pps_activations_aggreg:o
     bool proximityCollisionPointsOn; //if on will be reading predicted collision points from proximity sensor
+    std::vector<std::string> proximitySensors; // names of the proximity sensors, each read from /reactController/<name>:i
+    std::vector<std::pair<std::string, std::string>> rawSkinParts; // skin parts read as raw taxels and their calibration files
+    double rawSkinThreshold; // pressure above which a raw taxel is active
+    std::vector<double> modalityRates; // processing rate [Hz] of every obstacle modality (0 every cycle, -1 on new data only)
+    bool sweptCheck; // if on, a step that would carry a link through an obstacle is shortened
+    double obstacleMemory; // decay time [s] of the world-frame obstacle memory (0 to disable)
+    bool pipeline; // if on, the inputs and the logged data are handled by threads of their own
+    RealtimeProfile::settings_t rtSettings; // CPUs, scheduling and memory of the control thread (all off by default)
+    bool encoderPrediction; // if on, the encoders are extrapolated to the time the command is applied
+    double commandDelay; // [s] from the read of the encoders to the application of the command, besides their age
 
     //setting visualization in iCub simulator; the visualizations in iCubGui constitute an independent pipeline
     // (currently the iCubGui ones are on and cannot be toggled on/off from the outside)
@@ -143,10 +163,28 @@ public:
         hittingConstraints = true;
         orientationControl = true;
         selfColPoints = -1;
+        envMapFile = "";
+        envMapResolution = 0.02;
+        constraintWorkers = 2;
+        maxCollisionPoints = 20;
+        clusterRadius = 0.02;
+        obstacleLatency = 0.05;
+        ttcHorizon = 0.5;
+        pointCloudCollisionPointsOn = false;
+        pointCloudVoxel = 0.02;
+        pointCloudExtrinsics = yarp::math::eye(4);
         
         tactileCollisionPointsOn = true;
         visualCollisionPointsOn = true;
         proximityCollisionPointsOn = true;
+        proximitySensors = {"proximity_events", "proximity_events2"};
+        rawSkinThreshold = 10.0;
+        modalityRates.assign(ModalityScheduler::MODALITIES, 0.0);
+        sweptCheck = true;
+        obstacleMemory = 0.0;
+        pipeline = false;
+        encoderPrediction = false;
+        commandDelay = 0.0;
 
         if(robot == "icubSim"){
             visualizeTargetInSim = true;
@@ -303,6 +341,11 @@ public:
         return rctCtrlThrd->getState();
     }
 
+    yarp::os::Bottle get_timing() override
+    {
+        return rctCtrlThrd->getTiming();
+    }
+
     bool set_verbosity(const int32_t _verbosity) override
     {
         yInfo("[reactController] Setting verbosity to %i",_verbosity);
@@ -509,6 +552,123 @@ public:
         {
             yInfo("[reactController] Could not find proximityCollisionPoints flag (on/off) in the config file; using %d as default",proximityCollisionPointsOn);
         }
+        if (rf.check("proximitySensors"))
+        {
+            if (const Bottle* sensors = rf.find("proximitySensors").asList())
+            {
+                proximitySensors.clear();
+                for (size_t i = 0; i < sensors->size(); i++)
+                {
+                    proximitySensors.push_back(sensors->get(i).asString());
+                }
+            }
+            yInfo("[reactController] proximitySensors set to %lu sensors.",proximitySensors.size());
+        }
+        else
+        {
+            yInfo("[reactController] Could not find proximitySensors list in the config file; using proximity_events and proximity_events2 as default");
+        }
+        if (rf.check("rawSkinParts"))
+        {
+            // ((skin_part calibration_file) ...): the tactile contacts are then computed here from the raw taxels
+            if (const Bottle* parts = rf.find("rawSkinParts").asList())
+            {
+                for (size_t i = 0; i < parts->size(); i++)
+                {
+                    const Bottle* part = parts->get(i).asList();
+                    if (part == nullptr || part->size() < 2)
+                    {
+                        yWarning("[reactController] rawSkinParts entries have to be (skin_part calibration_file)");
+                        continue;
+                    }
+                    const std::string calibFile = rf.findFileByName(part->get(1).asString());
+                    if (calibFile.empty())
+                    {
+                        yWarning("[reactController] Could not find the calibration file %s", part->get(1).asString().c_str());
+                        continue;
+                    }
+                    rawSkinParts.emplace_back(part->get(0).asString(), calibFile);
+                    yInfo("[reactController] skin part %s read as raw taxels, calibration in %s", part->get(0).asString().c_str(), calibFile.c_str());
+                }
+            }
+        }
+        if (rf.check("rawSkinThreshold"))
+        {
+            rawSkinThreshold = rf.find("rawSkinThreshold").asFloat64();
+            yInfo("[reactController] rawSkinThreshold set to %g.",rawSkinThreshold);
+        }
+
+        //****************** processing rates of the modalities ******************
+        const std::vector<std::pair<std::string, int>> rateOptions = {{"tactileRate", ModalityScheduler::TACTILE},
+                                                                      {"visualRate", ModalityScheduler::VISUAL},
+                                                                      {"proximityRate", ModalityScheduler::PROXIMITY},
+                                                                      {"pointCloudRate", ModalityScheduler::POINT_CLOUD},
+                                                                      {"obstacleRate", ModalityScheduler::GEOMETRIC}};
+        for (const auto& opt : rateOptions)
+        {
+            if (rf.check(opt.first))
+            {
+                modalityRates[opt.second] = rf.find(opt.first).asFloat64();
+                yInfo("[reactController] %s set to %g Hz (0 every cycle, negative on new data only).",opt.first.c_str(),modalityRates[opt.second]);
+            }
+        }
+        if (rf.check("sweptCheck"))
+        {
+            sweptCheck = rf.find("sweptCheck").asString()=="on";
+            yInfo("[reactController] sweptCheck flag set to %s.",sweptCheck? "on" : "off");
+        }
+        else yInfo("[reactController] Could not find sweptCheck flag (on/off) in the config file; using %d as default",sweptCheck);
+        if (rf.check("obstacleMemory"))
+        {
+            obstacleMemory = rf.find("obstacleMemory").asFloat64();
+            yInfo("[reactController] obstacleMemory set to %g s (0 to disable).",obstacleMemory);
+        }
+        if (rf.check("pipeline"))
+        {
+            pipeline = rf.find("pipeline").asString()=="on";
+            yInfo("[reactController] pipeline flag set to %s.",pipeline? "on" : "off");
+        }
+        else yInfo("[reactController] Could not find pipeline flag (on/off) in the config file; using %d as default",pipeline);
+        for (const auto& opt : {std::make_pair(std::string("rtCpus"), &rtSettings.cpus),
+                                std::make_pair(std::string("rtWorkerCpus"), &rtSettings.workerCpus)})
+        {
+            if (const Bottle* cpus = rf.check(opt.first) ? rf.find(opt.first).asList() : nullptr)
+            {
+                opt.second->clear();
+                for (size_t i = 0; i < cpus->size(); i++)
+                {
+                    opt.second->push_back(cpus->get(i).asInt32());
+                }
+                yInfo("[reactController] %s set to %lu CPUs.",opt.first.c_str(),opt.second->size());
+            }
+        }
+        if (rf.check("rtPriority"))
+        {
+            rtSettings.priority = rf.find("rtPriority").asInt32();
+            yInfo("[reactController] rtPriority set to %d (0 to keep the default scheduling).",rtSettings.priority);
+        }
+        if (rf.check("rtLockMemory"))
+        {
+            rtSettings.lockMemory = rf.find("rtLockMemory").asString()=="on";
+            yInfo("[reactController] rtLockMemory flag set to %s.",rtSettings.lockMemory? "on" : "off");
+        }
+        else yInfo("[reactController] Could not find rtLockMemory flag (on/off) in the config file; using %d as default",rtSettings.lockMemory);
+        if (rf.check("rtPrefault"))
+        {
+            rtSettings.prefault = rf.find("rtPrefault").asFloat64();
+            yInfo("[reactController] rtPrefault set to %g MB (0 to disable).",rtSettings.prefault);
+        }
+        if (rf.check("encoderPrediction"))
+        {
+            encoderPrediction = rf.find("encoderPrediction").asString()=="on";
+            yInfo("[reactController] encoderPrediction flag set to %s.",encoderPrediction? "on" : "off");
+        }
+        else yInfo("[reactController] Could not find encoderPrediction flag (on/off) in the config file; using %d as default",encoderPrediction);
+        if (rf.check("commandDelay"))
+        {
+            commandDelay = rf.find("commandDelay").asFloat64();
+            yInfo("[reactController] commandDelay set to %g s.",commandDelay);
+        }
         
         //************************** gazeControl ******************************************************8
         if (rf.check("gazeControl"))
@@ -668,6 +828,86 @@ public:
             }
             else yInfo("[reactController] Could not find restPosWeight in the config file; using %g as default",selfColPoints);
 
+            //****************** static environment map ******************
+            if (rf.check("environmentMap"))
+            {
+                envMapFile = rf.findFile(rf.find("environmentMap").asString());
+                if (envMapFile.empty())
+                {
+                    yWarning("[reactController] environmentMap %s not found, static obstacles will be ignored.",
+                             rf.find("environmentMap").asString().c_str());
+                }
+                else yInfo("[reactController] environmentMap set to %s.",envMapFile.c_str());
+            }
+            else yInfo("[reactController] Could not find environmentMap in the config file; static obstacles will be ignored");
+            if (rf.check("environmentResolution"))
+            {
+                envMapResolution = rf.find("environmentResolution").asFloat64();
+                yInfo("[reactController] environmentResolution set to %g m.",envMapResolution);
+            }
+
+            //****************** parallel constraint generation ******************
+            if (rf.check("constraintWorkers"))
+            {
+                constraintWorkers = std::max(0, rf.find("constraintWorkers").asInt32());
+                yInfo("[reactController] constraintWorkers set to %d.",constraintWorkers);
+            }
+            else yInfo("[reactController] Could not find constraintWorkers in the config file; using %d as default",constraintWorkers);
+
+            //****************** collision points budget ******************
+            if (rf.check("maxCollisionPoints"))
+            {
+                maxCollisionPoints = std::max(1, std::min(40, rf.find("maxCollisionPoints").asInt32()));
+                yInfo("[reactController] maxCollisionPoints set to %d.",maxCollisionPoints);
+            }
+            else yInfo("[reactController] Could not find maxCollisionPoints in the config file; using %d as default",maxCollisionPoints);
+            if (rf.check("clusterRadius"))
+            {
+                clusterRadius = rf.find("clusterRadius").asFloat64();
+                yInfo("[reactController] clusterRadius set to %g m.",clusterRadius);
+            }
+            else yInfo("[reactController] Could not find clusterRadius in the config file; using %g as default",clusterRadius);
+
+            //****************** obstacle motion prediction ******************
+            if (rf.check("obstacleLatency"))
+            {
+                obstacleLatency = rf.find("obstacleLatency").asFloat64();
+                yInfo("[reactController] obstacleLatency set to %g s.",obstacleLatency);
+            }
+            else yInfo("[reactController] Could not find obstacleLatency in the config file; using %g as default",obstacleLatency);
+            if (rf.check("ttcHorizon"))
+            {
+                ttcHorizon = rf.find("ttcHorizon").asFloat64();
+                yInfo("[reactController] ttcHorizon set to %g s.",ttcHorizon);
+            }
+            else yInfo("[reactController] Could not find ttcHorizon in the config file; using %g as default",ttcHorizon);
+
+            //****************** point cloud obstacles ******************
+            if (rf.check("pointCloudCollisionPoints"))
+            {
+                pointCloudCollisionPointsOn = rf.find("pointCloudCollisionPoints").asString()=="on";
+                yInfo("[reactController] pointCloudCollisionPoints flag set to %s.",pointCloudCollisionPointsOn? "on" : "off");
+            }
+            else yInfo("[reactController] Could not find pointCloudCollisionPoints flag (on/off) in the config file; using %d as default",pointCloudCollisionPointsOn);
+            if (rf.check("pointCloudVoxel"))
+            {
+                pointCloudVoxel = rf.find("pointCloudVoxel").asFloat64();
+                yInfo("[reactController] pointCloudVoxel set to %g m.",pointCloudVoxel);
+            }
+            if (rf.check("pointCloudExtrinsics"))
+            {
+                const Bottle* ext = rf.find("pointCloudExtrinsics").asList();
+                if (ext && ext->size() == 16)
+                {
+                    for (int i = 0; i < 16; i++)
+                    {
+                        pointCloudExtrinsics(i/4, i%4) = ext->get(i).asFloat64();
+                    }
+                    yInfo("[reactController] pointCloudExtrinsics set to \n%s",pointCloudExtrinsics.toString(3,3).c_str());
+                }
+                else yWarning("[reactController] pointCloudExtrinsics has to be a list of 16 values (row-major 4x4); using identity");
+            }
+
 
             //********************** Visualizations in simulator ***********************
 //            if (robot == "icubSim"){
@@ -757,7 +997,13 @@ public:
                                           gazeControl,stiffInteraction,
                                           hittingConstraints, orientationControl,
                                           visualizeTargetInSim, visualizeParticleInSim,
-                                          visualizeCollisionPointsInSim, prtclThrd, restPosWeight, selfColPoints);
+                                          visualizeCollisionPointsInSim, prtclThrd, restPosWeight, selfColPoints,
+                                          envMapFile, envMapResolution, constraintWorkers,
+                                          maxCollisionPoints, clusterRadius, obstacleLatency, ttcHorizon,
+                                          pointCloudCollisionPointsOn, pointCloudVoxel, pointCloudExtrinsics,
+                                          proximitySensors, rawSkinParts, rawSkinThreshold, modalityRates,
+                                          sweptCheck, obstacleMemory, pipeline, rtSettings,
+                                          encoderPrediction, commandDelay);
         if (!rctCtrlThrd->start())
         {
             delete rctCtrlThrd;
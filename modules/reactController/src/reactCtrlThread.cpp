@@ -17,11 +17,25 @@
 * Public License for more details.
  */
 
+#include <limits>
+#include <algorithm>
 #include "reactCtrlThread.h"
 
 #define TACTILE_INPUT_GAIN 0.6
 #define VISUAL_INPUT_GAIN 0.6 // changed from 0.8 in sim to 0.6 for realsense obstacles
 #define PROXIMITY_INPUT_GAIN 0.8
+#define LINK_RADIUS 0.04 // [m] radius of the arm links, modelled as capsules around the segments between the joints
+#define SELF_FILTER_MARGIN 0.03 // [m] depth points this far out of the link capsules still belong to the robot
+#define MATCH_GATE 0.03 // [m] a measurement updates the nearest stored point of the same skin part and type within this distance
+#define SWEPT_MAX_SAMPLES 8 // configurations checked along one control step
+#define MEMORY_RESOLUTION 0.02 // [m] cell size of the obstacle memory
+#define KINEMATICS_CHECK_SAMPLES 20 // configurations at which the kinematics engine is compared with iKin
+#define KINEMATICS_CHECK_TOL 1e-9 // [m] or [-], largest difference allowed in frames and Jacobians
+#define PERCEPTION_BUDGET 1.0 // [periods] time the perception stage has to read the inputs of the next cycle
+#define TELEMETRY_BUDGET 1.0 // [periods] time the telemetry stage has to write the data of a cycle
+#define TIMING_SEND_PERIOD 1.0 // [s] period of the timing summaries on /reactController/timing:o
+#define CTRL_MODE_PERIOD 0.2 // [s] period at which the control modes are read by the monitor
+#define PREDICTION_MAX_HORIZON 0.05 // [s] longest extrapolation of the encoders, in case of stale or wrong timestamps
 
 enum {
     STATE_WAIT,
@@ -32,6 +46,7 @@ enum {
 
 ArmInterface::ArmInterface(std::string _part, double _selfColPoints, const std::string& refGen, double _dT, bool _main):
         I(nullptr), part_name(std::move(_part)), useSelfColPoints(_selfColPoints), referenceGen(refGen), dT(_dT),
+        collisionPoints(_dT, MATCH_GATE),
         mainPart(_main), iencsA(nullptr), iposDirA(nullptr), imodA(nullptr), iintmodeA(nullptr), iimpA(nullptr),
         ilimA(nullptr), encsA(nullptr), arm(nullptr), jntsA(0), chainActiveDOF(0), virtualArm(nullptr), avhdl(nullptr),
         fingerPos({80.,6.,57.,13.,0.,13.,0.,103.}), homePos({0., 0., 0., -34., 30., 0., 50., 0.,  0., 0.}),
@@ -55,6 +70,7 @@ ArmInterface::ArmInterface(std::string _part, double _selfColPoints, const std::
     }
     //we set up the variables based on the current DOF - that is without torso joints if torso is blocked
     chainActiveDOF = arm->getDOF();
+    kin.setChain(arm);
 
     //N.B. All angles in this thread are in degrees
     qA.resize(NR_ARM_JOINTS,0.0); //current values of arm joints (should be 7)
@@ -77,10 +93,10 @@ ArmInterface::ArmInterface(std::string _part, double _selfColPoints, const std::
     // x_home = pose.subVector(0,2);
     // o_home = pose.subVector(3,5)*pose(6);
     x_home = (part_short == "left")? Vector{-0.304, -0.202, 0.023}:Vector{-0.304, 0.202, 0.023};
-    o_home = (part_short == "left")? Vector{-0.025, 0.603, -0.798, 2.838}:Vector{-0.152, -0.789, 0.596, 3.094};
+    o_home = axisAngleToQuaternion((part_short == "left")? Vector{-0.025, 0.603, -0.798, 2.838}:Vector{-0.152, -0.789, 0.596, 3.094});
 
     //palm facing inwards
-    o_0.resize(4,0.0); o_0(1)=-0.707; o_0(2)=+0.707; o_0(3) = M_PI;
+    o_0 = axisAngleToQuaternion(Vector{0.0, -0.707, +0.707, M_PI});
     //palm facing down
 //    o_0 = (part_short == "right")? Vector{0.0, 1.0, 0.0, -0.95*M_PI} : Vector{0.0, 0.0, 1.0, M_PI};
     o_t = o_0;
@@ -108,16 +124,7 @@ void ArmInterface::setVMax(bool useTorso, double vMax)
 
 void ArmInterface::updateCollPoints()
 {
-    for (auto& colP : collisionPoints)
-    {
-        colP.duration -= dT;
-//        if (colP.duration < 0.9)
-            colP.magnitude *= 0.9; // vision 0.6; tactile 0.9
-        if (colP.magnitude < 1e-3) colP.duration = -1;
-    }
-    collisionPoints.erase(std::remove_if(collisionPoints.begin(), collisionPoints.end(),
-                                         [](const collisionPoint_t & colP) { return colP.duration <= 0; }),
-                          collisionPoints.end());
+    collisionPoints.tick();
 }
 
 bool ArmInterface::prepareDrivers(const std::string& robot, const std::string& name, bool stiffInteraction)
@@ -144,6 +151,7 @@ bool ArmInterface::prepareDrivers(const std::string& robot, const std::string& n
     iencsA->getAxes(&jntsA);
     printf("Joints A is %d\n", jntsA);
     encsA = new yarp::sig::Vector(jntsA,0.0);
+    encStampsA.assign(jntsA,0.0);
 
     if (!okA)
     {
@@ -212,13 +220,40 @@ void ArmInterface::release()
     delete filter; filter = nullptr;
 }
 
-void ArmInterface::updateArm(const Vector& qT)
+namespace
+{
+    // time of the oldest joint of a timed read, 0 if no joint was stamped
+    double oldestStamp(const double* stamps, const int n)
+    {
+        double oldest = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            if (stamps[i] > 0.0 && (oldest == 0.0 || stamps[i] < oldest)) oldest = stamps[i];
+        }
+        return oldest;
+    }
+}
+
+double ArmInterface::readEncoders()
+{
+    if (!iencsA->getEncodersTimed(encsA->data(), encStampsA.data())) return 0.0;
+    return oldestStamp(encStampsA.data(), NR_ARM_JOINTS);
+}
+
+void ArmInterface::updateArm(const Vector& qT, const double horizon)
 {
-    iencsA->getEncoders(encsA->data());
     qA = encsA->subVector(0,NR_ARM_JOINTS-1);
     q_last = q;
     q.setSubvector(0,qT);
     q.setSubvector(NR_TORSO_JOINTS,qA);
+    if (horizon > 0.0)
+    {
+        // where the arm joints should be when the command is applied, as they follow the last one sent
+        for (size_t i = NR_TORSO_JOINTS; i < chainActiveDOF; i++)
+        {
+            q[i] = std::min(std::max(q[i] + q_dot[i]*horizon, lim(i,0)), lim(i,1));
+        }
+    }
     //yDebug() << norm(q-q_last)  << "\n";
     if (norm(q-q_last) < 0.002)
     {
@@ -228,9 +263,9 @@ void ArmInterface::updateArm(const Vector& qT)
     {
         notMovingCounter = 0;
     }
-    arm->setAng(q*CTRL_DEG2RAD);
-    x_t = arm->EndEffPosition();
-    o_t = arm->EndEffPose().subVector(3,6);
+    kin.update(q*CTRL_DEG2RAD);
+    x_t = kin.position();
+    o_t = kin.orientation();
 }
 
 bool ArmInterface::alignJointsBound(IControlLimits* ilimT)
@@ -252,6 +287,7 @@ bool ArmInterface::alignJointsBound(IControlLimits* ilimT)
     {
         virtualArm = new iCubArm(*arm);  //Creates a new Limb from an already existing Limb object - but they will be too independent limbs from now on
     }
+    virtualKin.setChain(virtualArm);
     return true;
 }
 
@@ -266,7 +302,7 @@ void ArmInterface::printJointsBounds() const
     }
 }
 
-void ArmInterface::initialization(iKinChain* chain, iKinChain* torso,  int verbosity)
+void ArmInterface::initialization(iKinChain* chain, iKinChain* torso, const EnvironmentMap* envMap, int verbosity)
 {
     //set grasping pose for fingers
 //    for (size_t j=0; j<fingerPos.size(); j++)
@@ -291,8 +327,10 @@ void ArmInterface::initialization(iKinChain* chain, iKinChain* torso,  int verbo
 
     filter = new LPFilterSO3(o_home, dT, 1.);
     I = new Integrator(dT,q,lim);
-    avhdl = std::make_unique<AvoidanceHandler>(*virtualArm->asChain(), collisionPoints, chain,
-                                                      useSelfColPoints, part_short, encsA, torso, verbosity);
+    avhdl = std::make_unique<AvoidanceHandler>(*virtualArm->asChain(), collisionPoints.points(), chain,
+                                                      useSelfColPoints, part_short, encsA, torso, envMap, verbosity);
+    avhdl->setObstaclePoints(&obstaclePoints);
+    avhdl->setKinematicState(&virtualKin);
 }
 
 bool ArmInterface::checkRecoveryPath(Vector& next_x)
@@ -359,10 +397,10 @@ void ArmInterface::updateNextTarget(bool& vel_limited)
     vel_limited = vel_limited | res;
 }
 
-void ArmInterface::resetTarget(const yarp::sig::Vector& _x_d, const yarp::sig::Vector& _o_d, double trajSpeed)
+void ArmInterface::resetTarget(const yarp::sig::Vector& _x_d, const Eigen::Quaterniond& _o_d, double trajSpeed)
 {
     q_dot.zero();
-    virtualArm->setAng(q*CTRL_DEG2RAD); //with new target, we make the two chains identical at the start
+    virtualKin.update(q*CTRL_DEG2RAD); //with new target, we make the two chains identical at the start
     I->reset(q);
     o_0=o_t;
     o_d = _o_d;
@@ -383,6 +421,10 @@ void ArmInterface::resetTarget(const yarp::sig::Vector& _x_d, const yarp::sig::V
 
 /*********** public methods ****************************************************************************/
 
+const char* const reactCtrlThread::timingNames[TIMING_STAGES] = {"updateArmChain", "ports", "vlim", "solveIK",
+                                                                 "controlArm", "sendData", "sendObsData",
+                                                                 "writeTelemetry", "cycle", "period"};
+
 reactCtrlThread::reactCtrlThread(int _rate, std::string _name, std::string _robot,  const std::string& _part,
                                  const std::string& second_part, int _verbosity, bool _disableTorso,
                                  double _trajSpeed, double _globalTol, double _vMax, double _tol, double _timeLimit,
@@ -390,18 +432,54 @@ reactCtrlThread::reactCtrlThread(int _rate, std::string _name, std::string _robo
                                  bool _gazeControl, bool _stiffInteraction,
                                  bool _hittingConstraints, bool _orientationControl,
                                  bool _visTargetInSim, bool _visParticleInSim, bool _visCollisionPointsInSim,
-                                 particleThread *_pT, double _restPosWeight, double _selfColPoints) :
+                                 particleThread *_pT, double _restPosWeight, double _selfColPoints,
+                                 std::string _envMapFile, double _envMapResolution, int _constraintWorkers,
+                                 int _maxCollisionPoints, double _clusterRadius, double _obstacleLatency, double _ttcHorizon,
+                                 bool _pointCloudCPOn, double _pcVoxel, const yarp::sig::Matrix& _pcExtrinsics,
+                                 const std::vector<std::string>& _proximitySensors,
+                                 const std::vector<std::pair<std::string, std::string>>& _rawSkinParts, double _rawSkinThreshold,
+                                 const std::vector<double>& _modalityRates, bool _sweptCheck,
+                                 double _obstacleMemory, bool _pipeline,
+                                 const RealtimeProfile::settings_t& _rtSettings, bool _encoderPrediction,
+                                 double _commandDelay) :
         PeriodicThread(static_cast<double>(_rate)/1000.0), name(std::move(_name)), robot(std::move(_robot)),
         verbosity(_verbosity), useTorso(!_disableTorso), trajSpeed(_trajSpeed), globalTol(_globalTol), vMax(_vMax),
         tol(_tol), timeLimit(_timeLimit), referenceGen(std::move(_referenceGen)), tactileCollPointsOn(_tactileCPOn),
         visualCollPointsOn(_visualCPOn), proximityCollPointsOn(_proximityCPOn), gazeControl(_gazeControl),
         stiffInteraction(_stiffInteraction), hittingConstraints(_hittingConstraints), main_arm_constr(true),
         orientationControl(_orientationControl), visualizeCollisionPointsInSim(_visCollisionPointsInSim), counter(0),
+        envMapFile(std::move(_envMapFile)), envMapResolution(_envMapResolution), constraintWorkers(_constraintWorkers), cycleStamp(0),
+        maxCollisionPoints(_maxCollisionPoints), clusterRadius(_clusterRadius), obstacleLatency(_obstacleLatency),
+        ttcHorizon(_ttcHorizon), pointCloudCollPointsOn(_pointCloudCPOn), sweptCheck(_sweptCheck), pipeline(_pipeline),
         restPosWeight(_restPosWeight), state(STATE_WAIT), iencsT(nullptr), iposDirT(nullptr), imodT(nullptr),
         ilimT(nullptr), encsT(nullptr), jntsT(0), igaze(nullptr), contextGaze(0), movingTargetCircle(false), radius(0),
-        frequency(0), streamingTarget(false), t_0(0), solverExitCode(0), timeToSolveProblem_s(0), comingHome(false),
+        frequency(0), streamingTarget(false), streamedTargets(&reactCtrlThread::parseStreamedTarget), t_0(0), solverExitCode(0), timeToSolveProblem_s(0), comingHome(false),
         holding_position(false), visuhdl(verbosity, false, name, _visTargetInSim,
-                                         referenceGen != "none" && _visParticleInSim)
+                                         referenceGen != "none" && _visParticleInSim),
+        obstacles(DURATION, _verbosity), people(DURATION, _verbosity), proximitySensors(_proximitySensors), rawSkinParts(_rawSkinParts),
+        taxels(_rawSkinThreshold, _verbosity), scheduler(_modalityRates),
+        aggregSkinEventsInPort([seq = 0u](const Bottle& b, SpscRing<portEvent_t, EVENT_RING>& ring) mutable
+                               { parseEvents(b, TACTILE_OBS, seq++, ring); }),
+        aggregPPSeventsInPort([seq = 0u](const Bottle& b, SpscRing<portEvent_t, EVENT_RING>& ring) mutable
+                              { parseEvents(b, VISUAL_OBS, seq++, ring); }),
+        sensManagerPort(&reactCtrlThread::parseSensManager),
+        NeoObsInPort([this](const Bottle& b, SpscRing<ObstaclePrimitives::frame_t, FRAME_RING>& ring)
+                     {
+                         ObstaclePrimitives::frame_t f;
+                         parsedObstacles.parse(b, yarp::os::Time::now());
+                         parsedObstacles.toFrame(f);
+                         ring.push(f);
+                     }),
+        skeletonInPort([this](const Bottle& b, SpscRing<ObstaclePrimitives::frame_t, FRAME_RING>& ring)
+                       {
+                           ObstaclePrimitives::frame_t f;
+                           parsedPeople.parseSkeletons(b, yarp::os::Time::now());
+                           parsedPeople.toFrame(f);
+                           ring.push(f);
+                       }),
+        sensManagerNew(false), primitivesNew(false), parsedObstacles(DURATION, _verbosity), parsedPeople(DURATION, _verbosity),
+        rtProfile(_rtSettings, _verbosity), positionModesSet(false), cycleOverruns(0), lastTimingSent(0.0), encoderStamp(0.0),
+        encoderPrediction(_encoderPrediction), commandDelay(_commandDelay)
 {
     dT=getPeriod();
     obsWorldPos.resize(109);
@@ -414,12 +492,22 @@ reactCtrlThread::reactCtrlThread(int _rate, std::string _name, std::string _robo
     /******** iKin chain and variables, and transforms init *************************/
     main_arm =std::make_unique<ArmInterface>(_part, _selfColPoints, referenceGen, dT);
     second_arm = (second_part=="left_arm" || second_part=="right_arm")? std::make_unique<ArmInterface>(second_part, _selfColPoints, referenceGen, dT, false) : nullptr;
+    if (pointCloudCollPointsOn)
+    {
+        pcHandler = std::make_unique<PointCloudHandler>(_pcVoxel, _pcExtrinsics, 0.2, 1,
+                                                        LINK_RADIUS + SELF_FILTER_MARGIN + 0.87*_pcVoxel, verbosity);
+    }
+    if (_obstacleMemory > 0.0)
+    {
+        obstacleMemory = std::make_unique<ObstacleMemory>(MEMORY_RESOLUTION, _obstacleMemory, 2.0, verbosity);
+    }
 }
 
 bool reactCtrlThread::threadInit()
 {
     torso = new iCubTorso();
     printMessage(2,"[reactCtrlThread] threadInit()\n");
+    rtProfile.setupMemory(); // before the allocations of the thread, so that they are locked too
 
     //N.B. All angles in this thread are in degrees
     qT.resize(NR_TORSO_JOINTS,0.0); //current values of torso joints (3, in the order expected for iKin: yaw, roll, pitch)
@@ -433,26 +521,125 @@ bool reactCtrlThread::threadInit()
     updateArmChain();
     printf("%s\n", main_arm->arm->EndEffPose().toString(3).c_str());
     if (second_arm) printf("%s\n", second_arm->arm->EndEffPose().toString(3).c_str());
-    main_arm->initialization(second_arm? second_arm->virtualArm->asChain() : nullptr, torso->asChain(), verbosity);
-    if (second_arm) second_arm->initialization(main_arm->virtualArm->asChain(), torso->asChain(), verbosity);
+    if (!envMapFile.empty())
+    {
+        envMap = std::make_unique<EnvironmentMap>(verbosity);
+        if (!envMap->load(envMapFile, "", envMapResolution))
+        {
+            yWarning("[reactCtrlThread] could not load environment map %s, static obstacles will be ignored", envMapFile.c_str());
+            envMap.reset();
+        }
+    }
+    workers = std::make_unique<WorkerPool>(constraintWorkers);
+    for (const auto h : workers->nativeHandles())
+    {
+        rtProfile.setupWorker(h, true); // the cycle waits for them
+    }
+    main_arm->initialization(second_arm? second_arm->virtualArm->asChain() : nullptr, torso->asChain(), envMap.get(), verbosity);
+    if (second_arm) second_arm->initialization(main_arm->virtualArm->asChain(), torso->asChain(), envMap.get(), verbosity);
+    for (ArmInterface* a : {main_arm.get(), second_arm.get()})
+    {
+        if (!a) continue;
+        for (KinematicState* k : {&a->kin, &a->virtualKin})
+        {
+            double worst = 0.0;
+            if (k->crossCheck(KINEMATICS_CHECK_SAMPLES, KINEMATICS_CHECK_TOL, worst))
+            {
+                printMessage(1,"[reactCtrlThread] kinematics engine of %s matches iKin (largest difference %g)\n",
+                             a->part_name.c_str(), worst);
+            }
+            else
+            {
+                yWarning("[reactCtrlThread] kinematics engine of %s differs from iKin by %g, using iKin",
+                         a->part_name.c_str(), worst);
+            }
+        }
+    }
+    main_arm->avhdl->setPointBudget(maxCollisionPoints, clusterRadius);
+    if (second_arm) second_arm->avhdl->setPointBudget(maxCollisionPoints, clusterRadius);
+    main_arm->avhdl->setPrediction(obstacleLatency, ttcHorizon);
+    if (second_arm) second_arm->avhdl->setPrediction(obstacleLatency, ttcHorizon);
     NeoObsInPort.open("/"+name+"/neo_obstacles:i");
-    solver = std::make_unique<QPSolver>(main_arm->virtualArm, hittingConstraints,
-                                        second_arm? second_arm->virtualArm : nullptr,
+    skeletonInPort.open("/"+name+"/skeletons:i");
+    solver = std::make_unique<QPSolver>(&main_arm->virtualKin, hittingConstraints,
+                                        second_arm? &second_arm->virtualKin : nullptr,
                                         vMax, orientationControl,dT,
                                         main_arm->homePos*CTRL_DEG2RAD, restPosWeight, main_arm->part_short);
     aggregPPSeventsInPort.open("/"+name+"/pps_events_aggreg:i");
     aggregSkinEventsInPort.open("/"+name+"/skin_events_aggreg:i");
-    proximityEventsInPort.open("/"+name+"/proximity_events:i");
-    proximityEvents2InPort.open("/"+name+"/proximity_events2:i");
+    proximitySensors.open("/"+name);
+    for (const auto& part : rawSkinParts)
+    {
+        SkinPart sp = SKIN_PART_UNKNOWN;
+        for (int k = 0; k < SKIN_PART_SIZE; k++)
+        {
+            if (SkinPart_s[k] == part.first) sp = static_cast<SkinPart>(k);
+        }
+        if (sp == SKIN_PART_UNKNOWN || !taxels.addPart(sp, part.second))
+        {
+            yWarning("[reactCtrlThread] raw taxels of skin part %s will be ignored", part.first.c_str());
+        }
+    }
+    if (!taxels.empty())
+    {
+        taxels.open("/"+name);
+    }
 //    streamedTargets.open("/"+name+"/streamedWholeBodyTargets:i");
     streamedTargets.open("/"+name+"/streamedTargets:i");
 
     outPort.open("/"+name +"/data:o"); //for dumping
     outObsPort.open("/"+name +"/obsdata:o"); //for dumping
     sensManagerPort.open("/"+name +"/sensManager:i"); //for dumping
+    if (pointCloudCollPointsOn) pointCloudInPort.open("/"+name+"/pointcloud:i");
     movementFinishedPort.open("/" + name + "/finished:o");
     proximityEventsVisuPort.open("/"+name+"/proximity:o");
     proximityEventsForiCubGuiPort.open("/"+name+"/prox_gui:o");
+    timingPort.open("/"+name+"/timing:o");
+
+    ctrlModeMonitor = std::make_unique<CtrlModeMonitor>(CTRL_MODE_PERIOD, verbosity);
+    ctrlModeParts[0] = ctrlModeMonitor->addPart("arm", main_arm->imodA, NR_ARM_JOINTS);
+    ctrlModeParts[1] = ctrlModeMonitor->addPart("torso", imodT, NR_TORSO_JOINTS);
+    ctrlModeParts[2] = second_arm? ctrlModeMonitor->addPart("second_arm", second_arm->imodA, NR_ARM_JOINTS) : -1;
+    ctrlModeMonitor->start();
+    ctrlModeMonitor->take(ctrlModes);
+    rtProfile.setupWorker(ctrlModeMonitor->nativeHandle(), false);
+
+    if (pipeline)
+    {
+        // the quantization of the point cloud can not share the pool with the control thread
+        perceptionWorkers = std::make_unique<WorkerPool>(0);
+        perceptionStage = std::make_unique<PipelineStage>("perception", PERCEPTION_BUDGET*dT, verbosity);
+        perceptionStage->start([this]()
+        {
+            readPerception(perceptionBuffer.back(), *perceptionWorkers);
+            perceptionBuffer.publish();
+        });
+        telemetryStage = std::make_unique<PipelineStage>("telemetry", TELEMETRY_BUDGET*dT, verbosity);
+        telemetryStage->start([this]()
+        {
+            if (telemetryBuffer.take(telemetry))
+            {
+                writeTelemetry(telemetry);
+                telemetry.gui.clear();
+            }
+        });
+        perceptionStage->trigger();
+        for (PipelineStage* s : {perceptionStage.get(), telemetryStage.get()})
+        {
+            rtProfile.setupWorker(s->nativeHandle(), false);
+        }
+    }
+
+    rtProfile.setupControlThread();
+    if (rtProfile.enabled())
+    {
+        std::string report;
+        for (const auto& s : rtProfile.achieved())
+        {
+            report += (report.empty() ? "" : ", ") + s;
+        }
+        yInfo("[reactCtrlThread] real-time profile: %s", report.empty() ? "nothing could be applied" : report.c_str());
+    }
 
     writeConfigData();
     printMessage(5,"[reactCtrlThread] threadInit() finished.\n");
@@ -517,6 +704,7 @@ bool reactCtrlThread::prepareDrivers()
     }
     iencsT->getAxes(&jntsT);
     encsT = new yarp::sig::Vector(jntsT,0.0);
+    encStampsT.assign(jntsT,0.0);
 
     if (!okT)
     {
@@ -608,142 +796,284 @@ void reactCtrlThread::insertTestingCollisions()
         }
         if (active)
         {
-            bool exists = false;
-            for (auto& colPoint : main_arm->collisionPoints)
-            {
-                if (colPoint.x == collisionPointStruct.x)
-                {
-                    colPoint.reset();
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists) main_arm->collisionPoints.push_back(collisionPointStruct);
+            const Matrix R = main_arm->kin.H(NR_TORSO_JOINTS+SkinPart_2_LinkNum[SKIN_LEFT_FOREARM].linkNum).submatrix(0,2,0,2);
+            main_arm->collisionPoints.merge(collisionPointStruct, yarp::os::Time::now(), R);
         }
     }
 }
 
 bool reactCtrlThread::preprocCollisions()
 {
+    const TimingHistogram::Clock::time_point t0 = TimingHistogram::Clock::now();
     main_arm->updateCollPoints();
     if (second_arm) second_arm->updateCollPoints();
 //    insertTestingCollisions();
+    const TimingHistogram::Clock::time_point t1 = TimingHistogram::Clock::now();
     getCollisionsFromPorts();
-    bool vel_limited = !main_arm->collisionPoints.empty();
-    main_arm->avhdl->getVLIM(main_arm->Aobst, main_arm->bvalues, main_arm_constr);
-    main_arm->updateRecoveryPath();
+    const TimingHistogram::Clock::time_point t2 = TimingHistogram::Clock::now();
+    timings[TIMING_PORTS].record(t2 - t1);
+    bool vel_limited = !main_arm->collisionPoints.empty() || !main_arm->obstaclePoints.empty();
+    const int rows1 = main_arm->avhdl->prepareVLIM(main_arm->Aobst, main_arm->bvalues, main_arm_constr);
+    int rows2 = 0;
     if (second_arm)
     {
-        vel_limited |= !second_arm->collisionPoints.empty();
-        second_arm->avhdl->getVLIM(second_arm->Aobst, second_arm->bvalues, !main_arm_constr);
-        second_arm->updateRecoveryPath();
+        vel_limited |= !second_arm->collisionPoints.empty() || !second_arm->obstaclePoints.empty();
+        rows2 = second_arm->avhdl->prepareVLIM(second_arm->Aobst, second_arm->bvalues, !main_arm_constr);
     }
+    // the rows of both arms are independent of each other
+    workers->parallelFor(rows1 + rows2, [&](int i)
+    {
+        if (i < rows1) main_arm->avhdl->computeVLIMRow(i, main_arm->Aobst, main_arm->bvalues);
+        else second_arm->avhdl->computeVLIMRow(i - rows1, second_arm->Aobst, second_arm->bvalues);
+    });
+    main_arm->updateRecoveryPath();
+    if (second_arm) second_arm->updateRecoveryPath();
+    timings[TIMING_VLIM].record((t1 - t0) + (TimingHistogram::Clock::now() - t2));
     return vel_limited;
 }
 
 void reactCtrlThread::getCollisionsFromPorts()
 {
-    if (tactileCollPointsOn)
+    cycleStamp = yarp::os::Time::now();
+    receivePerception();
+    // the rings are emptied in every cycle, whether or not their modality is due, and only the last data are kept
+    drainEvents(aggregSkinEventsInPort.records(), pendingSkinEvents);
+    if (!taxels.empty())
+    {
+        // the parts read as raw taxels would add their contacts twice
+        pendingSkinEvents.erase(std::remove_if(pendingSkinEvents.begin(), pendingSkinEvents.end(),
+                                               [this](const portEvent_t& e) { return taxels.handles(e.skin_part); }),
+                                pendingSkinEvents.end());
+    }
+    drainEvents(aggregPPSeventsInPort.records(), pendingPPSEvents);
+    while (sensManagerPort.records().pop(sensManagerFrame))
+    {
+        sensManagerNew = true;
+    }
+    // the raw taxels and the proximity sensors are read without waiting, so they are event-triggered anyway
+    const bool tactileDue = tactileCollPointsOn && scheduler.due(ModalityScheduler::TACTILE, cycleStamp,
+                                                                 !taxels.empty() || !pendingSkinEvents.empty());
+    if (tactileDue && !taxels.empty())
+    {
+        printMessage(9,"[reactCtrlThread::run()] Getting tactile collisions from raw taxels.\n");
+        for (const auto& c : taxels.process())
+        {
+            addCollPoint(c.skin_part, c.x, c.n, c.activation, TACTILE_INPUT_GAIN, TACTILE_OBS);
+        }
+    }
+    if (tactileDue)
     {
         printMessage(9,"[reactCtrlThread::run()] Getting tactile collisions from port.\n");
-        getCollisionPointsFromPort(aggregSkinEventsInPort, TACTILE_INPUT_GAIN, TACTILE_OBS);
+        addCollPoints(pendingSkinEvents, TACTILE_INPUT_GAIN, TACTILE_OBS);
+        pendingSkinEvents.clear();
     }
-    if (visualCollPointsOn) //note, these are not mutually exclusive - they can co-exist
+    if (visualCollPointsOn && scheduler.due(ModalityScheduler::VISUAL, cycleStamp,
+                                            !pendingPPSEvents.empty() || sensManagerNew)) //note, these are not mutually exclusive - they can co-exist
     {
-        // process the SensationManager port
-        if (auto* sensManagerBottle = sensManagerPort.read(false))
+        // the SensationManager port, only its last frame matters
+        if (sensManagerNew)
         {
-            int idx_v = 0;
-            for (int i = 0; i < sensManagerBottle->size(); i++)
+            for (int i = 0; i < sensManagerFrame.n; i++)
             {
-                const Bottle bl = *(sensManagerBottle->get(i).asList());
-                for(int j=0;j<bl.size();j++){
-                    const Bottle b = *(bl.get(j).asList());
-                    if (b.size()>=5 && idx_v < 100) {
-                        obsWorldPos[9+idx_v] = Vector{b.get(0).asFloat64(), b.get(1).asFloat64(), b.get(2).asFloat64()};
-                        idx_v++;
-
-                    }
-                }
+                obsWorldPos[9+i] = Vector{sensManagerFrame.pos[i][0], sensManagerFrame.pos[i][1], sensManagerFrame.pos[i][2]};
             }
+            sensManagerNew = false;
         }
 
         printMessage(9,"[reactCtrlThread::run()] Getting visual collisions from port.\n");
-        getCollisionPointsFromPort(aggregPPSeventsInPort, VISUAL_INPUT_GAIN, VISUAL_OBS);
-    }
-    if (proximityCollPointsOn)
-    {
-        printMessage(9,"[reactCtrlThread::run()] Getting proximity collisions from port.\n");
-        ts.update();
-        skinContactList& sCLout = proximityEventsForiCubGuiPort.prepare();
-        sCLout.clear();
-
-        for (int k = 0; k < 2; k++)
-        {
-            Bottle* bot = k == 0? proximityEventsInPort.read(false) : proximityEvents2InPort.read(false);
-            visuhdl.deleteiCubGuiObject("prox_obs"+std::to_string(k));
-            if (bot) {
-                getCollPointFromPort(bot, PROXIMITY_INPUT_GAIN, PROX_OBS);
-                yarp::os::Bottle& b = proximityEventsVisuPort.prepare();
-                b.clear();
-                b.addFloat64(bot->get(13).asFloat64());
-                proximityEventsVisuPort.write();
-
-                Vector geocenter(3, 0.0); // geocenter from skin / average activation locus from the pps
-                Vector normal(3, 0.0);
-                const Vector force(3, 0.0);
-                Vector moment(3, 0.0); // will remain zero
-
-                // printf("Bottle %d contains %s \n", i,collPointBottle->toString().c_str());
-                const SkinPart sp = static_cast<SkinPart>(bot->get(0).asInt32());
-                geocenter(0) = bot->get(1).asFloat64();
-                geocenter(1) = bot->get(2).asFloat64();
-                geocenter(2) = bot->get(3).asFloat64();
-                normal(0) = bot->get(4).asFloat64();
-                normal(1) = bot->get(5).asFloat64();
-                normal(2) = bot->get(6).asFloat64();
-                const double normalized_activation = 20 * bot->get(13).asFloat64();
-                moment(0) = -normalized_activation * normal(0);
-                moment(1) = -normalized_activation * normal(1);
-                moment(2) = -normalized_activation * normal(2);
-
-                skinContact const sc(SkinPart_2_BodyPart[sp].body, sp, getLinkNum(sp), geocenter, geocenter, {}, normalized_activation, normal, force, moment);
-
-                Matrix T_a;
-                if ((main_arm->part_short == "left" && SkinPart_2_BodyPart[sp].body == RIGHT_ARM) ||
-                    (main_arm->part_short == "right" && SkinPart_2_BodyPart[sp].body == LEFT_ARM))
-                {
-                    if (second_arm == nullptr) return;
-                    T_a = second_arm->arm->getH(3+SkinPart_2_LinkNum[sp].linkNum, true);
-                }
-                else
-                {
-                    T_a = main_arm->arm->getH(3+SkinPart_2_LinkNum[sp].linkNum, true);
-                }
-                const Vector prox_obs = {geocenter(0), geocenter(1), normal(2)*(1.05-bot->get(13).asFloat64())/5 ,1};
-                visuhdl.sendiCubGuiObject("prox_obs"+ std::to_string(k), T_a*prox_obs);
-                sCLout.push_back(sc);
-            }
-            proximityEventsForiCubGuiPort.setEnvelope(ts);
-            proximityEventsForiCubGuiPort.write();
-
-        }
+        addCollPoints(pendingPPSEvents, VISUAL_INPUT_GAIN, VISUAL_OBS);
+        pendingPPSEvents.clear();
+    }
+    // the obstacles are described anew in every frame, so only the last one is used
+    bool obstaclesNew = false, peopleNew = false;
+    while (NeoObsInPort.records().pop(obstacleFrame))
+    {
+        obstaclesNew = true;
+    }
+    if (obstaclesNew) obstacles.assign(obstacleFrame);
+    while (skeletonInPort.records().pop(obstacleFrame))
+    {
+        peopleNew = true;
+    }
+    if (peopleNew) people.assign(obstacleFrame);
+    primitivesNew |= obstaclesNew || peopleNew;
+    const bool primitivesOn = !obstacles.empty(cycleStamp) || !people.empty(cycleStamp);
+    const bool primitivesDue = primitivesOn && scheduler.due(ModalityScheduler::GEOMETRIC, cycleStamp,
+                                                             primitivesNew);
+    const bool cloudDue = pointCloudCollPointsOn && scheduler.due(ModalityScheduler::POINT_CLOUD, cycleStamp,
+                                                                  perception.cloudNew);
+    if (cloudDue || primitivesDue)
+    {
+        updateLinkSegments();
+    }
+    if (cloudDue)
+    {
+        printMessage(9,"[reactCtrlThread::run()] Getting collisions from point cloud.\n");
+        getPointCloudCollisions();
+    }
+    if (primitivesDue)
+    {
+        printMessage(9,"[reactCtrlThread::run()] Getting collisions from obstacle primitives.\n");
+        getPrimitiveCollisions();
+        primitivesNew = false;
+    }
+    else if (!primitivesOn)
+    {
+        // otherwise the witness points of the last update are kept, in the FoR of their links
+        main_arm->obstaclePoints.clear();
+        if (second_arm) second_arm->obstaclePoints.clear();
+    }
+    if (proximityCollPointsOn && scheduler.due(ModalityScheduler::PROXIMITY, cycleStamp, true))
+    {
+        printMessage(9,"[reactCtrlThread::run()] Getting proximity collisions from ports.\n");
+        getProximityCollisions();
+    }
+    if (obstacleMemory)
+    {
+        printMessage(9,"[reactCtrlThread::run()] Getting collisions from the obstacle memory.\n");
+        getMemoryCollisions();
     }
     //after this point, we don't care where did the collision points come from - our relative confidence in the two modalities is expressed in the gains
 
     if (visualizeCollisionPointsInSim)
     {
         printMessage(5,"[reactCtrlThread::run()] will visualize collision points in simulator.\n");
-        visuhdl.showCollisionPointsInSim(*main_arm->arm, main_arm->collisionPoints, second_arm? second_arm->arm:nullptr,
-                                         second_arm? second_arm->collisionPoints : std::vector<collisionPoint_t>{},
+        visuhdl.showCollisionPointsInSim(*main_arm->arm, main_arm->collisionPoints.points(), second_arm? second_arm->arm:nullptr,
+                                         second_arm? second_arm->collisionPoints.points() : std::vector<collisionPoint_t>{},
                                          main_arm->avhdl->getSelfColPointsTorso());
     }
 }
 
 
 
+void reactCtrlThread::readPerception(perception_t& in, WorkerPool& pool)
+{
+    in.cloudNew = false;
+    if (pointCloudCollPointsOn)
+    {
+        if (auto* cloud = pointCloudInPort.read(false))
+        {
+            pcHandler->quantize(*cloud, in.cloudKeys, pool);
+            in.cloudNew = true;
+        }
+    }
+}
+
+void reactCtrlThread::receivePerception()
+{
+    if (perceptionStage)
+    {
+        perceptionStage->wait(); // if it is over budget, its inputs are taken in the next cycle
+    }
+    else
+    {
+        readPerception(perceptionBuffer.back(), *workers);
+        perceptionBuffer.publish();
+    }
+
+    // like on the port, a new cloud replaces the one that was not processed yet
+    if (perceptionBuffer.take(perceptionIn) && perceptionIn.cloudNew)
+    {
+        std::swap(perception.cloudKeys, perceptionIn.cloudKeys);
+        perception.cloudNew = true;
+    }
+
+    if (perceptionStage)
+    {
+        perceptionStage->trigger(); // the inputs of the next cycle are read while this one goes on
+    }
+}
+
+void reactCtrlThread::drainEvents(SpscRing<portEvent_t, EVENT_RING>& ring, std::vector<portEvent_t>& pending)
+{
+    portEvents.clear();
+    portEvent_t e;
+    while (ring.pop(e))
+    {
+        portEvents.push_back(e);
+    }
+    if (portEvents.empty()) return;
+    printMessage(5,"[reactCtrlThread::drainEvents]: %lu events on the port.\n", portEvents.size());
+
+    // a skin part keeps the events of the last bottle it was in, so that a burst does not add its contacts twice
+    std::array<unsigned int, SKIN_PART_SIZE> last{};
+    std::array<bool, SKIN_PART_SIZE> seen{};
+    for (auto it = portEvents.rbegin(); it != portEvents.rend(); ++it)
+    {
+        const int sp = static_cast<int>(it->skin_part);
+        if (sp < 0 || sp >= SKIN_PART_SIZE || seen[sp]) continue;
+        seen[sp] = true;
+        last[sp] = it->bottle;
+    }
+    portEvents.erase(std::remove_if(portEvents.begin(), portEvents.end(), [&](const portEvent_t& ev)
+    {
+        const int sp = static_cast<int>(ev.skin_part);
+        return sp < 0 || sp >= SKIN_PART_SIZE || ev.bottle != last[sp];
+    }), portEvents.end());
+
+    // the new bottle of a skin part replaces the one still pending
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const portEvent_t& ev)
+    {
+        return seen[static_cast<int>(ev.skin_part)];
+    }), pending.end());
+    pending.insert(pending.end(), portEvents.begin(), portEvents.end());
+}
+
+void reactCtrlThread::parseEvents(const Bottle& b, const int type, const unsigned int seq,
+                                  SpscRing<portEvent_t, EVENT_RING>& ring)
+{
+    for (int i = 0; i < b.size(); i++)
+    {
+        if (const Bottle* bot = b.get(i).asList())
+        {
+            ring.push(parsePortEvent(*bot, type, seq));
+        }
+    }
+}
+
+void reactCtrlThread::parseSensManager(const Bottle& b, SpscRing<sensManagerFrame_t, FRAME_RING>& ring)
+{
+    sensManagerFrame_t f;
+    f.n = 0;
+    for (int i = 0; i < b.size(); i++)
+    {
+        const Bottle* bl = b.get(i).asList();
+        if (!bl) continue;
+        for (int j = 0; j < bl->size(); j++)
+        {
+            const Bottle* p = bl->get(j).asList();
+            if (p && p->size() >= 5 && f.n < MAX_SENS_MANAGER)
+            {
+                f.pos[f.n][0] = p->get(0).asFloat64();
+                f.pos[f.n][1] = p->get(1).asFloat64();
+                f.pos[f.n][2] = p->get(2).asFloat64();
+                f.n++;
+            }
+        }
+    }
+    ring.push(f);
+}
+
+void reactCtrlThread::parseStreamedTarget(const Bottle& b, SpscRing<streamedTarget_t, TARGET_RING>& ring)
+{
+    streamedTarget_t t;
+    t.size = b.size();
+    t.orientation = t.size == 7 && b.get(6).isFloat64();
+    for (int i = 0; i < std::min(t.size, 16); i++)
+    {
+        t.values[i] = b.get(i).asFloat64();
+    }
+    ring.push(t);
+}
+
 void reactCtrlThread::run()
 {
+    const TimingHistogram::Clock::time_point runStart = TimingHistogram::Clock::now();
+    if (cycleStart != TimingHistogram::Clock::time_point())
+    {
+        timings[TIMING_PERIOD].record(runStart - cycleStart);
+    }
+    cycleStart = runStart;
     for (int k = 0; k < 109; k++)
     {
         obsWorldPos[k].zero();
@@ -755,11 +1085,6 @@ void reactCtrlThread::run()
         {
            state = STATE_REACH;
         }
-//        std::vector<Vector> x_planned;
-//        if (readMotionPlan(x_planned))
-//        {
-//            setNewTarget(x_planned[0],false);
-//        }
     }
     bool vel_limited = false;
     switch (state)
@@ -780,14 +1105,12 @@ void reactCtrlThread::run()
             printMessage(2, "norm(x_t-x_d) = %g\n", norm(main_arm->x_t-main_arm->x_d));
         }
 
-        auto o_t = axisAngleToMatrix(main_arm->o_t);
-        auto o_d = axisAngleToMatrix(main_arm->o_d);
-        Eigen::AngleAxisd error(o_d * o_t.transpose());
-        const bool inTarget = norm(main_arm->x_t - main_arm->x_d) < globalTol && (error.angle() < 2*globalTol);
+        const double oriError = main_arm->o_t.angularDistance(main_arm->o_d);
+        const bool inTarget = norm(main_arm->x_t - main_arm->x_d) < globalTol && (oriError < 2*globalTol);
         //we keep solving until we reach the desired target
         if (!movingTargetCircle && !holding_position && !streamingTarget)
         {
-//            yDebug("[reactCtrlThread] angle error %g", error.angle());
+//            yDebug("[reactCtrlThread] angle error %g", oriError);
             if (inTarget && (second_arm == nullptr || norm(second_arm->x_t - second_arm->x_d) < globalTol)) {
                 comingHome = false;
                 yDebug("[reactCtrlThread] norm(x_t-x_d) %g\tglobalTol %g", norm(main_arm->x_t - main_arm->x_d), globalTol);
@@ -825,8 +1148,6 @@ void reactCtrlThread::run()
             main_arm->q_dot.zero();
             if (second_arm) second_arm->q_dot.zero();
         }
-        updateArmChain(); //N.B. This is the second call within run(); may give more precise data for the logging; may also cost time
-
         break;
     }
     case STATE_IDLE:
@@ -834,7 +1155,7 @@ void reactCtrlThread::run()
         yarp::os::Bottle& b = movementFinishedPort.prepare();
         b.clear();
         Vector p;
-        p = main_arm->arm->EndEffPose();
+        p = main_arm->kin.pose();
         for (int i = 0; i < 7; i++)
         {
             b.addInt32(static_cast<int>(round(p(i) * M2MM)));
@@ -850,14 +1171,45 @@ void reactCtrlThread::run()
         yFatal("[reactCtrlThread] reactCtrlThread should never be here!!! Step: %d",state);
     }
 
-    sendData();
-    sendObsData();
+    if (telemetryStage)
+    {
+        // the ports are written by the telemetry stage, while the next cycle goes on
+        telemetry_t& t = telemetryBuffer.back();
+        sendData(t);
+        sendObsData(t);
+        telemetryBuffer.publish();
+        telemetryStage->trigger();
+    }
+    else
+    {
+        sendData(telemetry);
+        sendObsData(telemetry);
+        writeTelemetry(telemetry);
+        telemetry.gui.clear();
+    }
     if (vel_limited) //if vLim was changed by the avoidanceHandler, we reset it
     {
         main_arm->vLimAdapted = main_arm->vLimNominal;
         if (second_arm) second_arm->vLimAdapted = second_arm->vLimNominal;
     }
 
+    const TimingHistogram::Clock::duration used = TimingHistogram::Clock::now() - runStart;
+    timings[TIMING_CYCLE].record(used);
+    if (std::chrono::duration<double>(used).count() > dT)
+    {
+        cycleOverruns.fetch_add(1, std::memory_order_relaxed);
+        printMessage(3,"[reactCtrlThread::run()] over the period: %.2f ms\n", std::chrono::duration<double, std::milli>(used).count());
+    }
+    const double now = yarp::os::Time::now();
+    if (timingPort.getOutputCount() > 0 && now - lastTimingSent >= TIMING_SEND_PERIOD)
+    {
+        Bottle& b = timingPort.prepare();
+        b.clear();
+        timingSummary(b);
+        timingPort.write();
+        lastTimingSent = now;
+    }
+
     printMessage(2,"[reactCtrlThread::run()] finished, state: %d.\n\n\n",state);
 }
 
@@ -866,21 +1218,46 @@ void reactCtrlThread::nextMove(bool& vel_limited)
     main_arm->updateNextTarget(vel_limited);
     if (second_arm) second_arm->updateNextTarget(vel_limited);
     if (second_arm) {
-        visuhdl.visualizeObjects(main_arm->x_d, main_arm->x_n, second_arm->x_d, second_arm->x_n);
+        visuhdl.visualizeObjects(main_arm->x_d, main_arm->x_n, second_arm->x_d, second_arm->x_n, &guiObjects);
     }
     else {
-        visuhdl.visualizeObjects(main_arm->x_d, main_arm->x_n);
+        visuhdl.visualizeObjects(main_arm->x_d, main_arm->x_n, &guiObjects);
     }
     const double t_3 = yarp::os::Time::now();
     //this is the key function call where the reaching opt problem is solved
-    solverExitCode = solveIK();
+    {
+        ScopedTiming timing(timings[TIMING_SOLVE_IK]);
+        solverExitCode = solveIK();
+    }
     timeToSolveProblem_s = yarp::os::Time::now() - t_3;
+    const Vector qPrev = main_arm->I->get();
+    const Vector qPrev2 = second_arm? second_arm->I->get() : Vector();
     main_arm->qIntegrated = main_arm->I->integrate(main_arm->q_dot);
-    main_arm->virtualArm->setAng(main_arm->qIntegrated * CTRL_DEG2RAD);
+    main_arm->virtualKin.update(main_arm->qIntegrated * CTRL_DEG2RAD);
     if (second_arm)
     {
         second_arm->qIntegrated = second_arm->I->integrate(second_arm->q_dot);
-        second_arm->virtualArm->setAng(second_arm->qIntegrated * CTRL_DEG2RAD);
+        second_arm->virtualKin.update(second_arm->qIntegrated * CTRL_DEG2RAD);
+    }
+    if (sweptCheck)
+    {
+        // the constraints hold at the sampled configurations only: a fast link could pass through a thin obstacle
+        const double fraction = sweptStepFraction();
+        if (fraction < 1.0)
+        {
+            printMessage(1,"[reactCtrlThread::nextMove] the step would pass through an obstacle, scaled by %.2f\n", fraction);
+            main_arm->q_dot *= fraction;
+            main_arm->I->reset(qPrev);
+            main_arm->qIntegrated = main_arm->I->integrate(main_arm->q_dot);
+            main_arm->virtualKin.update(main_arm->qIntegrated * CTRL_DEG2RAD);
+            if (second_arm)
+            {
+                second_arm->q_dot *= fraction;
+                second_arm->I->reset(qPrev2);
+                second_arm->qIntegrated = second_arm->I->integrate(second_arm->q_dot);
+                second_arm->virtualKin.update(second_arm->qIntegrated * CTRL_DEG2RAD);
+            }
+        }
     }
 
     if (!controlArm("positionDirect"))
@@ -891,7 +1268,35 @@ void reactCtrlThread::nextMove(bool& vel_limited)
 
 void reactCtrlThread::threadRelease()
 {
-
+    if (pipeline)
+    {
+        perceptionStage->stop();
+        telemetryStage->stop();
+        printMessage(1,"[reactCtrlThread] perception stage: %lu runs, %lu over budget, longest %.2f ms\n",
+                     perceptionStage->runs(), perceptionStage->overruns(), perceptionStage->maxLatency()*1000.0);
+        printMessage(1,"[reactCtrlThread] telemetry stage: %lu runs, %lu over budget, longest %.2f ms, %lu cycles not sent\n",
+                     telemetryStage->runs(), telemetryStage->overruns(), telemetryStage->maxLatency()*1000.0,
+                     telemetryBuffer.drops());
+    }
+    workers.reset();
+    ctrlModeMonitor->stop();
+    printMessage(1,"[reactCtrlThread] control modes read %lu times, %lu reads refused\n", ctrlModeMonitor->reads(),
+                 ctrlModeMonitor->failures());
+    printMessage(1,"[reactCtrlThread] records lost on full rings: skin %lu, pps %lu, proximity %lu, sensation manager %lu, "
+                   "obstacles %lu, skeletons %lu, targets %lu\n", aggregSkinEventsInPort.records().drops(),
+                 aggregPPSeventsInPort.records().drops(), proximitySensors.drops(), sensManagerPort.records().drops(),
+                 NeoObsInPort.records().drops(), skeletonInPort.records().drops(), streamedTargets.records().drops());
+    printMessage(1,"[reactCtrlThread] frames of the arm computed %lu times, of the virtual arm %lu times in %u cycles\n",
+                 main_arm->kin.computations(), main_arm->virtualKin.computations(), getIterations());
+    yInfo("[reactCtrlThread] timing of %u cycles, %lu over the period of %.1f ms:", getIterations(),
+          cycleOverruns.load(std::memory_order_relaxed), dT*1000.0);
+    yInfo("[reactCtrlThread] %-16s %8s %9s %9s %9s %9s %9s %9s", "[ms]", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (int i = 0; i < TIMING_STAGES; i++)
+    {
+        const TimingHistogram::summary_t s = timings[i].summary();
+        yInfo("[reactCtrlThread] %-16s %8lu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f", timingNames[i], s.count, s.mean,
+              s.p50, s.p90, s.p99, s.p999, s.max);
+    }
     yInfo("threadRelease(): deleting arm and torso encoder arrays and arm object.");
     delete encsT; encsT = nullptr;
     delete torso; torso = nullptr;
@@ -917,10 +1322,8 @@ void reactCtrlThread::threadRelease()
     aggregPPSeventsInPort.close();
     aggregSkinEventsInPort.interrupt();
     aggregSkinEventsInPort.close();
-    proximityEventsInPort.interrupt();
-    proximityEventsInPort.close();
-    proximityEvents2InPort.interrupt();
-    proximityEvents2InPort.close();
+    proximitySensors.close();
+    taxels.close();
     proximityEventsVisuPort.interrupt();
     proximityEventsVisuPort.close();
     proximityEventsForiCubGuiPort.interrupt();
@@ -931,14 +1334,55 @@ void reactCtrlThread::threadRelease()
     outObsPort.close();
     sensManagerPort.interrupt();
     sensManagerPort.close();
+    if (pointCloudCollPointsOn)
+    {
+        pointCloudInPort.interrupt();
+        pointCloudInPort.close();
+    }
     visuhdl.closePorts();
     movementFinishedPort.interrupt();
     movementFinishedPort.close();
+    timingPort.interrupt();
+    timingPort.close();
     NeoObsInPort.interrupt();
     NeoObsInPort.close();
+    skeletonInPort.interrupt();
+    skeletonInPort.close();
 }
 
 
+Bottle reactCtrlThread::getTiming() const
+{
+    Bottle b;
+    timingSummary(b);
+    return b;
+}
+
+void reactCtrlThread::timingSummary(Bottle& b) const
+{
+    Bottle& stages = b.addList();
+    for (int i = 0; i < TIMING_STAGES; i++)
+    {
+        const TimingHistogram::summary_t s = timings[i].summary();
+        Bottle& stage = stages.addList();
+        stage.addString(timingNames[i]);
+        stage.addInt32(static_cast<int>(s.count));
+        for (const double v : {s.mean, s.p50, s.p90, s.p99, s.p999, s.max})
+        {
+            stage.addFloat64(v);
+        }
+    }
+    Bottle& overruns = b.addList();
+    overruns.addString("overruns");
+    overruns.addInt32(static_cast<int>(cycleOverruns.load(std::memory_order_relaxed)));
+    Bottle& used = b.addList();
+    used.addString("used");
+    used.addFloat64(getEstimatedUsed()*1000.0);
+    Bottle& period = b.addList();
+    period.addString("period");
+    period.addFloat64(getEstimatedPeriod()*1000.0);
+}
+
 bool reactCtrlThread::enableTorso()
 {
     // std::lock_guard<std::mutex> lg(mut);
@@ -952,6 +1396,7 @@ bool reactCtrlThread::enableTorso()
     {
         main_arm->arm->releaseLink(i);
     }
+    main_arm->kin.setChain(main_arm->arm);
     main_arm->vLimAdapted.setSubcol({-vMax, -vMax, -vMax}, 0, 0);
     main_arm->vLimAdapted.setSubcol({vMax, vMax, vMax}, 0, 1);
     main_arm->vLimNominal.setSubcol({-vMax, -vMax, -vMax}, 0, 0);
@@ -996,7 +1441,12 @@ bool reactCtrlThread::setNewTarget(const Vector& _x_d, bool _movingCircle)
 
 bool reactCtrlThread::setNewTarget(const Vector& _x_d, const Vector& _o_d, bool _movingCircle)
 {
-    if (_x_d.size()==3 && _o_d.size()==4)
+    return _o_d.size()==4 && setNewTarget(_x_d, axisAngleToQuaternion(_o_d), _movingCircle);
+}
+
+bool reactCtrlThread::setNewTarget(const Vector& _x_d, const Eigen::Quaterniond& _o_d, bool _movingCircle)
+{
+    if (_x_d.size()==3)
     {
         streamingTarget = false;
         ee_dist_constr++;
@@ -1010,7 +1460,7 @@ bool reactCtrlThread::setNewTarget(const Vector& _x_d, const Vector& _o_d, bool
         if (second_arm)
         {
             second_arm->q_dot.zero();
-            second_arm->virtualArm->setAng(second_arm->q*CTRL_DEG2RAD); //with new target, we make the two chains identical at the start
+            second_arm->virtualKin.update(second_arm->q*CTRL_DEG2RAD); //with new target, we make the two chains identical at the start
             second_arm->I->reset(second_arm->q);
             second_arm->x_0 = second_arm->x_t;
             second_arm->x_d = second_arm->x_t;
@@ -1040,7 +1490,13 @@ bool reactCtrlThread::setBothTargets(const yarp::sig::Vector& _x_d, const yarp::
 
 bool reactCtrlThread::setBothTargets(const yarp::sig::Vector& _x_d, const yarp::sig::Vector& _o_d, const yarp::sig::Vector& _x2_d, const yarp::sig::Vector& _o2_d, bool m_arm_constr)
 {
-    if (second_arm != nullptr && _x_d.size()==3 && _o_d.size()==4 && _x2_d.size()==3 && _o2_d.size()==4)
+    return _o_d.size()==4 && _o2_d.size()==4 &&
+           setBothTargets(_x_d, axisAngleToQuaternion(_o_d), _x2_d, axisAngleToQuaternion(_o2_d), m_arm_constr);
+}
+
+bool reactCtrlThread::setBothTargets(const yarp::sig::Vector& _x_d, const Eigen::Quaterniond& _o_d, const yarp::sig::Vector& _x2_d, const Eigen::Quaterniond& _o2_d, bool m_arm_constr)
+{
+    if (second_arm != nullptr && _x_d.size()==3 && _x2_d.size()==3)
     {
         streamingTarget = false;
         ee_dist_constr++;
@@ -1090,9 +1546,14 @@ bool reactCtrlThread::stopControlAndSwitchToPositionMode()
 {
 //    ee_dist_constr = -1;
     state=STATE_WAIT;
-    return  setCtrlModes(jointsToSetPosA,"arm","position")  &&
-           (second_arm == nullptr || setCtrlModes(jointsToSetPosA,"second_arm","position")) &&
-           setCtrlModes(jointsToSetPosT,"torso","position");
+    const bool ok = setCtrlModes(jointsToSetPosA,"arm","position")  &&
+                    (second_arm == nullptr || setCtrlModes(jointsToSetPosA,"second_arm","position")) &&
+                    setCtrlModes(jointsToSetPosT,"torso","position");
+    // ctrlModes belongs to the control thread: it records the switch in the next controlArm(), so that the next
+    // reaching sets the modes again even if the monitor has not read them yet
+    positionModesSet = true;
+    if (ctrlModeMonitor) ctrlModeMonitor->refresh();
+    return ok;
 }
 
 bool reactCtrlThread::goHome()
@@ -1118,31 +1579,15 @@ int reactCtrlThread::solveIK()
     //  Remember: at this stage everything is kept in degrees because the robot is controlled in degrees.
     //  At the ipopt level it comes handy to translate everything in radians because iKin works in radians.
 
-    Vector xr(7, 0.0);
-    xr.setSubvector(0, main_arm->x_n);
-    xr.setSubvector(3, main_arm->o_n);
     int count = 0;
     int exit_code = 0;
     size_t dim = main_arm->chainActiveDOF;
-    auto obstacles = std::vector<Vector>{};
-    //        main_arm->avoidance = false;
-    if (Bottle *xdNew=NeoObsInPort.read(false))
-    {
-        //            main_arm->avoidance = true;
-        for (int j = 0; j < xdNew->size()-2; j+=3)
-        {
-            obstacles.push_back(Vector{xdNew->get(0+j).asFloat64(), xdNew->get(1+j).asFloat64(), xdNew->get(2+j).asFloat64()});
-        }
-    }
     if (second_arm) {
         dim += second_arm->chainActiveDOF - NR_TORSO_JOINTS;
-        Vector xr2(7, 0.0);
-        xr2.setSubvector(0, second_arm->x_n);
-        xr2.setSubvector(3, second_arm->o_n);
-        solver->init(xr, main_arm->q_dot, main_arm->vLimAdapted, comingHome ? 10 : restPosWeight, main_arm->Aobst, main_arm->bvalues,
-                     second_arm->Aobst, second_arm->bvalues, xr2, second_arm->q_dot, second_arm->vLimAdapted, ee_dist_constr > 0);
+        solver->init(main_arm->x_n, main_arm->o_n, main_arm->q_dot, main_arm->vLimAdapted, comingHome ? 10 : restPosWeight, main_arm->Aobst, main_arm->bvalues,
+                     second_arm->Aobst, second_arm->bvalues, second_arm->x_n, second_arm->o_n, second_arm->q_dot, second_arm->vLimAdapted, ee_dist_constr > 0);
     } else {
-        solver->init(xr, main_arm->q_dot, main_arm->vLimAdapted, comingHome ? 10 : restPosWeight, main_arm->Aobst, main_arm->bvalues);
+        solver->init(main_arm->x_n, main_arm->o_n, main_arm->q_dot, main_arm->vLimAdapted, comingHome ? 10 : restPosWeight, main_arm->Aobst, main_arm->bvalues);
     }
     Vector res(dim, 0.0);
     auto vals = std::vector<double>{0, std::numeric_limits<double>::max()};
@@ -1202,13 +1647,51 @@ int reactCtrlThread::solveIK()
 
 void reactCtrlThread::updateArmChain()
 {
-    iencsT->getEncoders(encsT->data());
+    ScopedTiming timing(timings[TIMING_ARM_CHAIN]);
+    // one timestamped read of every part: the sample is as old as its oldest joint
+    const double stamps[3] = {iencsT->getEncodersTimed(encsT->data(), encStampsT.data()) ?
+                                  oldestStamp(encStampsT.data(), NR_TORSO_JOINTS) : 0.0,
+                              main_arm->readEncoders(),
+                              second_arm ? second_arm->readEncoders() : std::numeric_limits<double>::max()};
+    const char* parts[3] = {"torso", "arm", "second arm"};
+    double oldest = std::numeric_limits<double>::max();
+    for (int p = 0; p < 3; p++)
+    {
+        if (stamps[p] > 0.0)
+        {
+            oldest = std::min(oldest, stamps[p]);
+        }
+        else
+        {
+            // the part keeps the values of the last sample, which is then as old as the last stamp at most
+            yWarning("[reactCtrlThread::updateArmChain] could not read the timed encoders of the %s", parts[p]);
+            if (encoderStamp > 0.0) oldest = std::min(oldest, encoderStamp);
+        }
+    }
+    if (oldest < std::numeric_limits<double>::max()) encoderStamp = oldest;
+
+    double horizon = 0.0;
+    if (encoderPrediction && state == STATE_REACH)
+    {
+        const double age = encoderStamp > 0.0 ? yarp::os::Time::now() - encoderStamp : 0.0;
+        horizon = std::min(std::max(age, 0.0) + commandDelay, PREDICTION_MAX_HORIZON);
+        printMessage(3,"[reactCtrlThread::updateArmChain] encoders %.1f ms old, extrapolated by %.1f ms\n",
+                     age*1000.0, horizon*1000.0);
+    }
     qT[0]=(*encsT)[2];
     qT[1]=(*encsT)[1];
     qT[2]=(*encsT)[0];
+    if (horizon > 0.0)
+    {
+        // the torso follows the velocities of the main arm (the second one shares them)
+        for (int i = 0; i < NR_TORSO_JOINTS; i++)
+        {
+            qT[i] = std::min(std::max(qT[i] + main_arm->q_dot[i]*horizon, main_arm->lim(i,0)), main_arm->lim(i,1));
+        }
+    }
     torso->setAng(qT*CTRL_DEG2RAD);
-    main_arm->updateArm(qT);
-    if (second_arm) second_arm->updateArm(qT);
+    main_arm->updateArm(qT, horizon);
+    if (second_arm) second_arm->updateArm(qT, horizon);
 }
 
 bool reactCtrlThread::alignJointsBounds()
@@ -1219,23 +1702,10 @@ bool reactCtrlThread::alignJointsBounds()
 bool reactCtrlThread::areJointsHealthyAndSet(std::vector<int> &jointsToSet, const std::string &_p, const std::string &_s)
 {
     jointsToSet.clear();
-    std::vector<int> modes(main_arm->jntsA);
-    if (_p=="arm")
-    {
-        modes.resize(NR_ARM_JOINTS,VOCAB_CM_IDLE);
-        main_arm->imodA->getControlModes(modes.data());
-    }
-    else if (_p=="torso")
-    {
-        modes.resize(NR_TORSO_JOINTS,VOCAB_CM_IDLE);
-        imodT->getControlModes(modes.data());
-    }
-    else if (_p=="second_arm" && second_arm)
-    {
-        modes.resize(NR_ARM_JOINTS,VOCAB_CM_IDLE);
-        second_arm->imodA->getControlModes(modes.data());
-    }
-    else { return false; }
+    // the modes known to the control thread, no round trip to the control boards
+    const int part = ctrlModePart(_p);
+    if (part < 0) { return false; }
+    const std::vector<int> modes(ctrlModes.modes[part], ctrlModes.modes[part] + ctrlModes.joints[part]);
 
     for (int i=0; i<modes.size(); i++)
     {
@@ -1267,6 +1737,25 @@ bool reactCtrlThread::areJointsHealthyAndSet(std::vector<int> &jointsToSet, cons
     return true;
 }
 
+int reactCtrlThread::ctrlModePart(const std::string &_p) const
+{
+    if (_p=="arm") { return ctrlModeParts[0]; }
+    if (_p=="torso") { return ctrlModeParts[1]; }
+    if (_p=="second_arm" && second_arm) { return ctrlModeParts[2]; }
+    return -1;
+}
+
+void reactCtrlThread::cacheCtrlModes(const std::vector<int> &jointsToSet, const std::string &_p, const std::string &_s)
+{
+    const int part = ctrlModePart(_p);
+    if (part < 0 || jointsToSet.empty()) { return; }
+    const int mode = _s=="position"? VOCAB_CM_POSITION : _s=="velocity"? VOCAB_CM_VELOCITY : VOCAB_CM_POSITION_DIRECT;
+    for (const int j : jointsToSet)
+    {
+        ctrlModes.modes[part][j] = mode;
+    }
+}
+
 bool reactCtrlThread::setCtrlModes(const std::vector<int> &jointsToSet, const std::string &_p, const std::string &_s)
 {
     if (_s!="position" && _s!="velocity" && _s!="positionDirect") { return false; }
@@ -1318,6 +1807,15 @@ bool reactCtrlThread::setCtrlModes(const std::vector<int> &jointsToSet, const st
 //N.B. the targetValues can be either positions or velocities, depending on the control mode!
 bool reactCtrlThread::controlArm(const std::string& _controlMode)
 {
+    ScopedTiming timing(timings[TIMING_CONTROL_ARM]);
+    // the modes are checked on the cache of the monitor: in the steady state only the positions are sent
+    ctrlModeMonitor->take(ctrlModes);
+    if (positionModesSet.exchange(false))
+    {
+        cacheCtrlModes(jointsToSetPosA,"arm","position");
+        if (second_arm) cacheCtrlModes(jointsToSetPosA,"second_arm","position");
+        cacheCtrlModes(jointsToSetPosT,"torso","position");
+    }
     std::vector<int> jointsToSetA;
     std::vector<int> jointsToSetA2;
     std::vector<int> jointsToSetT;
@@ -1338,12 +1836,14 @@ bool reactCtrlThread::controlArm(const std::string& _controlMode)
         yError("[reactCtrlThread::controlArm] I am not able to set the arm joints to %s mode!",_controlMode.c_str());
         return false;
     }
+    cacheCtrlModes(jointsToSetA,"arm",_controlMode);
 
     if (!setCtrlModes(jointsToSetT,"torso",_controlMode))
     {
         yError("[reactCtrlThread::controlArm] I am not able to set the torso joints to %s mode!",_controlMode.c_str());
         return false;
     }
+    cacheCtrlModes(jointsToSetT,"torso",_controlMode);
 
     if (second_arm)
     {
@@ -1358,6 +1858,7 @@ bool reactCtrlThread::controlArm(const std::string& _controlMode)
             yError("[reactCtrlThread::controlArm] I am not able to set the second arm joints to %s mode!", _controlMode.c_str());
             return false;
         }
+        cacheCtrlModes(jointsToSetA2, "second_arm", _controlMode);
     }
 
     if(_controlMode == "positionDirect")
@@ -1367,13 +1868,19 @@ bool reactCtrlThread::controlArm(const std::string& _controlMode)
         posT[1] = main_arm->qIntegrated[1];
         posT[2] = main_arm->qIntegrated[0]; //swapping pitch and yaw as per iKin vs. motor interface convention
         printMessage(2,"    positionDirect: torso (swap pitch & yaw): %s\n",posT.toString(3,3).c_str());
-        iposDirT->setPositions(NR_TORSO_JOINTS, jointsToSetPosT.data(),posT.data());
+        bool sent = iposDirT->setPositions(NR_TORSO_JOINTS, jointsToSetPosT.data(),posT.data());
         printMessage(1,"[reactCtrlThread::controlArm] Target joint positions (iKin order, deg): %s\n",main_arm->qIntegrated.toString(3,3).c_str());
-        main_arm->iposDirA->setPositions(NR_ARM_JOINTS, jointsToSetPosA.data(), main_arm->qIntegrated.subVector(3,9).data()); //indexes 3 to 9 are the arm joints
+        sent &= main_arm->iposDirA->setPositions(NR_ARM_JOINTS, jointsToSetPosA.data(), main_arm->qIntegrated.subVector(3,9).data()); //indexes 3 to 9 are the arm joints
         if (second_arm)
         {
             printMessage(1,"[reactCtrlThread::controlArm] Target joint positions2 (iKin order, deg): %s\n",second_arm->qIntegrated.toString(3,3).c_str());
-            second_arm->iposDirA->setPositions(NR_ARM_JOINTS, jointsToSetPosA.data(), second_arm->qIntegrated.subVector(3,9).data());
+            sent &= second_arm->iposDirA->setPositions(NR_ARM_JOINTS, jointsToSetPosA.data(), second_arm->qIntegrated.subVector(3,9).data());
+        }
+        if (!sent)
+        {
+            // e.g. a joint gone to hardware fault: the modes are read again without waiting for the period
+            printMessage(1,"[reactCtrlThread::controlArm] positions refused, reading the control modes again\n");
+            ctrlModeMonitor->refresh();
         }
     }
 
@@ -1394,27 +1901,302 @@ Vector reactCtrlThread::getPosMovingTargetOnCircle()
 }
 
 /**** communication through ports in/out ****************/
-void reactCtrlThread::getCollisionPointsFromPort(BufferedPort<Bottle> &inPort, double gain, int type)
+void reactCtrlThread::getProximityCollisions()
 {
-    Bottle* collPointsMultiBottle = inPort.read(false);
-    if(collPointsMultiBottle == nullptr)
+    ts.update();
+    const auto& readings = proximitySensors.drain();
+    // the deletes go ahead of the objects of the cycle, all sent in order by the telemetry
+    for (const int k : proximitySensors.hidden())
     {
-        printMessage(9,"[reactCtrlThread::getCollisionPointsFromPort]: no avoidance vectors on the port.\n") ;
-        return;
+        VisualisationHandler::addiCubGuiDelete(guiObjects, "prox_obs"+std::to_string(k));
     }
-    printMessage(5,"[reactCtrlThread::getCollisionPointsFromPort]: There were %d bottles on the port.\n",
-                 collPointsMultiBottle->size());
-    for(int i=0; i< collPointsMultiBottle->size();i++)
+
+    // one output per cycle, whatever the number of sensors that fired
+    skinContactList& sCLout = proximityEventsForiCubGuiPort.prepare();
+    sCLout.clear();
+    proxActivations.assign(proximitySensors.size(), 0.0);
+    for (const auto& r : readings)
+    {
+        const portEvent_t& e = r.event;
+        const SkinPart sp = e.skin_part;
+        const Vector geocenter{e.x[0], e.x[1], e.x[2]}; // geocenter from skin / average activation locus from the pps
+        const Vector normal{e.n[0], e.n[1], e.n[2]};
+        addCollPoint(sp, geocenter, normal, e.activation, PROXIMITY_INPUT_GAIN, PROX_OBS);
+        proxActivations[r.sensor] = e.activation;
+
+        const Vector force(3, 0.0);
+        const double normalized_activation = 20 * e.activation;
+        const Vector moment = -normalized_activation * normal;
+        sCLout.push_back(skinContact(SkinPart_2_BodyPart[sp].body, sp, getLinkNum(sp), geocenter, geocenter, {},
+                                     normalized_activation, normal, force, moment));
+
+        ArmInterface* arm_ptr = main_arm.get();
+        if ((main_arm->part_short == "left" && SkinPart_2_BodyPart[sp].body == RIGHT_ARM) ||
+            (main_arm->part_short == "right" && SkinPart_2_BodyPart[sp].body == LEFT_ARM))
+        {
+            if (second_arm == nullptr) continue;
+            arm_ptr = second_arm.get();
+        }
+        const Matrix T_a = arm_ptr->kin.H(3+SkinPart_2_LinkNum[sp].linkNum);
+        const Vector prox_obs = T_a * Vector{geocenter(0), geocenter(1), normal(2)*(1.05-e.activation)/5 ,1};
+        VisualisationHandler::addiCubGuiObject(guiObjects, "prox_obs"+std::to_string(r.sensor), prox_obs);
+    }
+    if (!readings.empty())
     {
-        Bottle* bot = collPointsMultiBottle->get(i).asList();
-        printMessage(5, "Bottle %d contains %s \n", i, bot->toString().c_str());
-        getCollPointFromPort(bot, gain, type);
+        Bottle& activations = proximityEventsVisuPort.prepare();
+        activations.clear();
+        for (const double a : proxActivations)
+        {
+            activations.addFloat64(a);
+        }
+        proximityEventsVisuPort.write();
     }
+    proximityEventsForiCubGuiPort.setEnvelope(ts);
+    proximityEventsForiCubGuiPort.write();
 }
 
-void reactCtrlThread::getCollPointFromPort(Bottle* bot, double gain, int type)
+void reactCtrlThread::appendLinkSegments(const ArmInterface* a, const KinematicState& state,
+                                         std::vector<PointCloudHandler::segment_t>& segments) const
+{
+    // links as segments between the frames at shoulder, elbow, wrist and the end-effector
+    const bool left = a->part_short == "left";
+    const SkinPart parts[2] = {left? SKIN_LEFT_UPPER_ARM : SKIN_RIGHT_UPPER_ARM, left? SKIN_LEFT_FOREARM : SKIN_RIGHT_FOREARM};
+    Vector from = state.H(NR_TORSO_JOINTS).subcol(0,3,3);
+    for (int k = 0; k < 3; k++)
+    {
+        const Vector to = (k < 2) ? state.H(NR_TORSO_JOINTS+SkinPart_2_LinkNum[parts[k]].linkNum).subcol(0,3,3)
+                                  : state.position();
+        segments.push_back({Eigen::Vector3d(from[0], from[1], from[2]), Eigen::Vector3d(to[0], to[1], to[2])});
+        from = to;
+    }
+}
+
+void reactCtrlThread::updateLinkSegments()
+{
+    linkSegments.clear();
+    linkSegmentParts.clear();
+    for (ArmInterface* a : {main_arm.get(), second_arm.get()})
+    {
+        if (!a) continue;
+        const bool left = a->part_short == "left";
+        appendLinkSegments(a, a->kin, linkSegments);
+        linkSegmentParts.emplace_back(a, left? SKIN_LEFT_UPPER_ARM : SKIN_RIGHT_UPPER_ARM);
+        linkSegmentParts.emplace_back(a, left? SKIN_LEFT_FOREARM : SKIN_RIGHT_FOREARM);
+        linkSegmentParts.emplace_back(a, left? SKIN_LEFT_HAND : SKIN_RIGHT_HAND);
+    }
+}
+
+double reactCtrlThread::sweptStepFraction()
+{
+    const bool primitivesOn = !obstacles.empty(cycleStamp) || !people.empty(cycleStamp);
+    if (!primitivesOn && !pcHandler && !envMap)
+    {
+        return 1.0;
+    }
+
+    // links at the current configuration (the arm chains) and at the integrated one (the virtual arms)
+    sweptSegments.clear();
+    for (ArmInterface* a : {main_arm.get(), second_arm.get()})
+    {
+        if (a) appendLinkSegments(a, a->kin, sweptSegments);
+    }
+    const size_t links = sweptSegments.size();
+    for (ArmInterface* a : {main_arm.get(), second_arm.get()})
+    {
+        if (a) appendLinkSegments(a, a->virtualKin, sweptSegments);
+    }
+    double maxShift = 0.0;
+    for (size_t i = 0; i < links; i++)
+    {
+        maxShift = std::max({maxShift, (sweptSegments[links+i].a - sweptSegments[i].a).norm(),
+                             (sweptSegments[links+i].b - sweptSegments[i].b).norm()});
+    }
+
+    // consecutive samples closer than the link radius, so that their capsules overlap
+    const int samples = std::min(SWEPT_MAX_SAMPLES, std::max(1, static_cast<int>(std::ceil(maxShift / LINK_RADIUS))));
+    sweptSegments.resize(links);
+    for (int j = 1; j <= samples; j++)
+    {
+        const double s = static_cast<double>(j) / samples;
+        for (ArmInterface* a : {main_arm.get(), second_arm.get()})
+        {
+            if (!a) continue;
+            if (j < samples) a->virtualKin.update((a->q + s * (a->qIntegrated - a->q)) * CTRL_DEG2RAD);
+            else a->virtualKin.update(a->qIntegrated * CTRL_DEG2RAD);
+            appendLinkSegments(a, a->virtualKin, sweptSegments);
+        }
+    }
+
+    sweptClearance.assign(sweptSegments.size(), std::numeric_limits<double>::max());
+    for (size_t k = 0; k < sweptSegments.size() && primitivesOn; k++)
+    {
+        // the obstacles are moved to where they will be at the sample
+        const double t = cycleStamp + dT * static_cast<double>(k / links) / samples;
+        obsWitnesses.clear();
+        for (const ObstaclePrimitives* set : {&obstacles, &people})
+        {
+            set->closest(sweptSegments[k].a, sweptSegments[k].b, t, LINK_RADIUS + maxShift, obsWitnesses);
+        }
+        for (const auto& w : obsWitnesses)
+        {
+            sweptClearance[k] = std::min(sweptClearance[k], w.dist - LINK_RADIUS);
+        }
+    }
+    if (pcHandler)
+    {
+        pcHandler->nearest(sweptSegments, sweptNearest, *workers); // voxels collected by getPointCloudCollisions()
+        for (size_t k = 0; k < sweptSegments.size(); k++)
+        {
+            if (sweptNearest[k].valid) sweptClearance[k] = std::min(sweptClearance[k], sweptNearest[k].dist - LINK_RADIUS);
+        }
+    }
+    if (envMap)
+    {
+        double dist;
+        Eigen::Vector3d normal;
+        for (size_t k = 0; k < sweptSegments.size(); k++)
+        {
+            const Eigen::Vector3d ab = sweptSegments[k].b - sweptSegments[k].a;
+            const int points = 1 + static_cast<int>(std::ceil(ab.norm() / LINK_RADIUS));
+            for (int p = 0; p <= points; p++)
+            {
+                if (envMap->query(sweptSegments[k].a + ab * (static_cast<double>(p) / points), dist, normal))
+                {
+                    sweptClearance[k] = std::min(sweptClearance[k], dist - LINK_RADIUS);
+                }
+            }
+        }
+    }
+
+    for (int j = 1; j <= samples; j++)
+    {
+        for (size_t i = 0; i < links; i++)
+        {
+            // a link already in contact may move out of the obstacle, but not deeper into it
+            const double c = sweptClearance[j*links + i];
+            if (c < 0.0 && c < sweptClearance[(j-1)*links + i])
+            {
+                printMessage(3,"[reactCtrlThread::sweptStepFraction] link %lu enters an obstacle at sample %d of %d\n",
+                             i, j, samples);
+                return static_cast<double>(j-1) / samples;
+            }
+        }
+    }
+    return 1.0;
+}
+
+void reactCtrlThread::getPointCloudCollisions()
+{
+    if (perception.cloudNew)
+    {
+        pcHandler->integrate(perception.cloudKeys, cycleStamp);
+        perception.cloudNew = false;
+    }
+
+    const int occupied = pcHandler->update(linkSegments, cycleStamp, *workers);
+    pcHandler->nearest(linkSegments, pcNearest, *workers);
+    printMessage(5,"[reactCtrlThread::getPointCloudCollisions] %d occupied voxels\n", occupied);
+    for (size_t i = 0; i < pcNearest.size(); i++)
+    {
+        const PointCloudHandler::nearest_t& nr = pcNearest[i];
+        if (!nr.valid) continue;
+        const double magnitude = std::min(1.0, 1.0 - (nr.dist - LINK_RADIUS) / OBS_RANGE);
+        if (magnitude <= 0.0) continue;
+
+        ArmInterface* arm_ptr = linkSegmentParts[i].first;
+        const SkinPart sp = linkSegmentParts[i].second;
+        const Matrix T_a = arm_ptr->kin.H(NR_TORSO_JOINTS+SkinPart_2_LinkNum[sp].linkNum);
+        const Matrix R_t = T_a.submatrix(0,2,0,2).transposed();
+        const Vector w{nr.onSegment[0], nr.onSegment[1], nr.onSegment[2]};
+        const Eigen::Vector3d dir = (nr.obstacle - nr.onSegment).normalized();
+
+        collisionPoint_t newColPoint{sp, VISUAL_OBS, magnitude * VISUAL_INPUT_GAIN};
+        newColPoint.x = R_t * (w - T_a.subcol(0,3,3)); // witness point in the FoR of the skin part
+        newColPoint.n = Vector{dir[0], dir[1], dir[2]}; // root FoR, as for the other modalities
+        arm_ptr->collisionPoints.merge(newColPoint, cycleStamp, T_a.submatrix(0,2,0,2));
+        if (obstacleMemory) obstacleMemory->insert(nr.obstacle, cycleStamp);
+    }
+}
+
+void reactCtrlThread::getPrimitiveCollisions()
+{
+    main_arm->obstaclePoints.clear();
+    if (second_arm) second_arm->obstaclePoints.clear();
+    for (size_t i = 0; i < linkSegments.size(); i++)
+    {
+        obsWitnesses.clear();
+        // the distance to the link surface has to be within the influence distance of the damper;
+        // every obstacle or bone gives at most one witness per link
+        for (const ObstaclePrimitives* set : {&obstacles, &people})
+        {
+            set->closest(linkSegments[i].a, linkSegments[i].b, cycleStamp, DAMPER_INFLUENCE + LINK_RADIUS, obsWitnesses);
+        }
+        if (obsWitnesses.empty())
+        {
+            continue;
+        }
+        ArmInterface* arm_ptr = linkSegmentParts[i].first;
+        const SkinPart sp = linkSegmentParts[i].second;
+        const Matrix T_a = arm_ptr->kin.H(NR_TORSO_JOINTS+SkinPart_2_LinkNum[sp].linkNum);
+        const Matrix R_t = T_a.submatrix(0,2,0,2).transposed();
+        for (const auto& w : obsWitnesses)
+        {
+            const double dist = w.dist - LINK_RADIUS;
+            collisionPoint_t newColPoint{sp, GEOM_OBS,
+                                         std::min(1.0, std::max(0.0, 1.0 - (dist - DAMPER_SECURITY) / (DAMPER_INFLUENCE - DAMPER_SECURITY)))};
+            newColPoint.x = R_t * (Vector{w.onSegment[0], w.onSegment[1], w.onSegment[2]} - T_a.subcol(0,3,3));
+            newColPoint.n = Vector{w.normal[0], w.normal[1], w.normal[2]}; // root FoR, as for the other modalities
+            newColPoint.distance = dist;
+            newColPoint.obsNormalVel = w.normal.dot(w.vel);
+            newColPoint.stamp = cycleStamp;
+            arm_ptr->obstaclePoints.push_back(newColPoint);
+            if (obstacleMemory) obstacleMemory->insert(w.onSegment + w.dist * w.normal, cycleStamp);
+            printMessage(5,"[reactCtrlThread::getPrimitiveCollisions] obstacle %d at %.3f m from %s\n", w.obstacle, dist,
+                         SkinPart_s[sp].c_str());
+        }
+    }
+}
+
+void reactCtrlThread::getMemoryCollisions()
+{
+    updateLinkSegments();
+    for (size_t i = 0; i < linkSegments.size(); i++)
+    {
+        // what is perceived in this cycle comes from its own modality already
+        if (!obstacleMemory->nearest(linkSegments[i].a, linkSegments[i].b, cycleStamp, OBS_RANGE + LINK_RADIUS,
+                                     cycleStamp, memNearest))
+        {
+            continue;
+        }
+        const double magnitude = memNearest.occupancy * std::min(1.0, 1.0 - (memNearest.dist - LINK_RADIUS) / OBS_RANGE);
+        if (magnitude <= 0.0) continue;
+
+        ArmInterface* arm_ptr = linkSegmentParts[i].first;
+        const SkinPart sp = linkSegmentParts[i].second;
+        const Matrix T_a = arm_ptr->kin.H(NR_TORSO_JOINTS+SkinPart_2_LinkNum[sp].linkNum);
+        const Matrix R_t = T_a.submatrix(0,2,0,2).transposed();
+        const Vector w{memNearest.onSegment[0], memNearest.onSegment[1], memNearest.onSegment[2]};
+        const Eigen::Vector3d dir = (memNearest.obstacle - memNearest.onSegment).normalized();
+
+        collisionPoint_t newColPoint{sp, MEMORY_OBS, magnitude * VISUAL_INPUT_GAIN};
+        newColPoint.x = R_t * (w - T_a.subcol(0,3,3));
+        newColPoint.n = Vector{dir[0], dir[1], dir[2]}; // root FoR, as for the other modalities
+        arm_ptr->collisionPoints.merge(newColPoint, cycleStamp, T_a.submatrix(0,2,0,2));
+        printMessage(5,"[reactCtrlThread::getMemoryCollisions] remembered obstacle at %.3f m from %s, occupancy %.2f\n",
+                     memNearest.dist - LINK_RADIUS, SkinPart_s[sp].c_str(), memNearest.occupancy);
+    }
+}
+
+void reactCtrlThread::addCollPoints(const std::vector<portEvent_t>& events, const double gain, const int type)
+{
+    for (const auto& e : events)
+    {
+        addCollPoint(e.skin_part, Vector{e.x[0], e.x[1], e.x[2]}, Vector{e.n[0], e.n[1], e.n[2]}, e.activation, gain, type);
+    }
+}
+
+void reactCtrlThread::addCollPoint(const SkinPart sp, const Vector& x, const Vector& n, double activation, double gain, int type)
 {
-    const SkinPart sp = static_cast<SkinPart>(bot->get(0).asInt32());
 //    if (type == TACTILE_OBS && (sp == SKIN_RIGHT_HAND || sp == SKIN_LEFT_HAND)) // added for bimanual task
 //        return;
     // we take only those collision points that are relevant for the chain we are controlling + torso
@@ -1435,80 +2217,78 @@ void reactCtrlThread::getCollPointFromPort(Bottle* bot, double gain, int type)
 
         collisionPoint_t newColPoint{type};
         newColPoint.skin_part = sp;
-        newColPoint.x = {bot->get(1).asFloat64(), bot->get(2).asFloat64(), bot->get(3).asFloat64()};
-//        newColPoint.n = {bot->get(4).asFloat64(), bot->get(5).asFloat64(), bot->get(6).asFloat64()};
-        newColPoint.magnitude = bot->get(13).asFloat64() * gain; //* 0.7 added for bimanual task
+        newColPoint.x = x;
+        newColPoint.magnitude = activation * gain; //* 0.7 added for bimanual task
 
+        Matrix T_a;
+        if (SkinPart_2_BodyPart[sp].body == TORSO)
+        {
+            T_a = torso->getH(SkinPart_2_LinkNum[sp].linkNum, true);
+        }
+        else
+        {
+            T_a = arm_ptr->kin.H(3+SkinPart_2_LinkNum[sp].linkNum);
+        }
+        // the normal of the visual events is in the root FoR already, the others are in the FoR of the skin part
+        const Vector nRoot = type == VISUAL_OBS? n : T_a.submatrix(0,2,0,2) * n;
+        if (obstacleMemory)
+        {
+            // the obstacle lies along the normal, closer the higher the activation (on the skin for a contact)
+            const Vector p = (T_a * Vector{x[0], x[1], x[2], 1}).subVector(0,2) +
+                             nRoot * (type == TACTILE_OBS? 0.0 : (1.0 - std::min(1.0, activation)) * OBS_RANGE);
+            obstacleMemory->insert(Eigen::Vector3d(p[0], p[1], p[2]), cycleStamp, std::min(1.0, activation));
+        }
+
+        newColPoint.n = nRoot;
         if (type != VISUAL_OBS)
         {
-            Matrix T_a;
-            if (SkinPart_2_BodyPart[sp].body == TORSO)
-            {
-                T_a = torso->getH(SkinPart_2_LinkNum[sp].linkNum, true);
-            }
-            else
-            {
-                T_a = arm_ptr->arm->getH(3+SkinPart_2_LinkNum[sp].linkNum, true);
-            }
-            newColPoint.n = T_a.submatrix(0,2,0,2) * Vector{bot->get(4).asFloat64(), bot->get(5).asFloat64(), bot->get(6).asFloat64()};
             if (type == PROX_OBS) {
-                obsWorldPos[(sp == SKIN_LEFT_HAND)? 0 : 1] = (T_a * Vector{bot->get(1).asFloat64(), bot->get(2).asFloat64(),
-                                                    bot->get(6).asFloat64()*(1.05-bot->get(13).asFloat64())/5, 1}).subVector(0,2);
+                obsWorldPos[(sp == SKIN_LEFT_HAND)? 0 : 1] = (T_a * Vector{x[0], x[1], n[2]*(1.05-activation)/5, 1}).subVector(0,2);
 //                printf("Added proximity obstacle\n");
             } else if (type == TACTILE_OBS) {
-                obsWorldPos[1+static_cast<int>(sp)] = (T_a * Vector{bot->get(1).asFloat64(), bot->get(2).asFloat64(), bot->get(3).asFloat64(), 1}).subVector(0,2);
+                obsWorldPos[1+static_cast<int>(sp)] = (T_a * Vector{x[0], x[1], x[2], 1}).subVector(0,2);
 //                printf("Added tactile obstacle with SP %d\n", sp);
             }
         }
         else
         {
-            newColPoint.n = {bot->get(10).asFloat64(), bot->get(11).asFloat64(), bot->get(12).asFloat64()};
             newColPoint.duration *= 2; // added for realsense obstacles
         }
 
 
-        bool exists = false;
-        for (auto& colPoint : arm_ptr->collisionPoints)
-        {
-            if (norm(colPoint.x - newColPoint.x) < 1e-2 && colPoint.type == newColPoint.type)
-            {
-                colPoint.reset(newColPoint.magnitude);
-                colPoint.x = colPoint.x;
-                colPoint.n = newColPoint.n;
-                exists = true;
-                break;
-            }
-        }
-        if (!exists) {
-//            printf("New col points position %s\n", newColPoint.x.toString(3).c_str());
-            arm_ptr->collisionPoints.push_back(newColPoint);
-        }
+        // every stored point takes at most one measurement per cycle, so that two nearby obstacles are not merged
+        arm_ptr->collisionPoints.merge(newColPoint, cycleStamp, T_a.submatrix(0,2,0,2));
     }
 }
 
-void reactCtrlThread::sendData()
+void reactCtrlThread::sendData(telemetry_t& t)
 {
-    ts.update();
+    ScopedTiming timing(timings[TIMING_SEND_DATA]);
+    // the data describe the arm at the time of the encoder sample
+    if (encoderStamp > 0.0) ts.update(encoderStamp);
+    else ts.update();
+    t.ts = ts;
     printMessage(5,"[reactCtrlThread::sendData()]\n");
-    if (outPort.getOutputCount()>0)
+    t.dataOn = outPort.getOutputCount()>0;
+    if (t.dataOn)
     {
         Vector closestPoint2Obs(3,0.0);
         Vector secondclosestPoint2Obs(3,0.0);
         Vector thirdclosestPoint2Obs(3,0.0);
-        auto ctrlPoints = main_arm->avhdl->getCtrlPointsPosition();
+        const auto& ctrlPoints = main_arm->avhdl->getCtrlPoints();
         if (!ctrlPoints.empty())
         {
-            closestPoint2Obs = ctrlPoints[0].first;
+            closestPoint2Obs = ctrlPoints[0].pos;
             if (ctrlPoints.size() > 1) {
-                secondclosestPoint2Obs = ctrlPoints[1].first;
+                secondclosestPoint2Obs = ctrlPoints[1].pos;
                 if (ctrlPoints.size() > 2)
                 {
-                    thirdclosestPoint2Obs = ctrlPoints[2].first;
+                    thirdclosestPoint2Obs = ctrlPoints[2].pos;
                 }
             }
         }
 
-        yarp::os::Bottle b;
+        yarp::os::Bottle& b = t.data;
         b.clear();
 
         //col 1-4
@@ -1526,11 +2306,11 @@ void reactCtrlThread::sendData()
         vectorIntoBottle(main_arm->x_n,b);
         //orientation
         //cols 14-17: the desired final orientation (for end-effector)
-        vectorIntoBottle(main_arm->o_d,b);
+        vectorIntoBottle(quaternionToAxisAngle(main_arm->o_d),b);
         // 18:21 the end effector orientation in which the robot currently is
-        vectorIntoBottle(main_arm->o_t,b);
+        vectorIntoBottle(quaternionToAxisAngle(main_arm->o_t),b);
         // 22:25 the current desired orientation given by referenceGen (currently not supported - equal to o_d)
-        vectorIntoBottle(main_arm->o_n,b);
+        vectorIntoBottle(quaternionToAxisAngle(main_arm->o_n),b);
 
         //variable - if torso on: 26:35: joint velocities as solution to control and sent to robot
         vectorIntoBottle(main_arm->q_dot,b);
@@ -1558,11 +2338,11 @@ void reactCtrlThread::sendData()
             vectorIntoBottle(second_arm->x_n,b);
             //orientation
             //cols 96-99: the desired final orientation (for end-effector)
-            vectorIntoBottle(second_arm->o_d,b);
+            vectorIntoBottle(quaternionToAxisAngle(second_arm->o_d),b);
             // 100:103 the end effector orientation in which the robot currently is
-            vectorIntoBottle(second_arm->o_t,b);
+            vectorIntoBottle(quaternionToAxisAngle(second_arm->o_t),b);
             // 104:107 the current desired orientation given by referenceGen (currently not supported - equal to o_d)
-            vectorIntoBottle(second_arm->o_n,b);
+            vectorIntoBottle(quaternionToAxisAngle(second_arm->o_n),b);
 
             //variable - if torso on: 108:117 joint velocities as solution to control and sent to robot
             vectorIntoBottle(second_arm->q_dot,b);
@@ -1573,18 +2353,18 @@ void reactCtrlThread::sendData()
             //variable - if torso on: 138:157; joint vel limits as input to QP, after avoidanceHandler,
             matrixIntoBottle(second_arm->vLimAdapted,b); // assuming it is row by row, so min_1, max_1, min_2, max_2 etc.
 
-            auto ctrlPoints2 = second_arm->avhdl->getCtrlPointsPosition();
+            const auto& ctrlPoints2 = second_arm->avhdl->getCtrlPoints();
             Vector closestPoint2Obs2(3,0.0);
             Vector secondclosestPoint2Obs2(3,0.0);
             Vector thirdclosestPoint2Obs2(3,0.0);
             if (!ctrlPoints2.empty())
             {
-                closestPoint2Obs2 = ctrlPoints2[0].first;
+                closestPoint2Obs2 = ctrlPoints2[0].pos;
                 if (ctrlPoints2.size() > 1) {
-                    secondclosestPoint2Obs2 = ctrlPoints2[1].first;
+                    secondclosestPoint2Obs2 = ctrlPoints2[1].pos;
                     if (ctrlPoints2.size() > 2)
                     {
-                        thirdclosestPoint2Obs2 = ctrlPoints2[2].first;
+                        thirdclosestPoint2Obs2 = ctrlPoints2[2].pos;
                     }
                 }
             }
@@ -1594,22 +2374,22 @@ void reactCtrlThread::sendData()
 
 
         }
-        outPort.setEnvelope(ts);
-        outPort.write(b);
     }
 }
 
 
-void reactCtrlThread::sendObsData()
+void reactCtrlThread::sendObsData(telemetry_t& t)
 {
+    ScopedTiming timing(timings[TIMING_SEND_OBS]);
     printMessage(5,"[reactCtrlThread::sendObsData()]\n");
-    if (outObsPort.getOutputCount()>0)
+    t.obsOn = outObsPort.getOutputCount()>0;
+    if (t.obsOn)
     {
-        yarp::os::Bottle b;
+        yarp::os::Bottle& b = t.obs;
         b.clear();
         const int arms = (second_arm != nullptr) + 1;
         for (int l = 0; l < arms; l++) {
-            auto ctrlPoints = (l == 0) ? main_arm->avhdl->getCtrlPoints() : second_arm->avhdl->getCtrlPoints();
+            const auto& ctrlPoints = (l == 0) ? main_arm->avhdl->getCtrlPoints() : second_arm->avhdl->getCtrlPoints();
 //            const int offset =  (l == 0)? 0 : 44;
             const int visu_off =  (l == 0)? 0 : -4;
             const int cap = (l == 0)?44:34;
@@ -1619,37 +2399,37 @@ void reactCtrlThread::sendObsData()
             for (int k = 0; k < cap; k++) {
                 closestPoints[k].resize(3, 0.0);
             }
-            for (auto& ctrlPoint : ctrlPoints) {
-                if (ctrlPoint.second == TACTILE_OBS) {
-                    if (ctrlPoint.first.getDOF() == 10 && idx_tact_h < 4) {
-                        closestPoints[4 + idx_tact_h] = ctrlPoint.first.EndEffPosition();
+            for (const auto& ctrlPoint : ctrlPoints) {
+                if (ctrlPoint.type == TACTILE_OBS) {
+                    if (ctrlPoint.dof == 10 && idx_tact_h < 4) {
+                        closestPoints[4 + idx_tact_h] = ctrlPoint.pos;
                         idx_tact_h++;
-                    } else if (ctrlPoint.first.getDOF() == 8 && idx_tact_f < 4) {
-                        closestPoints[4 + 4 + idx_tact_f] = ctrlPoint.first.EndEffPosition();
+                    } else if (ctrlPoint.dof == 8 && idx_tact_f < 4) {
+                        closestPoints[4 + 4 + idx_tact_f] = ctrlPoint.pos;
                         idx_tact_f++;
-                    } else if (ctrlPoint.first.getDOF() == 6 && idx_tact_u < 4) {
-                        closestPoints[4 + 8 + idx_tact_u] = ctrlPoint.first.EndEffPosition();
+                    } else if (ctrlPoint.dof == 6 && idx_tact_u < 4) {
+                        closestPoints[4 + 8 + idx_tact_u] = ctrlPoint.pos;
                         idx_tact_u++;
-                    } else if (ctrlPoint.first.getDOF() == 3 && idx_tact_t < 4 && l == 0) {
-                        closestPoints[4 + 12 + idx_tact_t] = ctrlPoint.first.EndEffPosition();
+                    } else if (ctrlPoint.dof == 3 && idx_tact_t < 4 && l == 0) {
+                        closestPoints[4 + 12 + idx_tact_t] = ctrlPoint.pos;
                         idx_tact_t++;
                     }
-                } else if (ctrlPoint.second == VISUAL_OBS) {
-                    if (ctrlPoint.first.getDOF() == 10 && idx_visu_h < 6) {
-                        closestPoints[20 + idx_visu_h + visu_off] = ctrlPoint.first.EndEffPosition();
+                } else if (ctrlPoint.type == VISUAL_OBS) {
+                    if (ctrlPoint.dof == 10 && idx_visu_h < 6) {
+                        closestPoints[20 + idx_visu_h + visu_off] = ctrlPoint.pos;
                         idx_visu_h++;
-                    } else if (ctrlPoint.first.getDOF() == 8 && idx_visu_f < 6) {
-                        closestPoints[20 + 6 + idx_visu_f + visu_off] = ctrlPoint.first.EndEffPosition();
+                    } else if (ctrlPoint.dof == 8 && idx_visu_f < 6) {
+                        closestPoints[20 + 6 + idx_visu_f + visu_off] = ctrlPoint.pos;
                         idx_visu_f++;
-                    } else if (ctrlPoint.first.getDOF() == 6 && idx_visu_u < 6) {
-                        closestPoints[20 + 12 + idx_visu_u + visu_off] = ctrlPoint.first.EndEffPosition();
+                    } else if (ctrlPoint.dof == 6 && idx_visu_u < 6) {
+                        closestPoints[20 + 12 + idx_visu_u + visu_off] = ctrlPoint.pos;
                         idx_visu_u++;
-                    } else if (ctrlPoint.first.getDOF() == 3 && idx_visu_t < 6 && l == 0) {
-                        closestPoints[20 + 18 + idx_visu_t + visu_off] = ctrlPoint.first.EndEffPosition();
+                    } else if (ctrlPoint.dof == 3 && idx_visu_t < 6 && l == 0) {
+                        closestPoints[20 + 18 + idx_visu_t + visu_off] = ctrlPoint.pos;
                         idx_visu_t++;
                     }
-                } else if (ctrlPoint.second == PROX_OBS and idx_prox < 4) {
-                    closestPoints[idx_prox] = ctrlPoint.first.EndEffPosition();
+                } else if (ctrlPoint.type == PROX_OBS and idx_prox < 4) {
+                    closestPoints[idx_prox] = ctrlPoint.pos;
                     idx_prox++;
                 }
             }
@@ -1662,89 +2442,75 @@ void reactCtrlThread::sendObsData()
         {
             vectorIntoBottle(obsP, b);
         }
-
-        outObsPort.setEnvelope(ts);
-        outObsPort.write(b);
     }
+    // the iCubGui objects of this cycle, if any, all in one bottle; the writer clears it once sent, so anything left
+    // in it belongs to a cycle the telemetry stage dropped and goes first, not to lose its deletes
+    for (int i = 0; i < guiObjects.size(); i++)
+    {
+        t.gui.add(guiObjects.get(i));
+    }
+    guiObjects.clear();
 }
 
-bool reactCtrlThread::readMotionPlan(std::vector<Vector> &x_desired)
+void reactCtrlThread::writeTelemetry(const telemetry_t& t)
 {
-    Bottle *inPlan = streamedTargets.read(false);
-
-    bool hasPlan = false;
-    if(inPlan!=nullptr) {
-        yInfo() << "received motionPlan";
-        const size_t nbCtrlPts = inPlan->size();
-
-        for (size_t i=0; i<nbCtrlPts; i++)
-        {
-            if (Bottle* inListTraj = inPlan->get(i).asList())
-            {
-                if (inListTraj->find("number-waypoints").asInt32()>0)
-                {
-                    const int nDim = inListTraj->find("number-dimension").asInt32();
-                    if (nDim>=3)
-                    {
-                        if (Bottle* coordinate = inListTraj->find("waypoint_0").asList())
-                        {
-                            if (coordinate->size()==nDim)
-                            {
-                                Vector xCtrlPt(nDim, 0.0);
-                                for (size_t k=0; k<nDim; k++)
-                                {
-                                    xCtrlPt[k]=coordinate->get(k).asFloat64();
-                                }
-                                const std::string ctrlPtName = inListTraj->find("control-point").asString();
-                                yInfo("\tControl point of %s\t: %s\n",ctrlPtName.c_str(),xCtrlPt.toString(3,3).c_str());
-                                x_desired.push_back(xCtrlPt);
-                                hasPlan = true;
-                            }
-                        }
-                    }
-                }
-            }
-        }
+    ScopedTiming timing(timings[TIMING_WRITE]);
+    if (t.dataOn)
+    {
+        outPort.setEnvelope(t.ts);
+        outPort.write(t.data);
+    }
+    if (t.obsOn)
+    {
+        outObsPort.setEnvelope(t.ts);
+        outObsPort.write(t.obs);
+    }
+    if (t.gui.size() > 0)
+    {
+        visuhdl.sendiCubGuiObjects(t.gui);
     }
-    return hasPlan;
 }
 
-
 bool reactCtrlThread::readStreamingTarget()
 {
-    if (Bottle *xdNew=streamedTargets.read(false))
+    // only the last target matters
+    bool received = false;
+    while (streamedTargets.records().pop(target))
+    {
+        received = true;
+    }
+    if (received)
     {
-        main_arm->x_d = {xdNew->get(0).asFloat64(), xdNew->get(1).asFloat64(), xdNew->get(2).asFloat64()};
+        const double* v = target.values;
+        main_arm->x_d = {v[0], v[1], v[2]};
         main_arm->x_0 = main_arm->x_t;
         main_arm_constr = true;
-        if (xdNew->size() <= 7)
+        if (target.size <= 7)
         {
-            if (xdNew->size() == 7 && xdNew->get(6).isFloat64()) {
-                main_arm->o_d = {xdNew->get(3).asFloat64(), xdNew->get(4).asFloat64(),
-                                 xdNew->get(5).asFloat64(), xdNew->get(6).asFloat64()};
+            if (target.orientation) {
+                main_arm->o_d = axisAngleToQuaternion(Vector{v[3], v[4], v[5], v[6]});
             }
-            else if (xdNew->size() >= 6 && second_arm)
+            else if (target.size >= 6 && second_arm)
             {
-                second_arm->x_d = {xdNew->get(3).asFloat64(), xdNew->get(4).asFloat64(), xdNew->get(5).asFloat64()};
+                second_arm->x_d = {v[3], v[4], v[5]};
                 second_arm->x_0 = second_arm->x_t;
-                if (xdNew->size() == 7) {
-                    main_arm_constr = xdNew->get(6).asInt32();
+                if (target.size == 7) {
+                    main_arm_constr = static_cast<int>(v[6]);
                 }
             }
         }
         else if (second_arm)
         {
-            second_arm->x_d = {xdNew->get(8).asFloat64(), xdNew->get(9).asFloat64(), xdNew->get(10).asFloat64()};
+            second_arm->x_d = {v[8], v[9], v[10]};
             second_arm->x_0 = second_arm->x_t;
-            if (xdNew->size() == 12) {
-                main_arm_constr = xdNew->get(11).asInt32();
+            if (target.size == 12) {
+                main_arm_constr = static_cast<int>(v[11]);
             }
-            if (xdNew->size() >= 15)
+            if (target.size >= 15)
             {
-                second_arm->o_d = {xdNew->get(11).asFloat64(), xdNew->get(12).asFloat64(),
-                                   xdNew->get(13).asFloat64(), xdNew->get(14).asFloat64()};
-                if (xdNew->size() == 16) {
-                    main_arm_constr = xdNew->get(15).asInt32();
+                second_arm->o_d = axisAngleToQuaternion(Vector{v[11], v[12], v[13], v[14]});
+                if (target.size == 16) {
+                    main_arm_constr = static_cast<int>(v[15]);
                 }
             }
         }
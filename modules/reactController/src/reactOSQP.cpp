@@ -8,22 +8,22 @@
 #include <fstream>
 
 
-ArmHelper::ArmHelper(iCubArm *chain_, double dt_, int offset_,  double vmax_, const Vector& restPos,
+ArmHelper::ArmHelper(KinematicState *kin_, double dt_, int offset_,  double vmax_, const Vector& restPos,
                      bool hitting_constr_, int vars_offset_, int constr_offset_):
-        arm(chain_), offset(offset_), dt(dt_), vmax(vmax_), adapt_w5(0), rest_jnt_pos(restPos),
+        kin(kin_), arm(kin_->chain()), offset(offset_), dt(dt_), vmax(vmax_), adapt_w5(0), rest_jnt_pos(restPos),
         hit_constr(hitting_constr_), vars_offset(vars_offset_), constr_offset(constr_offset_)
 {
     chain_dof = static_cast<int>(arm->getDOF())-offset;
     v0.resize(chain_dof, 0.0);
     v_lim.resize(chain_dof, 2);
     rest_w = {1, 100, 1, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5};
-    J0 = arm->GeoJacobian();
+    J0 = kin->jacobian();
     computeGuard();
 }
 
-void ArmHelper::init(const Vector &_xr, const Vector &_v0, const Matrix &_v_lim)
+void ArmHelper::init(const Vector &_xr, const Eigen::Quaterniond &_or, const Vector &_v0, const Matrix &_v_lim)
 {
-    yAssert(7 <= _xr.length());
+    yAssert(3 <= _xr.length());
     yAssert(v0.length() == _v0.length());
     yAssert((v_lim.rows() == _v_lim.rows()) && (v_lim.cols() == _v_lim.cols()));
     for (int r=0; r < _v_lim.rows(); r++)
@@ -33,17 +33,15 @@ void ArmHelper::init(const Vector &_xr, const Vector &_v0, const Matrix &_v_lim)
     v_lim= CTRL_DEG2RAD * _v_lim;
     v0= CTRL_DEG2RAD * _v0;
     q0=arm->getAng();
-    const Matrix H0=arm->getH();
+    const Matrix& H0=kin->endEffector();
     const Vector p0=H0.getCol(3).subVector(0,2);
     const Vector pr=_xr.subVector(0, 2);
-    const Vector ang=_xr.subVector(3,6);
-    const Matrix R = axis2dcm(ang).submatrix(0,2,0,2)*H0.submatrix(0,2,0,2).transposed();
+    // rotation from the current to the desired orientation, as angular velocity over dt
+    const Eigen::Vector3d w = rotationVector(_or * kin->orientation().conjugate()) / dt;
     v_des.resize(6,0);
     v_des.setSubvector(0, (pr-p0) / dt);
-//    Vector v2 = dcm2rpy(R) / dt;
-    Vector axang = dcm2axis(R);
-    v_des.setSubvector(3, axang.subVector(0,2) * axang(3) / dt);
-    J0=arm->GeoJacobian();
+    v_des.setSubvector(3, Vector{w.x(), w.y(), w.z()});
+    J0=kin->jacobian();
     const double manip_thr = 0.05;
     Matrix U,V;
     Vector S;
@@ -209,14 +207,14 @@ void ArmHelper::addConstraints(Eigen::SparseMatrix<double>& linearMatrix, int ob
 
 //public:
 /****************************************************************/
-QPSolver::QPSolver(iCubArm *chain_, bool hitConstr, iCubArm* second_chain_, double vmax_, bool orientationControl_,
+QPSolver::QPSolver(KinematicState *kin_, bool hitConstr, KinematicState* second_kin_, double vmax_, bool orientationControl_,
                              double dT_, const Vector& restPos, double restPosWeight_, const std::string& part_) :
         second_arm(nullptr), dt(dT_), w2(restPosWeight_), orig_w2(restPosWeight_), w3(10), w4(0.05), part(part_), obsConstrActive(false) // TODO: w3 = 10, w4 = 0.05 is original // for bubbles is w3 = 0.01 and w4 = 0.5, for one-arm exp w3=1, w4=0.05, for bimanual w3 =0.1 and w=0.5
 {
-    main_arm = std::make_unique<ArmHelper>(chain_, dt, 0, vmax_*CTRL_DEG2RAD, restPos, hitConstr);
+    main_arm = std::make_unique<ArmHelper>(kin_, dt, 0, vmax_*CTRL_DEG2RAD, restPos, hitConstr);
     vars_offset = main_arm->chain_dof + 6; // + 1;
     constr_offset = main_arm->chain_dof + 12 + 3 + hitConstr * 3 + obs_constr_num/2;
-    second_arm = second_chain_ ? std::make_unique<ArmHelper>(second_chain_, dt, 3, vmax_*CTRL_DEG2RAD, restPos,
+    second_arm = second_kin_ ? std::make_unique<ArmHelper>(second_kin_, dt, 3, vmax_*CTRL_DEG2RAD, restPos,
                                                         hitConstr,vars_offset, constr_offset) : nullptr;
     if (!orientationControl_) w4 = 0;
     int vars = vars_offset;
@@ -285,16 +283,17 @@ QPSolver::QPSolver(iCubArm *chain_, bool hitConstr, iCubArm* second_chain_, doub
 QPSolver::~QPSolver() = default;
 
 /****************************************************************/
-void QPSolver::init(const Vector &_xr, const Vector &_v0, const Matrix &_v_lim, double rest_pos_w,
-                    const std::vector<yarp::sig::Vector>& Aobs, const std::vector<double> &bvals,
+void QPSolver::init(const Vector &_xr, const Eigen::Quaterniond &_or, const Vector &_v0, const Matrix &_v_lim,
+                    double rest_pos_w, const std::vector<yarp::sig::Vector>& Aobs, const std::vector<double> &bvals,
                     const std::vector<yarp::sig::Vector>& Aobs2, const std::vector<double> &bvals2,
-                    const Vector &_xr2, const Vector &_v02, const Matrix &_v2_lim, bool ee_dist_constr_)
+                    const Vector &_xr2, const Eigen::Quaterniond &_or2, const Vector &_v02, const Matrix &_v2_lim,
+                    bool ee_dist_constr_)
 {
     eeDistConstr = ee_dist_constr_;
     obsConstrActive = false;
     w2 = (rest_pos_w >= 0) ? rest_pos_w : orig_w2;
-    main_arm->init(_xr, _v0, _v_lim);
-    if (second_arm) second_arm->init(_xr2, _v02, _v2_lim);
+    main_arm->init(_xr, _or, _v0, _v_lim);
+    if (second_arm) second_arm->init(_xr2, _or2, _v02, _v2_lim);
     for (int i = 0; i < obs_constr_num/2; ++i)
     {
         int j = 0;
@@ -349,10 +348,10 @@ void QPSolver::update_bounds(double pos_error, bool main_arm_constr)
     if (second_arm) {
         second_arm->updateBounds(lowerBound, upperBound, main_arm_constr ? std::numeric_limits<double>::max() : pos_error);
 
-        const Vector x1 = main_arm->arm->getH().getCol(3).subVector(0, 2);
-        const Vector x2 = second_arm->arm->getH().getCol(3).subVector(0, 2);
-        const Vector o1 = main_arm->arm->EndEffPose(true).subVector(3,6);
-        const Vector o2 = second_arm->arm->EndEffPose(true).subVector(3,6);
+        const Vector x1 = main_arm->kin->position();
+        const Vector x2 = second_arm->kin->position();
+        const Vector o1 = main_arm->kin->pose().subVector(3,6);
+        const Vector o2 = second_arm->kin->pose().subVector(3,6);
         const Vector ref_dist = {0.0, 0.15,0.0, 0.0,0.0,0.0};
         if (eeDistConstr) {
 //            printf("Ori main arm %s\tOri second arm %s\n", main_arm->arm->EndEffPose(true).subVector(3,6).toString(3).c_str(), second_arm->arm->EndEffPose(true).subVector(3,6).toString(3).c_str());
@@ -0,0 +1,220 @@
+//
+// Real-time execution profile of the control thread: CPU affinity, SCHED_FIFO, memory locking and prefaulting.
+//
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+#include <yarp/os/Log.h>
+#include "realtimeProfile.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <sys/mman.h>
+
+namespace
+{
+    // touches the stack below the caller, so that its pages are mapped (and locked) before the first cycle
+#if defined(__GNUC__)
+    __attribute__((noinline))
+#endif
+    void touchStack(const size_t bytes, const size_t page)
+    {
+        volatile unsigned char* buffer = static_cast<volatile unsigned char*>(alloca(bytes));
+        for (size_t i = 0; i < bytes; i += page)
+        {
+            buffer[i] = 0;
+        }
+    }
+}
+#endif
+
+
+RealtimeProfile::RealtimeProfile(settings_t _settings, const unsigned int _verbosity):
+        settings(std::move(_settings)), verbosity(_verbosity)
+{ }
+
+bool RealtimeProfile::enabled() const
+{
+    return !settings.cpus.empty() || !settings.workerCpus.empty() || settings.priority > 0 || settings.lockMemory ||
+           settings.prefault > 0.0;
+}
+
+#if defined(__linux__)
+
+bool RealtimeProfile::setupMemory()
+{
+    bool ok = true;
+    if (settings.lockMemory)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        {
+            note("memory locked");
+        }
+        else
+        {
+            yWarning("[RealtimeProfile] could not lock the memory (%s), pages may be swapped out", strerror(errno));
+            ok = false;
+        }
+    }
+    if (settings.prefault > 0.0)
+    {
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t bytes = static_cast<size_t>(settings.prefault * 1024.0 * 1024.0);
+        printMessage(2, "prefaulting %lu B of heap and %lu B of stack, pages of %lu B\n", bytes, STACK_PREFAULT, page);
+        // the freed block has to stay in the heap instead of going back to the OS
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+        if (auto* heap = static_cast<unsigned char*>(malloc(bytes)))
+        {
+            for (size_t i = 0; i < bytes; i += page)
+            {
+                heap[i] = 0;
+            }
+            free(heap);
+            touchStack(STACK_PREFAULT, page);
+            note("prefaulted " + std::to_string(bytes >> 20) + " MB of heap and " +
+                              std::to_string(STACK_PREFAULT >> 10) + " kB of stack");
+        }
+        else
+        {
+            yWarning("[RealtimeProfile] could not allocate %.1f MB to prefault", settings.prefault);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool RealtimeProfile::setupControlThread()
+{
+    const pthread_t self = pthread_self();
+    bool ok = pin(self, settings.cpus, "control thread");
+    ok &= schedule(self, settings.priority, "control thread");
+    return ok;
+}
+
+bool RealtimeProfile::setupWorker(const std::thread::native_handle_type h, const bool realtime)
+{
+    bool ok = pin(h, settings.workerCpus, "worker");
+    if (realtime)
+    {
+        ok &= schedule(h, settings.priority, "worker");
+    }
+    return ok;
+}
+
+bool RealtimeProfile::pin(const std::thread::native_handle_type h, const std::vector<int>& cpus, const std::string& what)
+{
+    if (cpus.empty()) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int c : cpus)
+    {
+        if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    const int err = pthread_setaffinity_np(h, sizeof(set), &set);
+    if (err != 0)
+    {
+        yWarning("[RealtimeProfile] could not pin the %s to CPUs %s (%s)", what.c_str(), cpuList(cpus).c_str(), strerror(err));
+        return false;
+    }
+    note(what + " on CPUs " + cpuList(cpus));
+    return true;
+}
+
+bool RealtimeProfile::schedule(const std::thread::native_handle_type h, const int priority, const std::string& what)
+{
+    if (priority <= 0) return true;
+    sched_param param{};
+    param.sched_priority = std::min(std::max(priority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+    const int err = pthread_setschedparam(h, SCHED_FIFO, &param);
+    if (err != 0)
+    {
+        yWarning("[RealtimeProfile] could not set SCHED_FIFO %d for the %s (%s), keeping the default scheduling",
+                 param.sched_priority, what.c_str(), strerror(err));
+        return false;
+    }
+    note(what + " SCHED_FIFO " + std::to_string(param.sched_priority));
+    return true;
+}
+
+#else
+
+bool RealtimeProfile::setupMemory()
+{
+    if (settings.lockMemory || settings.prefault > 0.0)
+    {
+        yWarning("[RealtimeProfile] memory locking and prefaulting are only supported on Linux");
+        return false;
+    }
+    return true;
+}
+
+bool RealtimeProfile::setupControlThread()
+{
+    return pin(std::thread::native_handle_type(), settings.cpus, "control thread") &
+           schedule(std::thread::native_handle_type(), settings.priority, "control thread");
+}
+
+bool RealtimeProfile::setupWorker(const std::thread::native_handle_type h, const bool realtime)
+{
+    return pin(h, settings.workerCpus, "worker") & (!realtime || schedule(h, settings.priority, "worker"));
+}
+
+bool RealtimeProfile::pin(std::thread::native_handle_type, const std::vector<int>& cpus, const std::string& what)
+{
+    if (cpus.empty()) return true;
+    yWarning("[RealtimeProfile] CPU affinity of the %s is only supported on Linux", what.c_str());
+    return false;
+}
+
+bool RealtimeProfile::schedule(std::thread::native_handle_type, const int priority, const std::string& what)
+{
+    if (priority <= 0) return true;
+    yWarning("[RealtimeProfile] SCHED_FIFO for the %s is only supported on Linux", what.c_str());
+    return false;
+}
+
+#endif
+
+void RealtimeProfile::note(const std::string& setting)
+{
+    // the workers share their settings, each is reported once
+    if (std::find(applied.begin(), applied.end(), setting) == applied.end())
+    {
+        applied.push_back(setting);
+    }
+}
+
+std::string RealtimeProfile::cpuList(const std::vector<int>& cpus)
+{
+    std::string s;
+    for (const int c : cpus)
+    {
+        s += (s.empty() ? "" : ",") + std::to_string(c);
+    }
+    return s;
+}
+
+int RealtimeProfile::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[RealtimeProfile] ");
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
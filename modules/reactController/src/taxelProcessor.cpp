@@ -0,0 +1,192 @@
+//
+// Contacts computed directly from the raw taxel pressures, without going through the skin events aggregator.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <yarp/os/Log.h>
+#include "taxelProcessor.h"
+
+using namespace iCub::skinDynLib;
+
+
+TaxelProcessor::TaxelProcessor(const double _threshold, const unsigned int _verbosity):
+        threshold(_threshold), verbosity(_verbosity)
+{
+    contacts.reserve(16);
+}
+
+int TaxelProcessor::printMessage(const unsigned int l, const char *f, ...) const
+{
+    if (verbosity>=l)
+    {
+        fprintf(stdout,"[TaxelProcessor] ");
+
+        va_list ap;
+        va_start(ap,f);
+        const int ret=vfprintf(stdout,f,ap);
+        va_end(ap);
+        return ret;
+    }
+    return -1;
+}
+
+bool TaxelProcessor::addPart(const SkinPart sp, const std::string& calibFile)
+{
+    std::ifstream in(calibFile);
+    if (!in.is_open())
+    {
+        yError("[TaxelProcessor] Unable to open calibration file %s", calibFile.c_str());
+        return false;
+    }
+
+    part_t p;
+    p.sp = sp;
+    std::string line;
+    bool inCalibration = false;
+    while (std::getline(in, line))
+    {
+        if (!inCalibration)
+        {
+            inCalibration = line.find("[calibration]") != std::string::npos;
+            continue;
+        }
+        if (line.find('[') != std::string::npos) break; // next group
+        std::istringstream ss(line);
+        double v[6];
+        if (!(ss >> v[0] >> v[1] >> v[2] >> v[3] >> v[4] >> v[5])) continue;
+        p.px.push_back(v[0]); p.py.push_back(v[1]); p.pz.push_back(v[2]);
+        p.nx.push_back(v[3]); p.ny.push_back(v[4]); p.nz.push_back(v[5]);
+        p.mounted.push_back(v[3] != 0.0 || v[4] != 0.0 || v[5] != 0.0);
+    }
+    p.n = static_cast<int>(p.px.size());
+    if (p.n == 0)
+    {
+        yError("[TaxelProcessor] No taxels found in the [calibration] group of %s", calibFile.c_str());
+        return false;
+    }
+
+    // neighbours within the radius, once and for all (a few hundred taxels per part)
+    const float r2 = static_cast<float>(NEIGHBOR_RADIUS * NEIGHBOR_RADIUS);
+    p.nbrStart.assign(1, 0);
+    for (int i = 0; i < p.n; i++)
+    {
+        for (int j = 0; p.mounted[i] && j < p.n; j++)
+        {
+            if (j == i || !p.mounted[j]) continue;
+            const float dx = p.px[i]-p.px[j], dy = p.py[i]-p.py[j], dz = p.pz[i]-p.pz[j];
+            if (dx*dx + dy*dy + dz*dz < r2) p.nbr.push_back(j);
+        }
+        p.nbrStart.push_back(static_cast<int>(p.nbr.size()));
+    }
+    p.pressure.assign(p.n, 0.0f);
+    p.active.assign(p.n, 0);
+    stack.reserve(std::max<size_t>(stack.capacity(), p.n));
+    printMessage(1, "%s: %d taxels (%ld mounted), %lu neighbour pairs\n", SkinPart_s[sp].c_str(), p.n,
+                 std::count(p.mounted.begin(), p.mounted.end(), 1), p.nbr.size() / 2);
+    parts.push_back(std::move(p));
+    return true;
+}
+
+bool TaxelProcessor::open(const std::string& prefix)
+{
+    bool ok = true;
+    for (auto& p : parts)
+    {
+        p.port = std::make_unique<yarp::os::BufferedPort<yarp::sig::Vector>>();
+        if (!p.port->open(prefix+"/skin/"+SkinPart_s[p.sp]+":i"))
+        {
+            yError("[TaxelProcessor] Unable to open port for skin part %s", SkinPart_s[p.sp].c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void TaxelProcessor::close()
+{
+    for (auto& p : parts)
+    {
+        if (!p.port) continue;
+        p.port->interrupt();
+        p.port->close();
+    }
+}
+
+const std::vector<TaxelProcessor::contact_t>& TaxelProcessor::process()
+{
+    contacts.clear();
+    for (auto& p : parts)
+    {
+        const yarp::sig::Vector* raw = p.port ? p.port->read(false) : nullptr;
+        if (raw == nullptr) continue;
+
+        const int n = std::min(p.n, static_cast<int>(raw->size()));
+        const double* v = raw->data();
+        float* pr = p.pressure.data();
+        uint8_t* act = p.active.data();
+        const uint8_t* mounted = p.mounted.data();
+        const float thr = static_cast<float>(threshold);
+        // branch-free over contiguous arrays, so that it is vectorized
+        for (int i = 0; i < n; i++)
+        {
+            pr[i] = static_cast<float>(v[i]);
+            act[i] = static_cast<uint8_t>((pr[i] > thr) & mounted[i]);
+        }
+        std::fill(act + n, act + p.n, 0);
+        cluster(p);
+    }
+    return contacts;
+}
+
+void TaxelProcessor::cluster(part_t& p)
+{
+    for (int seed = 0; seed < p.n; seed++)
+    {
+        if (!p.active[seed]) continue;
+
+        // flood fill of the blob; visited taxels are cleared from the active mask
+        double w = 0, x[3] = {0,0,0}, nrm[3] = {0,0,0};
+        float peak = 0;
+        int count = 0;
+        stack.clear();
+        stack.push_back(seed);
+        p.active[seed] = 0;
+        while (!stack.empty())
+        {
+            const int i = stack.back();
+            stack.pop_back();
+            const double wi = p.pressure[i] - threshold;
+            w += wi;
+            x[0] += wi * p.px[i]; x[1] += wi * p.py[i]; x[2] += wi * p.pz[i];
+            nrm[0] += wi * p.nx[i]; nrm[1] += wi * p.ny[i]; nrm[2] += wi * p.nz[i];
+            peak = std::max(peak, p.pressure[i]);
+            count++;
+            for (int k = p.nbrStart[i]; k < p.nbrStart[i+1]; k++)
+            {
+                const int j = p.nbr[k];
+                if (p.active[j])
+                {
+                    p.active[j] = 0;
+                    stack.push_back(j);
+                }
+            }
+        }
+
+        const double nn = std::sqrt(nrm[0]*nrm[0] + nrm[1]*nrm[1] + nrm[2]*nrm[2]);
+        if (w <= 0 || nn < 1e-9) continue;
+        contact_t c{p.sp, yarp::sig::Vector(3), yarp::sig::Vector(3), std::min(1.0, peak / SATURATION), count};
+        for (int k = 0; k < 3; k++)
+        {
+            c.x[k] = x[k] / w;
+            c.n[k] = nrm[k] / nn;
+        }
+        printMessage(3, "%s: contact of %d taxels at %s, activation %.2f\n", SkinPart_s[p.sp].c_str(), count,
+                     c.x.toString(3).c_str(), c.activation);
+        contacts.push_back(c);
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Lock-free histogram of durations with a bounded relative error, for the timing of the stages of the control cycle.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "timingHistogram.h"
+
+
+TimingHistogram::TimingHistogram(): total(0), sum(0), longest(0)
+{
+    for (auto& c : counts)
+    {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+void TimingHistogram::record(const Clock::duration d)
+{
+    const auto us = static_cast<uint64_t>(std::max<int64_t>(0,
+                        std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+    // one writer: plain load and store, no read-modify-write is needed
+    auto& c = counts[bucketOf(us)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum.store(sum.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+    if (us > longest.load(std::memory_order_relaxed)) longest.store(us, std::memory_order_relaxed);
+    total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+double TimingHistogram::percentile(const double p) const
+{
+    const unsigned long n = total.load(std::memory_order_relaxed);
+    if (n == 0) return 0.0;
+    const auto rank = static_cast<unsigned long>(std::ceil(std::min(std::max(p, 0.0), 100.0) / 100.0 * n));
+    unsigned long seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= std::max(rank, 1ul))
+        {
+            // the bound of the bucket, but never above the longest duration recorded (the last bucket has no bound)
+            const uint64_t max = longest.load(std::memory_order_relaxed);
+            return (i + 1 == BUCKETS ? max : std::min(upperBound(i), max)) / 1000.0;
+        }
+    }
+    return longest.load(std::memory_order_relaxed) / 1000.0;
+}
+
+TimingHistogram::summary_t TimingHistogram::summary() const
+{
+    summary_t s;
+    s.count = total.load(std::memory_order_relaxed);
+    if (s.count == 0) return s;
+    s.mean = static_cast<double>(sum.load(std::memory_order_relaxed)) / s.count / 1000.0;
+    s.p50 = percentile(50.0);
+    s.p90 = percentile(90.0);
+    s.p99 = percentile(99.0);
+    s.p999 = percentile(99.9);
+    s.max = longest.load(std::memory_order_relaxed) / 1000.0;
+    return s;
+}
+
+size_t TimingHistogram::bucketOf(uint64_t us)
+{
+    us = std::min<uint64_t>(us, (uint64_t(1) << MAX_BITS) - 1);
+    if (us < SUB_COUNT) return static_cast<size_t>(us);
+    int msb = 0;
+    while ((us >> (msb + 1)) != 0) msb++;
+    const int shift = msb - (SUB_BITS - 1); // us >> shift is in [HALF_COUNT, SUB_COUNT)
+    return static_cast<size_t>(SUB_COUNT + (shift - 1) * HALF_COUNT + ((us >> shift) - HALF_COUNT));
+}
+
+uint64_t TimingHistogram::upperBound(const size_t bucket)
+{
+    if (bucket < SUB_COUNT) return bucket;
+    const uint64_t shift = (bucket - SUB_COUNT) / HALF_COUNT + 1;
+    const uint64_t sub = (bucket - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
@@ -118,17 +118,25 @@ void VisualisationHandler::closePorts()
     }
 }
 
-void VisualisationHandler::visualizeObjects(const Vector& x_d, const Vector& x_n, const Vector& x2_d, const Vector& x2_n)
+void VisualisationHandler::visualizeObjects(const Vector& x_d, const Vector& x_n, const Vector& x2_d, const Vector& x2_n,
+                                            Bottle* gui)
 {
-    visualizeObjects(x_d, x_n);
+    visualizeObjects(x_d, x_n, gui);
 
-    if (visualizeTargetIniCubGui) sendiCubGuiObject("target_2", x2_d);
-
-    if(visualizeParticleIniCubGui) sendiCubGuiObject("particle_2", x2_n);
+    if (visualizeTargetIniCubGui)
+    {
+        if (gui) addiCubGuiObject(*gui, "target_2", x2_d);
+        else sendiCubGuiObject("target_2", x2_d);
+    }
 
+    if (visualizeParticleIniCubGui)
+    {
+        if (gui) addiCubGuiObject(*gui, "particle_2", x2_n);
+        else sendiCubGuiObject("particle_2", x2_n);
+    }
 }
 
-void VisualisationHandler::visualizeObjects(const Vector& x_d, const Vector& x_n)
+void VisualisationHandler::visualizeObjects(const Vector& x_d, const Vector& x_n, Bottle* gui)
 {
     if(visualizeTargetInSim)
     {
@@ -137,10 +145,17 @@ void VisualisationHandler::visualizeObjects(const Vector& x_d, const Vector& x_n
         moveSphere(1,x_d_sim);
     }
 
-    if (visualizeTargetIniCubGui) sendiCubGuiObject("target", x_d);
-
+    if (visualizeTargetIniCubGui)
+    {
+        if (gui) addiCubGuiObject(*gui, "target", x_d);
+        else sendiCubGuiObject("target", x_d);
+    }
 
-    if(visualizeParticleIniCubGui) sendiCubGuiObject("particle", x_n);
+    if (visualizeParticleIniCubGui)
+    {
+        if (gui) addiCubGuiObject(*gui, "particle", x_n);
+        else sendiCubGuiObject("particle", x_n);
+    }
 
     if (visualizeParticleInSim)
     {
@@ -199,6 +214,42 @@ void VisualisationHandler::sendiCubGuiObject(const std::string& object_type, Vec
 }
 
 
+void VisualisationHandler::sendiCubGuiObjects(const Bottle& objects)
+{
+    // iCubGui takes one object per message
+    for (int i = 0; i < objects.size(); i++)
+    {
+        const Bottle* obj = objects.get(i).asList();
+        if (obj == nullptr) continue;
+        if (obj->size() == 1)
+        {
+            deleteiCubGuiObject(obj->get(0).asString());
+        }
+        else if (obj->size() >= 4)
+        {
+            sendiCubGuiObject(obj->get(0).asString(), Vector{obj->get(1).asFloat64(), obj->get(2).asFloat64(),
+                                                             obj->get(3).asFloat64()});
+        }
+    }
+}
+
+
+void VisualisationHandler::addiCubGuiObject(Bottle& objects, const std::string& object_type, const Vector& x)
+{
+    Bottle& obj = objects.addList();
+    obj.addString(object_type);
+    obj.addFloat64(x(0));
+    obj.addFloat64(x(1));
+    obj.addFloat64(x(2));
+}
+
+
+void VisualisationHandler::addiCubGuiDelete(Bottle& objects, const std::string& object_type)
+{
+    objects.addList().addString(object_type);
+}
+
+
 void VisualisationHandler::deleteiCubGuiObject(const std::string& object_type)
 {
     if (outPortiCubGui.getOutputCount()>0)
@@ -0,0 +1,90 @@
+//
+// Persistent pool of worker threads for data-parallel loops inside the control cycle.
+//
+
+#include "workerPool.h"
+
+
+WorkerPool::WorkerPool(const unsigned int nWorkers, const int _crossover): crossover(_crossover), stopping(false),
+                                                                           generation(0), task(nullptr), context(nullptr),
+                                                                           count(0), next(0), busy(0)
+{
+    for (unsigned int i = 0; i < nWorkers; i++)
+    {
+        workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        stopping = true;
+    }
+    wakeCv.notify_all();
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+}
+
+std::vector<std::thread::native_handle_type> WorkerPool::nativeHandles()
+{
+    std::vector<std::thread::native_handle_type> handles;
+    for (auto& w : workers)
+    {
+        handles.push_back(w.native_handle());
+    }
+    return handles;
+}
+
+void WorkerPool::run(const int n, const task_t t, void* ctx)
+{
+    {
+        std::lock_guard<std::mutex> lg(mtx);
+        task = t;
+        context = ctx;
+        count = n;
+        next.store(0);
+        busy = static_cast<int>(workers.size());
+        generation++;
+    }
+    wakeCv.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lk(mtx);
+    doneCv.wait(lk, [this]() { return busy == 0; });
+    task = nullptr;
+    context = nullptr;
+}
+
+void WorkerPool::drain()
+{
+    for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+    {
+        task(context, i);
+    }
+}
+
+void WorkerPool::workerLoop()
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            wakeCv.wait(lk, [&]() { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        drain();
+
+        {
+            std::lock_guard<std::mutex> lg(mtx);
+            busy--;
+        }
+        doneCv.notify_one();
+    }
+}